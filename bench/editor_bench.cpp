@@ -0,0 +1,274 @@
+// Replays scripted keystrokes against the headless editor and reports how
+// long each key takes to process and draw, as the terminal front end would
+// see it. Frames are composed and diffed off-screen; nothing is written to a
+// terminal.
+//
+//   TextEditorBench [--lines 1000,100000,...] [--keys N] [--rows R]
+//                   [--cols C] [--seed S] [--dir DIR] [--idle US]
+//
+// With --idle, highlighting runs in the background with US microseconds
+// between keys, and key times include waiting for the worker.
+
+#include <ncurses.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "editor.h"
+#include "synthetic.h"
+
+struct Options
+{
+  std::vector<size_t> sizes = {1000, 100000, 1000000, 10000000};
+  size_t keys = 2000;
+  int rows = 50, cols = 160;
+  uint64_t seed = 1;
+  std::string dir = "/tmp";
+  long idle = -1;
+};
+
+// Keys to set the scene, which are not timed, followed by the keys that are.
+struct Script
+{
+  const char *name;
+  std::vector<int> setup, keys;
+};
+
+using clock_type = std::chrono::steady_clock;
+
+static void appendText(std::vector<int> &keys, const std::string &text)
+{
+  keys.insert(keys.end(), text.begin(), text.end());
+}
+
+static void appendCommand(std::vector<int> &keys, const std::string &command)
+{
+  appendText(keys, ":" + command + "\n");
+}
+
+static std::vector<Script> makeScripts(size_t lines, size_t count, uint64_t seed)
+{
+  BenchRandom random(seed);
+  std::vector<Script> scripts;
+  std::vector<int> middle;
+
+  appendCommand(middle, "l " + std::to_string(lines / 2 + 1));
+  middle.push_back('i');
+
+  Script typing{"type", middle, {}};
+  const char *const code = "value = buffer[index] + 42; // note\n";
+
+  for (size_t i = 0; i < count; i++)
+    typing.keys.push_back(code[i % strlen(code)]);
+  scripts.push_back(typing);
+
+  Script enter{"enter", middle, std::vector<int>(count, '\n')};
+  scripts.push_back(enter);
+
+  Script backspace{"backspace", middle, std::vector<int>(count, KEY_BACKSPACE)};
+  scripts.push_back(backspace);
+
+  // Each search is a whole command typed out, then a few jumps with n.
+  Script find{"find", {}, {}};
+  const char *const words[] = {"value", "offset_17", "flags & 3", "never larger"};
+
+  while (find.keys.size() < count)
+  {
+    appendCommand(find.keys, std::string("f ") + words[random.below(4)]);
+    find.keys.insert(find.keys.end(), {'n', 'n', 'n', 'N'});
+  }
+  scripts.push_back(find);
+
+  Script jump{"goto", {}, {}};
+
+  while (jump.keys.size() < count)
+    appendCommand(jump.keys, "l " + std::to_string(random.below(lines) + 1));
+  scripts.push_back(jump);
+
+  // Down from the middle of the file a line at a time, then back up.
+  Script scroll{"scroll", middle, {}};
+
+  scroll.setup.push_back(27);
+  for (size_t i = 0; i < count; i++)
+    scroll.keys.push_back(i < count / 2 ? KEY_DOWN : KEY_UP);
+  scripts.push_back(scroll);
+
+  return scripts;
+}
+
+// What flushFrame() does, minus the terminal: finds the rows that changed
+// and takes them as shown.
+static void presentFrame(Renderer &r)
+{
+  Frame &next = r.next, &shown = r.shown;
+
+  for (int y = 0; y < next.rows; y++)
+  {
+    if (sameRow(next, shown, y))
+      continue;
+
+    copyRow(next, shown, y);
+  }
+
+  r.resized = false;
+}
+
+static void applyKey(Editor &e, int key)
+{
+  if (processKey(e, key))
+    drawEditor(e);
+  else
+    placeCursor(e);
+
+  flushJournal(e);
+
+  presentFrame(e.renderer);
+}
+
+static double percentile(std::vector<double> &sorted, double fraction)
+{
+  size_t index = std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()));
+  return sorted[index];
+}
+
+static double elapsedMs(clock_type::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+static void runScript(const std::string &fileName, size_t lines, const Options &options, const Script &script)
+{
+  Editor e;
+  e.screenRows = options.rows;
+  e.screenCols = options.cols;
+
+  auto start = clock_type::now();
+  openFile(e, fileName);
+  e.buffer.finishLoading();
+  double loadMs = elapsedMs(start);
+
+  std::unique_lock<Highlighter> hold(e.highlighter, std::defer_lock);
+
+  if (options.idle >= 0)
+  {
+    e.highlighter.start(e.buffer);
+    hold.lock();
+  }
+
+  drawEditor(e);
+  presentFrame(e.renderer);
+
+  for (int key : script.setup)
+    applyKey(e, key);
+
+  std::vector<double> latencies;
+  latencies.reserve(script.keys.size());
+
+  for (int key : script.keys)
+  {
+    if (hold)
+    {
+      hold.unlock();
+      std::this_thread::sleep_for(std::chrono::microseconds(options.idle));
+    }
+
+    auto keyStart = clock_type::now();
+
+    if (options.idle >= 0)
+      hold.lock();
+
+    applyKey(e, key);
+    latencies.push_back(elapsedMs(keyStart) * 1000);
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  e.crashJournal.discard();
+
+  printf("%10zu  %-10s %7zu %10.1f %10.1f %10.1f %10.1f\n", lines, script.name, latencies.size(),
+         percentile(latencies, 0.5), percentile(latencies, 0.99), latencies.back(), loadMs);
+  fflush(stdout);
+}
+
+static std::vector<size_t> parseSizes(const char *text)
+{
+  std::vector<size_t> sizes;
+
+  for (const char *p = text; *p;)
+  {
+    char *end;
+    sizes.push_back(strtoull(p, &end, 10));
+    p = *end == ',' ? end + 1 : end + strlen(end);
+  }
+
+  return sizes;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string option = argv[i];
+
+    if (i + 1 == argc)
+      return false;
+
+    const char *value = argv[++i];
+
+    if (option == "--lines")
+      options.sizes = parseSizes(value);
+    else if (option == "--keys")
+      options.keys = strtoull(value, nullptr, 10);
+    else if (option == "--rows")
+      options.rows = atoi(value);
+    else if (option == "--cols")
+      options.cols = atoi(value);
+    else if (option == "--seed")
+      options.seed = strtoull(value, nullptr, 10);
+    else if (option == "--dir")
+      options.dir = value;
+    else if (option == "--idle")
+      options.idle = atol(value);
+    else
+      return false;
+  }
+
+  return options.keys > 0 && options.rows > 1 && options.cols > 0;
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+
+  if (!parseOptions(argc, argv, options))
+  {
+    fprintf(stderr, "usage: %s [--lines N,N,...] [--keys N] [--rows R] [--cols C] [--seed S] [--dir DIR] [--idle US]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%10s  %-10s %7s %10s %10s %10s %10s\n", "lines", "script", "keys", "p50 us", "p99 us", "max us", "load ms");
+
+  for (size_t lines : options.sizes)
+  {
+    std::string fileName = options.dir + "/texteditor-bench-" + std::to_string(lines) + ".c";
+
+    if (!writeFile(fileName, syntheticC(lines, options.seed)))
+    {
+      fprintf(stderr, "cannot write %s\n", fileName.c_str());
+      return 1;
+    }
+
+    for (const Script &script : makeScripts(lines, options.keys, options.seed))
+      runScript(fileName, lines, options, script);
+
+    remove(fileName.c_str());
+  }
+
+  return 0;
+}
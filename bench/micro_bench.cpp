@@ -0,0 +1,276 @@
+// Throughput of the editor's hot kernels on seeded synthetic files: loading,
+// saving, highlighting, searching and line edits. Prints one JSON document
+// on stdout, with MB/s and ns/op for every kernel and data set, so that runs
+// can be compared for regressions. Progress goes to stderr.
+//
+//   TextEditorMicroBench [--lines N] [--bytes N] [--repeat N] [--seed S]
+//                        [--dir DIR]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "edit.h"
+#include "highlight.h"
+#include "save.h"
+#include "search.h"
+#include "synthetic.h"
+#include "workers.h"
+
+struct Options
+{
+  size_t lines = 1000000;
+  size_t bytes = 16 << 20;
+  int repeat = 3;
+  uint64_t seed = 1;
+  std::string dir = "/tmp";
+};
+
+struct DataSet
+{
+  const char *name;
+  std::string fileName;
+  size_t bytes;
+  const char *literal, *regex;
+};
+
+struct Result
+{
+  std::string kernel, data;
+  size_t bytes, ops;
+  double seconds;
+};
+
+// Edits per run of the insert and erase kernels, at most. Editing a line
+// copies it, so a file of one huge line gets fewer.
+static const size_t EDIT_OPS = 200000;
+static const size_t EDIT_OPS_PER_LINE = 1000;
+
+// Rows highlighted at a time, as when paging through the file.
+static const size_t HIGHLIGHT_WINDOW = 50;
+
+// Jumps per run of the find-next kernel.
+static const size_t FIND_JUMPS = 10000;
+
+using clock_type = std::chrono::steady_clock;
+
+// Runs prepare() then body() `repeat` times and keeps the fastest body.
+static double bestOf(int repeat, const std::function<void()> &prepare, const std::function<void()> &body)
+{
+  double best = 1e300;
+
+  for (int i = 0; i < repeat; i++)
+  {
+    prepare();
+
+    auto start = clock_type::now();
+    body();
+    best = std::min(best, std::chrono::duration<double>(clock_type::now() - start).count());
+  }
+
+  return best;
+}
+
+static void loadFully(TextBuffer &buffer, const std::string &fileName)
+{
+  buffer.load(fileName);
+  buffer.finishLoading();
+}
+
+static void benchData(const DataSet &data, const Options &options, std::vector<Result> &results)
+{
+  auto record = [&](const char *kernel, size_t bytes, size_t ops, double seconds)
+  {
+    results.push_back({kernel, data.name, bytes, ops, seconds});
+    fprintf(stderr, "%-10s %-14s %10.1f MB/s %12.1f ns/op\n", data.name, kernel, bytes / seconds / 1e6, seconds * 1e9 / ops);
+  };
+
+  auto none = []() {};
+  TextBuffer buffer;
+  size_t lines = 0;
+
+  double seconds = bestOf(options.repeat, [&]()
+                          { buffer = TextBuffer(); },
+                          [&]()
+                          { loadFully(buffer, data.fileName); });
+  lines = buffer.size();
+  record("load", data.bytes, lines, seconds);
+
+  std::string savedName = data.fileName + ".saved";
+
+  seconds = bestOf(options.repeat, none, [&]()
+                   { writeSnapshot(savedName, buffer.snapshot(), false); });
+  record("save", data.bytes, lines, seconds);
+
+  // Every 100th line edited, so the snapshot mixes file and edited pieces.
+  for (size_t i = 0; i < lines; i += 100)
+    buffer.insertInLine(i, buffer.lineSize(i), " ");
+
+  seconds = bestOf(options.repeat, none, [&]()
+                   { writeSnapshot(savedName, buffer.snapshot(), false); });
+  record("save_edited", data.bytes + lines / 100, lines, seconds);
+  remove(savedName.c_str());
+
+  // Highlighting starts from a cold state cache each time. Every data set
+  // is lexed as C.
+  std::vector<HighlightData> highlights;
+  const Language &language = *languageFor("synthetic.c");
+
+  seconds = bestOf(options.repeat, [&]()
+                   { buffer = TextBuffer(); loadFully(buffer, data.fileName); },
+                   [&]()
+                   {
+                     for (size_t first = 0; first < lines; first += HIGHLIGHT_WINDOW)
+                     {
+                       highlights.clear();
+                       highlightLines(language, buffer, first, std::min(lines, first + HIGHLIGHT_WINDOW), highlights);
+                     } });
+  record("highlight", data.bytes, lines, seconds);
+
+  WorkerPool pool;
+  size_t matches = 0;
+
+  for (const char *pattern : {data.literal, data.regex})
+  {
+    bool isRegex = pattern == data.regex;
+    Search search;
+
+    seconds = bestOf(options.repeat, [&]()
+                     {
+                       std::string error;
+                       search = Search();
+                       if (isRegex)
+                         search.setRegex(pattern, error);
+                       else
+                         search.setPattern(pattern); },
+                     [&]()
+                     { matches = search.count(buffer, pool); });
+    record(isRegex ? "count_regex" : "count", data.bytes, std::max<size_t>(matches, 1), seconds);
+  }
+
+  Search search;
+  search.setPattern(data.literal);
+
+  seconds = bestOf(options.repeat, none, [&]()
+                   {
+                     TextPos at;
+                     for (size_t i = 0; i < FIND_JUMPS && search.next(buffer, at, at); i++)
+                       at.column++; });
+  record("find_next", data.bytes, FIND_JUMPS, seconds);
+
+  // Single characters typed and erased at random places, then whole lines
+  // inserted and removed.
+  BenchRandom random(options.seed);
+  size_t edits = std::min(EDIT_OPS, lines * EDIT_OPS_PER_LINE);
+
+  seconds = bestOf(options.repeat, none, [&]()
+                   {
+                     for (size_t i = 0; i < edits; i++)
+                     {
+                       size_t line = random.below(buffer.size());
+                       TextPos at{line, random.below(buffer.lineSize(line) + 1)};
+                       insertText(buffer, at, "x");
+                       eraseText(buffer, at, {line, at.column + 1});
+                     } });
+  record("edit_char", 2 * edits, 2 * edits, seconds);
+
+  seconds = bestOf(options.repeat, none, [&]()
+                   {
+                     for (size_t i = 0; i < edits; i++)
+                     {
+                       size_t line = random.below(buffer.size());
+                       buffer.insertLine(line, "int inserted = 0;");
+                       buffer.eraseLine(random.below(buffer.size()));
+                     } });
+  record("edit_line", 2 * edits * 18, 2 * edits, seconds);
+}
+
+static void printJson(const Options &options, const std::vector<Result> &results)
+{
+  printf("{\n  \"seed\": %llu,\n  \"repeat\": %d,\n  \"results\": [\n", (unsigned long long)options.seed, options.repeat);
+
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+
+    printf("    {\"kernel\": \"%s\", \"data\": \"%s\", \"bytes\": %zu, \"ops\": %zu, \"seconds\": %.6f, \"mb_per_s\": %.2f, \"ns_per_op\": %.2f}%s\n",
+           r.kernel.c_str(), r.data.c_str(), r.bytes, r.ops, r.seconds, r.bytes / r.seconds / 1e6, r.seconds * 1e9 / r.ops,
+           i + 1 < results.size() ? "," : "");
+  }
+
+  printf("  ]\n}\n");
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string option = argv[i];
+
+    if (i + 1 == argc)
+      return false;
+
+    const char *value = argv[++i];
+
+    if (option == "--lines")
+      options.lines = strtoull(value, nullptr, 10);
+    else if (option == "--bytes")
+      options.bytes = strtoull(value, nullptr, 10);
+    else if (option == "--repeat")
+      options.repeat = atoi(value);
+    else if (option == "--seed")
+      options.seed = strtoull(value, nullptr, 10);
+    else if (option == "--dir")
+      options.dir = value;
+    else
+      return false;
+  }
+
+  return options.lines > 0 && options.bytes > 0 && options.repeat > 0;
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+
+  if (!parseOptions(argc, argv, options))
+  {
+    fprintf(stderr, "usage: %s [--lines N] [--bytes N] [--repeat N] [--seed S] [--dir DIR]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<DataSet> sets = {
+      {"c", options.dir + "/texteditor-micro.c", 0, "buffer[", "offset_[0-9]+ \\+="},
+      {"minified", options.dir + "/texteditor-micro.min.js", 0, "return 7", "b>9[0-9][0-9]\\)"},
+      {"log", options.dir + "/texteditor-micro.log", 0, "ERROR", "latency=1[0-9]{3}ms"}};
+
+  std::vector<Result> results;
+
+  for (DataSet &data : sets)
+  {
+    std::string name = data.name;
+    std::string text = name == "c"          ? syntheticC(options.lines, options.seed)
+                       : name == "minified" ? syntheticMinified(options.bytes, options.seed)
+                                            : syntheticLog(options.lines, options.seed);
+
+    data.bytes = text.size();
+
+    if (!writeFile(data.fileName, text))
+    {
+      fprintf(stderr, "cannot write %s\n", data.fileName.c_str());
+      return 1;
+    }
+
+    text = std::string();
+    benchData(data, options, results);
+    remove(data.fileName.c_str());
+  }
+
+  printJson(options, results);
+  return 0;
+}
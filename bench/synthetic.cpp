@@ -0,0 +1,155 @@
+#include "synthetic.h"
+
+#include <cstdio>
+
+static const char *const TYPES[] = {"int", "char *", "size_t", "double", "struct node *", "unsigned long"};
+static const char *const NAMES[] = {"count", "buffer", "value", "node", "index", "length", "result", "offset"};
+static const char *const HEADERS[] = {"stdio.h", "stdlib.h", "string.h", "stdint.h", "errno.h"};
+
+template <size_t N>
+static const char *pick(BenchRandom &random, const char *const (&words)[N])
+{
+  return words[random.below(N)];
+}
+
+static void appendLine(std::string &out, int depth, const std::string &text)
+{
+  out.append(depth * 2, ' ');
+  out += text;
+  out += '\n';
+}
+
+std::string syntheticC(size_t lines, uint64_t seed)
+{
+  BenchRandom random(seed);
+  std::string out;
+  char line[160];
+  int depth = 0;
+  size_t written = 0, function = 0;
+
+  out.reserve(lines * 32);
+
+  for (; written < lines; written++)
+  {
+    size_t kind = random.below(16);
+
+    if (depth == 0)
+    {
+      if (kind < 2)
+        snprintf(line, sizeof(line), "#include <%s>", pick(random, HEADERS));
+      else if (kind < 4)
+        snprintf(line, sizeof(line), "/* %s helpers, part %zu */", pick(random, NAMES), function);
+      else if (kind < 5)
+        snprintf(line, sizeof(line), "#define %s_MAX %zu", pick(random, NAMES), random.below(4096));
+      else if (kind < 6)
+        line[0] = '\0';
+      else
+      {
+        snprintf(line, sizeof(line), "static %s %s_%zu(%s %s, int flags) {", pick(random, TYPES), pick(random, NAMES), function++, pick(random, TYPES), pick(random, NAMES));
+        appendLine(out, depth++, line);
+        continue;
+      }
+
+      appendLine(out, depth, line);
+      continue;
+    }
+
+    // Blocks close more readily the deeper they are, so functions stay
+    // around a few dozen lines.
+    if (kind < (size_t)depth + 1)
+    {
+      appendLine(out, --depth, "}");
+      continue;
+    }
+
+    if (kind < 6 && depth < 6)
+    {
+      snprintf(line, sizeof(line), "%s (%s_%zu > %zu) {", random.below(2) ? "if" : "while", pick(random, NAMES), random.below(64), random.below(1000));
+      appendLine(out, depth++, line);
+      continue;
+    }
+
+    if (kind < 9)
+      snprintf(line, sizeof(line), "%s %s_%zu = %s[%zu] + 0x%zx;", pick(random, TYPES), pick(random, NAMES), random.below(64), pick(random, NAMES), random.below(256), random.below(65536));
+    else if (kind < 11)
+      snprintf(line, sizeof(line), "printf(\"%s %%d: %%s\\n\", %s, \"%s\");", pick(random, NAMES), pick(random, NAMES), pick(random, NAMES));
+    else if (kind < 13)
+      snprintf(line, sizeof(line), "// %s is never larger than %zu here", pick(random, NAMES), random.below(100000));
+    else if (kind < 14)
+      snprintf(line, sizeof(line), "return %s_%zu * %zu.%zu;", pick(random, NAMES), random.below(64), random.below(100), random.below(100));
+    else
+      snprintf(line, sizeof(line), "%s_%zu += sizeof(%s) * (flags & %zu);", pick(random, NAMES), random.below(64), pick(random, TYPES), random.below(16));
+
+    appendLine(out, depth, line);
+  }
+
+  return out;
+}
+
+std::string syntheticMinified(size_t bytes, uint64_t seed)
+{
+  BenchRandom random(seed);
+  std::string out;
+  char piece[160];
+  size_t function = 0;
+
+  out.reserve(bytes + sizeof(piece));
+
+  while (out.size() < bytes)
+  {
+    size_t kind = random.below(8);
+
+    if (kind < 2)
+      snprintf(piece, sizeof(piece), "function %c%zu(a,b){", 'a' + (int)random.below(26), function++);
+    else if (kind < 4)
+      snprintf(piece, sizeof(piece), "var %c=a[%zu]+\"%s\";", 'a' + (int)random.below(26), random.below(256), pick(random, NAMES));
+    else if (kind < 5)
+      snprintf(piece, sizeof(piece), "if(b>%zu){return %zu}", random.below(1000), random.below(100));
+    else if (kind < 6)
+      snprintf(piece, sizeof(piece), "for(var i=0;i<%zu;i++){b+=i*0x%zx}", random.below(64), random.below(4096));
+    else
+      snprintf(piece, sizeof(piece), "}%s.%s(%zu);", pick(random, NAMES), pick(random, NAMES), random.below(100));
+
+    out += piece;
+  }
+
+  out.resize(bytes);
+  return out;
+}
+
+std::string syntheticLog(size_t lines, uint64_t seed)
+{
+  static const char *const LEVELS[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+  static const char *const EVENTS[] = {"request served", "cache miss", "connection closed", "retrying upstream", "slow query", "session expired"};
+
+  BenchRandom random(seed);
+  std::string out;
+  char line[200];
+  size_t millis = 0;
+
+  out.reserve(lines * 100);
+
+  for (size_t i = 0; i < lines; i++)
+  {
+    millis += random.below(50);
+
+    snprintf(line, sizeof(line), "2024-03-%02zu %02zu:%02zu:%02zu.%03zu %-5s [worker-%zu] %s id=%016llx %s=%zu latency=%zums\n",
+             1 + millis / 86400000 % 28, millis / 3600000 % 24, millis / 60000 % 60, millis / 1000 % 60, millis % 1000,
+             pick(random, LEVELS), random.below(16), pick(random, EVENTS), (unsigned long long)random.next(),
+             pick(random, NAMES), random.below(100000), random.below(2000));
+    out += line;
+  }
+
+  return out;
+}
+
+bool writeFile(const std::string &fileName, const std::string &text)
+{
+  FILE *file = fopen(fileName.c_str(), "wb");
+
+  if (!file)
+    return false;
+
+  bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+  return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A small seeded generator, so every run of a benchmark sees the same data.
+struct BenchRandom
+{
+  uint64_t state;
+
+  explicit BenchRandom(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+  uint64_t next()
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  size_t below(size_t n) { return next() % n; }
+};
+
+// C source of the given number of lines: functions with nested blocks,
+// comments, strings, numbers and preprocessor lines. The same seed always
+// gives the same text.
+std::string syntheticC(size_t lines, uint64_t seed);
+
+// One line of minified code, `bytes` long, with no newline at all.
+std::string syntheticMinified(size_t bytes, uint64_t seed);
+
+// Timestamped server log lines with levels, thread names and request ids.
+std::string syntheticLog(size_t lines, uint64_t seed);
+
+// Writes text to a file, returning whether it all got there.
+bool writeFile(const std::string &fileName, const std::string &text);
@@ -0,0 +1,1891 @@
+#include "buffer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "lz.h"
+#include "simd.h"
+
+// Files at least this large are mapped instead of read.
+static const size_t MMAP_THRESHOLD = 1 << 20;
+
+// Bytes indexed up front by load(); the rest is left to continueLoading().
+static const size_t INITIAL_LOAD_BYTES = 1 << 20;
+
+// finishLoading() still works in slices to bound the temporary index.
+static const size_t FINISH_SLICE_BYTES = 64 << 20;
+
+// Edited lines are copied into snapshots in blocks of at least this size.
+static const size_t SNAPSHOT_CHUNK_BYTES = 1 << 20;
+
+// How far before its target size a chunk may end to end after a separator
+// rather than inside a token.
+static const size_t CHUNK_SEAM_BYTES = 1 << 10;
+
+// Freed pool space below this is not worth copying the pool for.
+static const size_t COMPACT_MIN_BYTES = 4 << 20;
+
+FileData::~FileData()
+{
+  if (mapped)
+    munmap((void *)data, size);
+  else
+    delete[] data;
+
+  if (fd >= 0)
+    close(fd);
+}
+
+// Lines are moved around within leaves on every insertion, so they are
+// copied whole rather than field by field.
+TextBuffer::Line::Line(Line &&other) noexcept
+{
+  memcpy((void *)this, (const void *)&other, sizeof(Line));
+  other.place = IN_POOL;
+  other.extent = {0, 0, 0};
+}
+
+TextBuffer::Line &TextBuffer::Line::operator=(Line &&other) noexcept
+{
+  if (this != &other)
+  {
+    if (place == LONG)
+      delete longLine;
+
+    memcpy((void *)this, (const void *)&other, sizeof(Line));
+    other.place = IN_POOL;
+    other.extent = {0, 0, 0};
+  }
+
+  return *this;
+}
+
+TextBuffer::Line::~Line()
+{
+  if (place == LONG)
+    delete longLine;
+}
+
+TextBuffer::LineState TextBuffer::stateOf(const Line &line)
+{
+  if (line.place == LONG)
+    return line.longLine->state;
+
+  LineState state;
+  state.value = line.value == Line::VALUE_UNKNOWN ? STATE_UNKNOWN : line.value;
+  state.dirty = line.dirty;
+  state.ascii = line.ascii;
+  state.bracketMin = -(int32_t)line.extent.dip;
+  state.bracketSum = (int32_t)line.extent.rise - (int32_t)line.extent.dip;
+  return state;
+}
+
+void TextBuffer::setState(Line &line, const LineState &state)
+{
+  if (line.place == LONG)
+  {
+    line.longLine->state = state;
+    return;
+  }
+
+  line.value = state.value >= Line::VALUE_UNKNOWN ? Line::VALUE_UNKNOWN : state.value;
+  line.dirty = state.dirty;
+  line.ascii = state.ascii;
+  line.extent.dip = -state.bracketMin;
+  line.extent.rise = state.bracketSum - state.bracketMin;
+}
+
+std::string_view TextBuffer::text(const Line &line) const
+{
+  if (line.place == IN_FILE)
+    return std::string_view(file->data + line.offset, line.extent.size);
+
+  if (line.place == IN_POOL)
+    return line.extent.size ? std::string_view(poolText(line.offset), line.extent.size) : std::string_view("", 0);
+
+  const LongLine &longLine = *line.longLine;
+
+  if (!longLine.joined)
+  {
+    longLine.joined = std::make_unique<std::string>();
+    longLine.joined->reserve(longLine.size);
+
+    for (const Chunk &chunk : longLine.chunks)
+      *longLine.joined += chunk.text;
+  }
+
+  return *longLine.joined;
+}
+
+std::string_view TextBuffer::slice(const Line &line, size_t column, size_t count, std::string &joined, size_t &start) const
+{
+  start = 0;
+
+  if (line.place != LONG || line.longLine->joined)
+    return text(line);
+
+  const LongLine &longLine = *line.longLine;
+  column = std::min(column, longLine.size);
+
+  size_t offset = column;
+  size_t k = chunkAt(longLine, offset);
+  const std::string &first = longLine.chunks[k].text;
+
+  if (offset + count <= first.size() || k + 1 == longLine.chunks.size())
+  {
+    start = column - offset;
+    return first;
+  }
+
+  start = column;
+  joined.clear();
+
+  for (; k < longLine.chunks.size() && joined.size() < count; k++, offset = 0)
+    joined.append(longLine.chunks[k].text, offset, count - joined.size());
+
+  return joined;
+}
+
+// Slot sizes are a quarter of a power of two apart, so a line can grow in
+// place and the slot's size follows from the line's.
+size_t TextBuffer::slotBytes(size_t size)
+{
+  if (size <= 8)
+    return size ? 8 : 0;
+
+  size_t step = (size_t)1 << (63 - __builtin_clzll(size) - 2);
+  return (size + step - 1) & ~(step - 1);
+}
+
+char *TextBuffer::allocate(size_t size, uint64_t &offset)
+{
+  const size_t blockBytes = (size_t)1 << POOL_BLOCK_BITS;
+  size_t bytes = slotBytes(size);
+
+  if (pool.empty() || poolUsed + bytes > blockBytes)
+  {
+    pool.emplace_back(new char[blockBytes]);
+    poolUsed = 0;
+  }
+
+  offset = ((pool.size() - 1) << POOL_BLOCK_BITS) + poolUsed;
+  poolUsed += bytes;
+  poolBytes += bytes;
+  return poolText(offset);
+}
+
+void TextBuffer::release(const Line &line)
+{
+  if (line.place == IN_POOL)
+    poolFreed += slotBytes(line.extent.size);
+}
+
+// Puts text, which may lie in the line's own slot, into the pool as the
+// line's new text, in place if it fits the slot.
+void TextBuffer::store(Line &line, std::string_view text)
+{
+  char *slot = line.place == IN_POOL && line.extent.size ? poolText(line.offset) : nullptr;
+
+  if (slot && slotBytes(text.size()) <= slotBytes(line.extent.size))
+  {
+    memmove(slot, text.data(), text.size());
+    poolFreed += slotBytes(line.extent.size) - slotBytes(text.size());
+  }
+  else if (!text.empty())
+  {
+    uint64_t offset;
+    memcpy(allocate(text.size(), offset), text.data(), text.size());
+    release(line);
+    line.offset = offset;
+  }
+  else
+  {
+    release(line);
+  }
+
+  line.place = IN_POOL;
+  line.extent.size = text.size();
+}
+
+// A new line holding text, long or in the pool.
+TextBuffer::Line TextBuffer::makeLine(std::string_view text)
+{
+  Line line;
+
+  if (text.size() > LONG_LINE_BYTES)
+  {
+    line.place = LONG;
+    line.longLine = chunksOf(text);
+  }
+  else
+  {
+    store(line, text);
+  }
+
+  return line;
+}
+
+TextBuffer::TextBuffer()
+{
+  hotLeaves.prev = hotLeaves.next = &hotLeaves;
+}
+
+TextBuffer::~TextBuffer()
+{
+}
+
+TextBuffer::TextBuffer(TextBuffer &&other) noexcept
+    : lexValid(other.lexValid), lexEnd(other.lexEnd), lexDirty(other.lexDirty),
+      budget(other.budget), hotCount(other.hotCount), hotBytes(other.hotBytes),
+      packedBytes(other.packedBytes), packedLeaves(other.packedLeaves.load()),
+      root(std::move(other.root)), rngState(other.rngState), changes(other.changes),
+      measuredMemory(other.measuredMemory), measuredChanges(other.measuredChanges),
+      file(std::move(other.file)), loadOffset(other.loadOffset), scanOffset(other.scanOffset),
+      pool(std::move(other.pool)), poolUsed(other.poolUsed), poolBytes(other.poolBytes), poolFreed(other.poolFreed)
+{
+  hotLeaves.prev = hotLeaves.next = &hotLeaves;
+  takeHotLeaves(other);
+}
+
+TextBuffer &TextBuffer::operator=(TextBuffer &&other) noexcept
+{
+  lexValid = other.lexValid;
+  lexEnd = other.lexEnd;
+  lexDirty = other.lexDirty;
+  root = std::move(other.root);
+  budget = other.budget;
+  hotCount = other.hotCount;
+  hotBytes = other.hotBytes;
+  packedLeaves = other.packedLeaves.load();
+  packedBytes = other.packedBytes;
+  takeHotLeaves(other);
+  rngState = other.rngState;
+  changes = other.changes;
+  measuredMemory = other.measuredMemory;
+  measuredChanges = other.measuredChanges;
+  file = std::move(other.file);
+  loadOffset = other.loadOffset;
+  scanOffset = other.scanOffset;
+  pool = std::move(other.pool);
+  poolUsed = other.poolUsed;
+  poolBytes = other.poolBytes;
+  poolFreed = other.poolFreed;
+  return *this;
+}
+
+// Takes over the list of expanded leaves along with other's leaves, once
+// our own are gone.
+void TextBuffer::takeHotLeaves(TextBuffer &other)
+{
+  HotLink &theirs = other.hotLeaves;
+
+  if (theirs.next != &theirs)
+  {
+    hotLeaves.next = theirs.next;
+    hotLeaves.prev = theirs.prev;
+    hotLeaves.next->prev = &hotLeaves;
+    hotLeaves.prev->next = &hotLeaves;
+    theirs.prev = theirs.next = &theirs;
+  }
+
+  other.hotCount = other.hotBytes = other.packedLeaves = other.packedBytes = 0;
+}
+
+size_t TextBuffer::size() const
+{
+  return lineCount(root);
+}
+
+std::string_view TextBuffer::line(size_t index) const
+{
+  Node *leaf = locate(index);
+  return text(leaf->lines[index]);
+}
+
+size_t TextBuffer::lineSize(size_t index) const
+{
+  Node *leaf = locate(index);
+  return length(leaf->lines[index]);
+}
+
+void TextBuffer::insertInLine(size_t index, size_t column, std::string_view inserted)
+{
+  changes++;
+
+  size_t local = index;
+  Node *leaf = locate(local);
+
+  changedLeaf(leaf);
+  insertInto(leaf->lines[local], index, column, inserted);
+}
+
+std::string TextBuffer::eraseInLine(size_t index, size_t from, size_t to)
+{
+  changes++;
+
+  size_t local = index;
+  Node *leaf = locate(local);
+
+  changedLeaf(leaf);
+  return eraseFrom(leaf->lines[local], index, from, to);
+}
+
+void TextBuffer::replaceInLine(Line &line, size_t index, const LineEdit &edit)
+{
+  if (edit.to > edit.from)
+    eraseFrom(line, index, edit.from, edit.to);
+
+  if (!edit.text.empty())
+    insertInto(line, index, edit.from, edit.text);
+}
+
+void TextBuffer::insertInto(Line &line, size_t index, size_t column, std::string_view inserted)
+{
+  invalidateLine(line, index);
+
+  if (line.place != LONG)
+  {
+    std::string_view old = text(line);
+    std::string joined;
+
+    joined.reserve(old.size() + inserted.size());
+    joined.append(old, 0, column).append(inserted).append(old, column);
+
+    if (joined.size() > LONG_LINE_BYTES)
+      splitIntoChunks(line, joined);
+    else
+      store(line, joined);
+    return;
+  }
+
+  LongLine &longLine = *line.longLine;
+  longLine.joined.reset();
+
+  size_t k = chunkAt(longLine, column);
+  Chunk &chunk = longLine.chunks[k];
+
+  chunk.text.insert(column, inserted);
+  chunk.state.dirty = true;
+  chunk.state.ascii = ASCII_UNKNOWN;
+  longLine.size += inserted.size();
+
+  if (chunk.text.size() > 2 * CHUNK_BYTES)
+    rechunk(longLine, k, k + 1);
+}
+
+std::string TextBuffer::eraseFrom(Line &line, size_t index, size_t from, size_t to)
+{
+  invalidateLine(line, index);
+
+  if (line.place != LONG)
+  {
+    std::string_view old = text(line);
+    std::string removed(old.substr(from, to - from));
+    std::string rest;
+
+    rest.reserve(old.size() - removed.size());
+    rest.append(old, 0, from).append(old, to);
+    store(line, rest);
+    return removed;
+  }
+
+  LongLine &longLine = *line.longLine;
+  longLine.joined.reset();
+
+  std::string removed;
+  removed.reserve(to - from);
+
+  size_t column = from;
+  size_t first = chunkAt(longLine, column), k = first;
+
+  for (; removed.size() < to - from; k++, column = 0)
+  {
+    Chunk &chunk = longLine.chunks[k];
+    size_t count = std::min(to - from - removed.size(), chunk.text.size() - column);
+
+    removed.append(chunk.text, column, count);
+    chunk.text.erase(column, count);
+    chunk.state.dirty = true;
+    chunk.state.ascii = ASCII_UNKNOWN;
+  }
+
+  longLine.size -= removed.size();
+
+  if (longLine.size < LONG_LINE_BYTES / 2)
+  {
+    joinChunks(line);
+    return removed;
+  }
+
+  // The chunk after the erased text now follows different text, and chunks
+  // left small are merged into it.
+  size_t last = std::min(k + 1, longLine.chunks.size());
+
+  if (k < longLine.chunks.size())
+    longLine.chunks[k].state.dirty = true;
+
+  for (size_t i = first; i < last; i++)
+    if (longLine.chunks[i].text.size() < CHUNK_BYTES / 4)
+    {
+      rechunk(longLine, first, last);
+      break;
+    }
+
+  return removed;
+}
+
+TextBuffer::MemoryUse TextBuffer::memoryUse() const
+{
+  if (measuredChanges != changes)
+  {
+    measuredMemory = MemoryUse();
+    measuredMemory.index = newlines.capacity() * sizeof(uint64_t);
+    measuredMemory.pool = pool.size() << POOL_BLOCK_BITS;
+    measuredMemory.poolFree = poolFreed + (pool.empty() ? 0 : ((size_t)1 << POOL_BLOCK_BITS) - poolUsed);
+    measuredMemory.file = file && !file->mapped ? file->size : 0;
+    nodeMemory(root.get(), measuredMemory);
+    measuredChanges = changes;
+  }
+
+  return measuredMemory;
+}
+
+void TextBuffer::compact()
+{
+  if (poolFreed < COMPACT_MIN_BYTES || poolFreed * 2 < poolBytes)
+    return;
+
+  std::vector<std::unique_ptr<char[]>> old;
+  old.swap(pool);
+  poolUsed = poolBytes = poolFreed = 0;
+
+  auto move = [&](size_t, Line &line)
+  {
+    if (line.place != IN_POOL || line.extent.size == 0)
+      return true;
+
+    const char *from = old[line.offset >> POOL_BLOCK_BITS].get() + (line.offset & (((uint64_t)1 << POOL_BLOCK_BITS) - 1));
+    uint64_t offset;
+
+    memcpy(allocate(line.extent.size, offset), from, line.extent.size);
+    line.offset = offset;
+    return true;
+  };
+
+  visit(root.get(), 0, 0, size(), move, true);
+  measuredChanges = UINT64_MAX;
+}
+
+void TextBuffer::setMemoryBudget(size_t bytes)
+{
+  budget = bytes;
+
+  if (!budget)
+  {
+    // Leaves packed by now stay so until next read.
+    while (hotLeaves.next != &hotLeaves)
+      hotLeaves.next->unlink();
+
+    hotCount = hotBytes = 0;
+    return;
+  }
+
+  if (root)
+    packCold(root.get());
+
+  shrinkHotLeaves(nullptr);
+}
+
+void TextBuffer::HotLink::linkAfter(HotLink *at)
+{
+  prev = at;
+  next = at->next;
+  next->prev = this;
+  at->next = this;
+}
+
+void TextBuffer::HotLink::unlink()
+{
+  if (!prev)
+    return;
+
+  prev->next = next;
+  next->prev = prev;
+  prev = next = nullptr;
+}
+
+static void putVarint(uint64_t value, std::vector<char> &out)
+{
+  for (; value >= 0x80; value >>= 7)
+    out.push_back((char)(value | 0x80));
+
+  out.push_back((char)value);
+}
+
+static uint64_t getVarint(const char *&at)
+{
+  uint64_t value = 0;
+
+  for (int shift = 0;; shift += 7)
+  {
+    unsigned char byte = *at++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+
+    if (byte < 0x80)
+      return value;
+  }
+}
+
+// Makes the leaf's lines available, and under a budget moves it to the
+// front of the list of expanded leaves.
+void TextBuffer::expand(Node *node) const
+{
+  if (node->isPacked)
+  {
+    const PackedLines &packed = *node->packed;
+
+    // Packed leaves never leave memory, so failing to expand one is a bug
+    // rather than bad input.
+    packScratch.resize(packed.encodedBytes);
+    if (!lzDecompress(packed.bytes.data(), packed.bytes.size(), packScratch.data(), packed.encodedBytes))
+      abort();
+
+    const char *at = packScratch.data();
+    uint64_t next = 0;
+
+    node->lines.resize(packed.lines);
+
+    for (Line &line : node->lines)
+    {
+      unsigned char flags = *at++;
+
+      line.place = flags & 3;
+      line.dirty = (flags >> 2) & 1;
+      line.ascii = (flags >> 4) & 3;
+      line.value = (unsigned char)*at++;
+
+      if (line.place == IN_FILE)
+      {
+        uint64_t delta = getVarint(at);
+        line.offset = next + (delta & 1 ? ~(delta >> 1) : delta >> 1);
+      }
+      else
+      {
+        line.offset = getVarint(at);
+      }
+
+      line.extent.size = getVarint(at);
+      line.extent.dip = getVarint(at);
+      line.extent.rise = getVarint(at);
+      next = line.offset + line.extent.size + 1;
+    }
+
+    node->isPacked = false;
+    packedLeaves--;
+    packedBytes -= packed.bytes.size();
+    measuredChanges = UINT64_MAX;
+  }
+
+  if (budget)
+    touch(node);
+}
+
+// Packs an expanded leaf unless it is pinned or holds a long line. Offsets
+// of unedited lines are encoded relative to the end of the line before.
+bool TextBuffer::pack(Node *node) const
+{
+  if (node->isPacked)
+    return true;
+
+  if (node->pins || node->lines.empty())
+    return false;
+
+  for (const Line &line : node->lines)
+    if (line.place == LONG)
+      return false;
+
+  // Bracket queries then skip the leaf without expanding it.
+  summarizeLeaf(node);
+
+  if (!node->packed)
+  {
+    std::vector<char> &encoded = packScratch;
+    uint64_t next = 0;
+
+    encoded.clear();
+
+    for (const Line &line : node->lines)
+    {
+      encoded.push_back((char)(line.place | line.dirty << 2 | line.ascii << 4));
+      encoded.push_back((char)line.value);
+
+      if (line.place == IN_FILE)
+      {
+        int64_t delta = (int64_t)(line.offset - next);
+        putVarint(delta < 0 ? ~((uint64_t)delta << 1) : (uint64_t)delta << 1, encoded);
+      }
+      else
+      {
+        putVarint(line.offset, encoded);
+      }
+
+      putVarint(line.extent.size, encoded);
+      putVarint(line.extent.dip, encoded);
+      putVarint(line.extent.rise, encoded);
+      next = line.offset + line.extent.size + 1;
+    }
+
+    node->packed = std::make_unique<PackedLines>();
+    node->packed->lines = node->lines.size();
+    node->packed->encodedBytes = encoded.size();
+    lzCompress(encoded.data(), encoded.size(), node->packed->bytes);
+    node->packed->bytes.shrink_to_fit();
+  }
+
+  releasePages(node);
+  std::vector<Line>().swap(node->lines);
+  node->isPacked = true;
+  packedLeaves++;
+  packedBytes += node->packed->bytes.size();
+  measuredChanges = UINT64_MAX;
+  return true;
+}
+
+// Gives back the pages of the mapped file that only the leaf's lines use.
+void TextBuffer::releasePages(const Node *node) const
+{
+  if (!file || !file->mapped)
+    return;
+
+  uint64_t first = UINT64_MAX, last = 0;
+
+  for (const Line &line : node->lines)
+    if (line.place == IN_FILE)
+    {
+      first = std::min<uint64_t>(first, line.offset);
+      last = std::max<uint64_t>(last, line.offset + line.extent.size + 1);
+    }
+
+  if (first >= last)
+    return;
+
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t from = ((uintptr_t)file->data + first + page - 1) & ~(page - 1);
+  uintptr_t to = ((uintptr_t)file->data + std::min<uint64_t>(last, file->size)) & ~(page - 1);
+
+  if (from < to)
+    madvise((void *)from, to - from, MADV_DONTNEED);
+}
+
+// Puts an expanded leaf at the front of the list, then packs leaves from
+// the back while over budget.
+void TextBuffer::touch(Node *node) const
+{
+  if (hotLeaves.next == node)
+    return;
+
+  if (node->isLinked())
+  {
+    node->unlink();
+  }
+  else
+  {
+    uint64_t first = UINT64_MAX, last = 0;
+
+    for (const Line &line : node->lines)
+      if (line.place == IN_FILE)
+      {
+        first = std::min<uint64_t>(first, line.offset);
+        last = std::max<uint64_t>(last, line.offset + line.extent.size);
+      }
+
+    node->hotBytes = sizeof(Node) + node->lines.capacity() * sizeof(Line) + (first < last && file->mapped ? last - first : 0);
+    hotCount++;
+    hotBytes += node->hotBytes;
+  }
+
+  node->linkAfter(&hotLeaves);
+  shrinkHotLeaves(node);
+}
+
+void TextBuffer::shrinkHotLeaves(const Node *keep) const
+{
+  HotLink *link = hotLeaves.prev;
+
+  while (hotCount > MIN_HOT_LEAVES && hotBytes + packedBytes > budget && link != &hotLeaves)
+  {
+    Node *node = static_cast<Node *>(link);
+    link = link->prev;
+
+    if (node == keep || node->pins)
+      continue;
+
+    // Leaves the list even if it cannot be packed.
+    pack(node);
+    node->unlink();
+    hotCount--;
+    hotBytes -= node->hotBytes;
+  }
+}
+
+// Packs the leaves of a subtree that are neither packed nor in the list.
+void TextBuffer::packCold(Node *node) const
+{
+  if (!node)
+    return;
+
+  if (!node->isLinked())
+    pack(node);
+
+  packCold(node->left.get());
+  packCold(node->right.get());
+}
+
+// Expands a leaf for a visit until unpin(); under a lock while packing is
+// possible, as searches visit from several threads.
+void TextBuffer::pin(Node *node, bool writes) const
+{
+  std::unique_lock<std::mutex> lock(leafMutex, std::defer_lock);
+
+  if (budget || packedLeaves)
+    lock.lock();
+
+  expand(node);
+  if (writes)
+    changedLeaf(node);
+
+  node->pins++;
+}
+
+void TextBuffer::unpin(Node *node) const
+{
+  node->pins--;
+}
+
+// Drops the packed copy of an expanded leaf whose lines are changing.
+void TextBuffer::changedLeaf(Node *node) const
+{
+  if (!node->isPacked)
+    node->packed.reset();
+}
+
+// Stops counting the leaves of a subtree about to be destroyed.
+void TextBuffer::forgetLeaves(Node *node) const
+{
+  if (!node)
+    return;
+
+  if (node->isLinked())
+  {
+    node->unlink();
+    hotCount--;
+    hotBytes -= node->hotBytes;
+  }
+
+  if (node->isPacked)
+  {
+    packedLeaves--;
+    packedBytes -= node->packed->bytes.size();
+  }
+
+  forgetLeaves(node->left.get());
+  forgetLeaves(node->right.get());
+}
+
+void TextBuffer::nodeMemory(const Node *node, MemoryUse &use)
+{
+  if (!node)
+    return;
+
+  use.index += sizeof(Node) + node->lines.capacity() * sizeof(Line);
+
+  if (node->packed)
+    use.packed += sizeof(PackedLines) + node->packed->bytes.capacity();
+
+  for (const Line &line : node->lines)
+  {
+    if (line.place != LONG)
+      continue;
+
+    const LongLine &longLine = *line.longLine;
+    use.longLines += sizeof(LongLine) + longLine.chunks.capacity() * sizeof(Chunk);
+
+    for (const Chunk &chunk : longLine.chunks)
+      use.longLines += chunk.text.capacity();
+
+    if (longLine.joined)
+      use.longLines += sizeof(std::string) + longLine.joined->capacity();
+  }
+
+  nodeMemory(node->left.get(), use);
+  nodeMemory(node->right.get(), use);
+}
+
+bool TextBuffer::isAscii(size_t index) const
+{
+  Node *leaf = locate(index);
+  return isAscii(leaf->lines[index]);
+}
+
+bool TextBuffer::isAscii(Line &line) const
+{
+  if (line.place == LONG)
+  {
+    for (Chunk &chunk : line.longLine->chunks)
+      if (!checkAscii(chunk.text, chunk.state))
+        return false;
+
+    return true;
+  }
+
+  if (line.ascii == ASCII_UNKNOWN)
+    line.ascii = findNonAscii(text(line).data(), line.extent.size) == SIZE_MAX;
+
+  return line.ascii;
+}
+
+bool TextBuffer::checkAscii(std::string_view text, LineState &state)
+{
+  if (state.ascii == ASCII_UNKNOWN)
+    state.ascii = findNonAscii(text.data(), text.size()) == SIZE_MAX;
+
+  return state.ascii;
+}
+
+TextBuffer::LineState TextBuffer::lineState(size_t index) const
+{
+  Node *leaf = locate(index);
+  return stateOf(leaf->lines[index]);
+}
+
+void TextBuffer::invalidateState(size_t index)
+{
+  size_t local = index;
+  Node *leaf = locate(local);
+  changedLeaf(leaf);
+  invalidateLine(leaf->lines[local], index);
+}
+
+void TextBuffer::invalidateLine(Line &line, size_t index)
+{
+  lexValid = std::min(lexValid, index);
+
+  LineState state = stateOf(line);
+
+  if (!state.dirty && index < lexEnd)
+    lexDirty++;
+
+  state.dirty = true;
+  state.ascii = ASCII_UNKNOWN;
+  setState(line, state);
+
+  // Chunks after the first are re-lexed only if the state they start from
+  // turns out to have changed.
+  if (line.place == LONG)
+  {
+    line.longLine->chunks.front().state.dirty = true;
+    line.longLine->joined.reset();
+  }
+}
+
+static bool isSeam(char c)
+{
+  return c == ',' || c == ';' || c == '{' || c == '}' || c == ' ' || c == '\t';
+}
+
+// Where the chunk starting at `from` ends: after a separator near
+// CHUNK_BYTES if there is one, and never inside a UTF-8 sequence.
+static size_t chunkEnd(std::string_view text, size_t from)
+{
+  const size_t chunkBytes = TextBuffer::CHUNK_BYTES;
+
+  if (text.size() - from <= chunkBytes + chunkBytes / 2)
+    return text.size();
+
+  size_t end = from + chunkBytes;
+
+  for (size_t i = end; i > end - CHUNK_SEAM_BYTES; i--)
+    if (isSeam(text[i - 1]))
+      return i;
+
+  while (end > from + 1 && ((unsigned char)text[end] & 0xC0) == 0x80 && from + chunkBytes - end < 3)
+    end--;
+
+  return end;
+}
+
+TextBuffer::LongLine *TextBuffer::chunksOf(std::string_view text)
+{
+  LongLine *longLine = new LongLine();
+
+  longLine->size = text.size();
+
+  for (size_t at = 0; at < text.size();)
+  {
+    size_t end = chunkEnd(text, at);
+    longLine->chunks.push_back({std::string(text.substr(at, end - at)), LineState()});
+    at = end;
+  }
+
+  return longLine;
+}
+
+// Turns the line into a long line holding `whole`, which may be its own
+// text, keeping its state.
+void TextBuffer::splitIntoChunks(Line &line, std::string_view whole)
+{
+  LineState state = stateOf(line);
+  LongLine *longLine = chunksOf(whole);
+
+  release(line);
+  line.place = LONG;
+  line.longLine = longLine;
+  longLine->state = state;
+}
+
+void TextBuffer::joinChunks(Line &line)
+{
+  LongLine *longLine = line.longLine;
+  LineState state = longLine->state;
+  std::string_view whole = text(line);
+
+  line.place = IN_POOL;
+  line.extent = {0, 0, 0};
+  store(line, whole);
+  setState(line, state);
+  delete longLine;
+}
+
+// Splits chunks [first, last) again into chunks of about CHUNK_BYTES.
+void TextBuffer::rechunk(LongLine &longLine, size_t first, size_t last)
+{
+  std::string joined;
+
+  for (size_t k = first; k < last; k++)
+    joined += longLine.chunks[k].text;
+
+  std::vector<Chunk> pieces;
+
+  for (size_t at = 0; at < joined.size();)
+  {
+    size_t end = chunkEnd(joined, at);
+    pieces.push_back({joined.substr(at, end - at), LineState()});
+    at = end;
+  }
+
+  auto &chunks = longLine.chunks;
+  chunks.erase(chunks.begin() + first, chunks.begin() + last);
+  chunks.insert(chunks.begin() + first, std::make_move_iterator(pieces.begin()), std::make_move_iterator(pieces.end()));
+}
+
+// Returns the chunk holding `column` and makes the column relative to it.
+size_t TextBuffer::chunkAt(const LongLine &longLine, size_t &column)
+{
+  size_t k = 0;
+
+  while (k + 1 < longLine.chunks.size() && column >= longLine.chunks[k].text.size())
+    column -= longLine.chunks[k++].text.size();
+
+  return k;
+}
+
+void TextBuffer::combineChunkStates(Line &line)
+{
+  LongLine &longLine = *line.longLine;
+  const std::vector<Chunk> &chunks = longLine.chunks;
+  long sum = 0, lowest = 0;
+  bool dirty = false;
+
+  for (const Chunk &chunk : chunks)
+  {
+    lowest = std::min(lowest, sum + chunk.state.bracketMin);
+    sum += chunk.state.bracketSum;
+    dirty |= chunk.state.dirty;
+  }
+
+  longLine.state.value = chunks.back().state.value;
+  longLine.state.dirty = dirty;
+  longLine.state.bracketSum = sum;
+  longLine.state.bracketMin = lowest;
+}
+
+void TextBuffer::summarizeLeaf(Node *node) const
+{
+  if (node->leafKnown)
+    return;
+
+  if (node->isPacked)
+    expand(node);
+
+  long sum = 0, lowest = 0;
+
+  for (const Line &line : node->lines)
+  {
+    LineState state = stateOf(line);
+    lowest = std::min(lowest, sum + state.bracketMin);
+    sum += state.bracketSum;
+  }
+
+  node->leafSum = sum;
+  node->leafMin = lowest;
+  node->leafKnown = true;
+}
+
+// Brings the bracket summaries of the node and of any stale subtrees below
+// it up to date.
+void TextBuffer::summarize(Node *node) const
+{
+  if (node->treeKnown)
+    return;
+
+  summarizeLeaf(node);
+
+  long sum = 0, lowest = 0;
+
+  if (node->left)
+  {
+    summarize(node->left.get());
+    sum = node->left->treeSum;
+    lowest = node->left->treeMin;
+  }
+
+  lowest = std::min(lowest, sum + node->leafMin);
+  sum += node->leafSum;
+
+  if (node->right)
+  {
+    summarize(node->right.get());
+    lowest = std::min(lowest, sum + node->right->treeMin);
+    sum += node->right->treeSum;
+  }
+
+  node->treeSum = sum;
+  node->treeMin = lowest;
+  node->treeKnown = true;
+}
+
+void TextBuffer::forgetBrackets(Node *node, size_t offset, size_t first, size_t last)
+{
+  if (!node || offset >= last || offset + node->lineCount <= first)
+    return;
+
+  size_t start = offset + lineCount(node->left);
+
+  node->treeKnown = false;
+
+  if (start < last && start + ownLines(node) > first)
+    node->leafKnown = false;
+
+  forgetBrackets(node->left.get(), offset, first, last);
+  forgetBrackets(node->right.get(), start + ownLines(node), first, last);
+}
+
+// Only the subtrees left of the path are summarized.
+long TextBuffer::bracketDepth(size_t index) const
+{
+  long depth = 0;
+  Node *node = root.get();
+
+  while (node)
+  {
+    size_t leftLines = lineCount(node->left);
+
+    if (index < leftLines)
+    {
+      node = node->left.get();
+      continue;
+    }
+
+    if (node->left)
+    {
+      summarize(node->left.get());
+      depth += node->left->treeSum;
+    }
+
+    index -= leftLines;
+
+    if (index < ownLines(node))
+    {
+      expand(node);
+      for (size_t i = 0; i < index; i++)
+        depth += stateOf(node->lines[i]).bracketSum;
+      break;
+    }
+
+    summarizeLeaf(node);
+    depth += node->leafSum;
+    index -= ownLines(node);
+    node = node->right.get();
+  }
+
+  return depth;
+}
+
+// `base` is the depth at the start of the node's subtree. Stale summaries
+// past `last` can only lower a minimum, so skipping on it stays correct.
+size_t TextBuffer::findForward(Node *node, size_t offset, long base, size_t from, size_t last, long depth) const
+{
+  if (!node || offset >= last || offset + node->lineCount <= from || base + node->treeMin > depth)
+    return SIZE_MAX;
+
+  size_t found = findForward(node->left.get(), offset, base, from, last, depth);
+
+  if (found != SIZE_MAX)
+    return found;
+
+  size_t start = offset + lineCount(node->left);
+  base += node->left ? node->left->treeSum : 0;
+
+  if (start >= from && base + node->leafMin > depth)
+  {
+    base += node->leafSum;
+  }
+  else
+  {
+    expand(node);
+
+    for (size_t i = 0; i < node->lines.size(); i++)
+    {
+      LineState state = stateOf(node->lines[i]);
+
+      if (start + i >= last)
+        return SIZE_MAX;
+
+      if (start + i >= from && base + state.bracketMin <= depth)
+        return start + i;
+
+      base += state.bracketSum;
+    }
+  }
+
+  return findForward(node->right.get(), start + ownLines(node), base, from, last, depth);
+}
+
+size_t TextBuffer::findBackward(Node *node, size_t offset, long base, size_t first, size_t before, long depth) const
+{
+  if (!node || offset >= before || offset + node->lineCount <= first || base + node->treeMin > depth)
+    return SIZE_MAX;
+
+  size_t start = offset + lineCount(node->left);
+  long leafBase = base + (node->left ? node->left->treeSum : 0);
+  size_t found = findBackward(node->right.get(), start + ownLines(node), leafBase + node->leafSum, first, before, depth);
+
+  if (found != SIZE_MAX)
+    return found;
+
+  expand(node);
+
+  for (size_t i = 0; i < node->lines.size() && start + i < before; i++)
+  {
+    LineState state = stateOf(node->lines[i]);
+
+    if (start + i >= first && leafBase + state.bracketMin <= depth)
+      found = start + i;
+
+    leafBase += state.bracketSum;
+  }
+
+  if (found != SIZE_MAX)
+    return found;
+
+  return findBackward(node->left.get(), offset, base, first, before, depth);
+}
+
+size_t TextBuffer::firstLineReaching(size_t from, size_t last, long depth) const
+{
+  if (!root)
+    return SIZE_MAX;
+
+  summarize(root.get());
+  return findForward(root.get(), 0, 0, from, last, depth);
+}
+
+size_t TextBuffer::lastLineReaching(size_t first, size_t before, long depth) const
+{
+  if (!root)
+    return SIZE_MAX;
+
+  summarize(root.get());
+  return findBackward(root.get(), 0, 0, first, before, depth);
+}
+
+void TextBuffer::insertLine(size_t index, std::string text)
+{
+  changes++;
+
+  lexValid = std::min(lexValid, index);
+  if (index < lexEnd)
+  {
+    lexEnd++;
+    lexDirty++;
+  }
+
+  if (!root)
+  {
+    root = std::make_unique<Node>();
+    root->lines.push_back(makeLine(text));
+    root->lineCount = 1;
+
+    if (budget)
+      touch(root.get());
+    return;
+  }
+
+  // Appending goes to the end of the last leaf rather than a new one.
+  size_t local = index == size() ? index - 1 : index;
+  Node *leaf = locate(local);
+  if (index == size())
+    local++;
+
+  size_t leafStart = index - local;
+
+  adjustPath(leafStart, 1);
+  changedLeaf(leaf);
+  leaf->lines.insert(leaf->lines.begin() + local, makeLine(text));
+
+  if (leaf->lines.size() > LEAF_MAX_LINES)
+    splitLeaf(leaf, leafStart, leaf->lines.size() / 2);
+
+  // The next line now follows a different line, so its cached state is stale.
+  if (index + 1 < lexEnd)
+    invalidateState(index + 1);
+}
+
+void TextBuffer::eraseLine(size_t index)
+{
+  changes++;
+
+  size_t local = index;
+  Node *leaf = locate(local);
+  size_t leafStart = index - local;
+
+  lexValid = std::min(lexValid, index);
+  if (index < lexEnd)
+  {
+    if (stateOf(leaf->lines[local]).dirty)
+      lexDirty--;
+    lexEnd--;
+  }
+
+  release(leaf->lines[local]);
+
+  if (leaf->lines.size() == 1)
+  {
+    removeLeaf(leafStart, 1);
+  }
+  else
+  {
+    adjustPath(leafStart, -1);
+    changedLeaf(leaf);
+    leaf->lines.erase(leaf->lines.begin() + local);
+  }
+
+  // The next line now follows a different line, so its cached state is stale.
+  if (index < lexEnd)
+    invalidateState(index);
+}
+
+// Inserts a run of lines as one splice, in O(k + log n).
+void TextBuffer::insertLines(size_t index, std::vector<std::string> &&lines)
+{
+  if (lines.empty())
+    return;
+
+  changes++;
+  size_t count = lines.size();
+
+  lexValid = std::min(lexValid, index);
+  if (index < lexEnd)
+  {
+    lexEnd += count;
+    lexDirty += count;
+  }
+
+  if (index < size())
+  {
+    size_t local = index;
+    Node *leaf = locate(local);
+
+    if (local > 0)
+      splitLeaf(leaf, index - local, local);
+  }
+
+  auto parts = split(std::move(root), index);
+  root = merge(merge(std::move(parts.first), buildFromLines(std::move(lines))), std::move(parts.second));
+
+  if (index + count < lexEnd)
+    invalidateState(index + count);
+}
+
+// Removes a run of lines as one splice.
+void TextBuffer::eraseLines(size_t index, size_t count)
+{
+  if (count == 0)
+    return;
+
+  changes++;
+  lexValid = std::min(lexValid, index);
+
+  auto forget = [&](size_t i, Line &line)
+  {
+    if (i < lexEnd && stateOf(line).dirty)
+      lexDirty--;
+    release(line);
+    return true;
+  };
+
+  visit(root.get(), 0, index, index + count, forget);
+
+  if (index < lexEnd)
+    lexEnd -= std::min(count, lexEnd - index);
+
+  for (size_t at : {index + count, index})
+  {
+    if (at >= size())
+      continue;
+
+    size_t local = at;
+    Node *leaf = locate(local);
+
+    if (local > 0)
+      splitLeaf(leaf, at - local, local);
+  }
+
+  auto tail = split(std::move(root), index + count);
+  auto head = split(std::move(tail.first), index);
+  forgetLeaves(head.second.get());
+  root = merge(std::move(head.first), std::move(tail.second));
+
+  if (index < lexEnd)
+    invalidateState(index);
+}
+
+void TextBuffer::assign(std::vector<std::string> &&lines)
+{
+  clear();
+  root = buildFromLines(std::move(lines));
+
+  if (budget && root)
+    packCold(root.get());
+}
+
+void TextBuffer::clear()
+{
+  changes++;
+
+  root.reset();
+  file.reset();
+  loadOffset = scanOffset = 0;
+
+  pool.clear();
+  poolUsed = poolBytes = poolFreed = 0;
+  hotCount = hotBytes = packedLeaves = packedBytes = 0;
+
+  lexValid = lexEnd = lexDirty = 0;
+}
+
+bool TextBuffer::load(const std::string &fileName)
+{
+  int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  struct stat info;
+  if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode))
+  {
+    close(fd);
+    return false;
+  }
+
+  std::shared_ptr<FileData> loaded = std::make_shared<FileData>();
+  loaded->size = info.st_size;
+
+  if (loaded->size >= MMAP_THRESHOLD)
+  {
+    void *mapping = mmap(nullptr, loaded->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapping == MAP_FAILED)
+    {
+      close(fd);
+      return false;
+    }
+
+    // Kept open to tell where the file ends should it shrink.
+    loaded->data = (const char *)mapping;
+    loaded->mapped = true;
+    loaded->fd = fd;
+  }
+  else if (loaded->size > 0)
+  {
+    char *bytes = new char[loaded->size];
+    size_t done = 0;
+
+    while (done < loaded->size)
+    {
+      ssize_t count = read(fd, bytes + done, loaded->size - done);
+      if (count <= 0)
+        break;
+      done += count;
+    }
+
+    loaded->data = bytes;
+    loaded->size = done;
+  }
+
+  if (!loaded->mapped)
+    close(fd);
+
+  clear();
+  file = std::move(loaded);
+
+  continueLoading(INITIAL_LOAD_BYTES);
+
+  // A first screen needs at least one line, however long it is.
+  while (size() == 0 && isLoading())
+    continueLoading(INITIAL_LOAD_BYTES);
+
+  return true;
+}
+
+bool TextBuffer::isLoading() const
+{
+  return file && loadOffset < file->size;
+}
+
+// Indexes up to maxBytes more of the file and appends the complete lines
+// found as new leaves at the end of the buffer.
+void TextBuffer::continueLoading(size_t maxBytes)
+{
+  if (!isLoading())
+    return;
+
+  changes++;
+  size_t end = scanOffset + std::min(maxBytes, file->size - scanOffset);
+
+  newlines.clear();
+  findNewlines(file->data + scanOffset, end - scanOffset, scanOffset, newlines);
+  scanOffset = end;
+
+  if (end == file->size)
+    newlines.push_back(file->size);
+
+  std::vector<Line> lines;
+  lines.reserve(newlines.size());
+
+  for (uint64_t newline : newlines)
+  {
+    if (newline == file->size && loadOffset == file->size)
+      break;
+
+    lines.emplace_back();
+    Line &line = lines.back();
+
+    if (newline - loadOffset <= Line::MAX_SIZE)
+    {
+      line.place = IN_FILE;
+      line.offset = loadOffset;
+      line.extent.size = newline - loadOffset;
+    }
+    else
+    {
+      line.place = LONG;
+      line.longLine = chunksOf(std::string_view(file->data + loadOffset, newline - loadOffset));
+    }
+
+    loadOffset = newline + 1;
+  }
+
+  loadOffset = std::min(loadOffset, file->size);
+
+  if (!isLoading())
+    std::vector<uint64_t>().swap(newlines);
+
+  if (lines.empty())
+    return;
+
+  std::unique_ptr<Node> loaded = buildFromLines(std::move(lines));
+
+  // Under a budget, the file is packed as it loads rather than after.
+  if (budget)
+    packCold(loaded.get());
+
+  root = merge(std::move(root), std::move(loaded));
+}
+
+void TextBuffer::finishLoading()
+{
+  while (isLoading())
+    continueLoading(FINISH_SLICE_BYTES);
+}
+
+void TextBuffer::copyFile()
+{
+  if (!isMapped())
+    return;
+
+  struct stat info;
+  size_t valid = fstat(file->fd, &info) == 0 ? std::min<size_t>(file->size, info.st_size) : 0;
+
+  std::shared_ptr<FileData> copy = std::make_shared<FileData>();
+  char *bytes = new char[file->size];
+
+  memcpy(bytes, file->data, valid);
+  memset(bytes + valid, ' ', file->size - valid);
+
+  copy->data = bytes;
+  copy->size = file->size;
+  file = std::move(copy);
+  changes++;
+}
+
+bool TextBuffer::adopt(TextBuffer &&other)
+{
+  finishLoading();
+  other.finishLoading();
+
+  if (size() != other.size())
+    return false;
+
+  std::vector<Line *> theirs;
+  theirs.reserve(other.size());
+
+  auto gather = [&](size_t, Line &line)
+  {
+    theirs.push_back(&line);
+    return true;
+  };
+
+  auto same = [&](size_t i, Line &line)
+  { return text(line) == other.text(*theirs[i]); };
+
+  other.visit(other.root.get(), 0, 0, other.size(), gather);
+
+  if (!visit(root.get(), 0, 0, size(), same))
+    return false;
+
+  // Every line but a long one is taken from the new file where that has
+  // it, edited lines in the pool included, since the texts are the same.
+  auto take = [&](size_t i, Line &line)
+  {
+    if (line.place == LONG || theirs[i]->place != IN_FILE)
+      return true;
+
+    LineState state = stateOf(line);
+    release(line);
+    line = std::move(*theirs[i]);
+    setState(line, state);
+    return true;
+  };
+
+  visit(root.get(), 0, 0, size(), take, true);
+
+  changes++;
+  file = std::move(other.file);
+  loadOffset = other.loadOffset;
+  scanOffset = other.scanOffset;
+
+  other.clear();
+  return true;
+}
+
+TextSnapshot TextBuffer::snapshot() const
+{
+  TextSnapshot result;
+  result.file = file;
+
+  char *chunk = nullptr;
+  size_t chunkUsed = 0, chunkSize = 0;
+
+  // Adjacent pieces are joined so they can be written in bulk.
+  auto share = [&](const char *data, size_t length)
+  {
+    if (length == 0)
+      return;
+
+    std::string_view *last = result.pieces.empty() ? nullptr : &result.pieces.back();
+
+    if (last && last->data() + last->size() == data)
+      *last = std::string_view(last->data(), last->size() + length);
+    else
+      result.pieces.emplace_back(data, length);
+
+    result.size += length;
+  };
+
+  auto copy = [&](const char *data, size_t length)
+  {
+    if (length == 0)
+      return;
+
+    if (chunkUsed + length > chunkSize)
+    {
+      chunkSize = std::max(length, SNAPSHOT_CHUNK_BYTES);
+      result.chunks.emplace_back(new char[chunkSize]);
+      chunk = result.chunks.back().get();
+      chunkUsed = 0;
+    }
+
+    memcpy(chunk + chunkUsed, data, length);
+    share(chunk + chunkUsed, length);
+    chunkUsed += length;
+  };
+
+  const char *fileEnd = file ? file->data + file->size : nullptr;
+  size_t count = size();
+  bool hasTail = isLoading();
+
+  auto addLine = [&](size_t i, Line &line)
+  {
+    bool isLast = i + 1 == count && !hasTail;
+
+    if (line.place == LONG)
+    {
+      for (const Chunk &chunk : line.longLine->chunks)
+        copy(chunk.text.data(), chunk.text.size());
+      if (!isLast)
+        copy("\n", 1);
+    }
+    else if (line.place == IN_POOL)
+    {
+      copy(text(line).data(), line.extent.size);
+      if (!isLast)
+        copy("\n", 1);
+    }
+    else
+    {
+      const char *data = file->data + line.offset;
+      share(data, line.extent.size);
+
+      // An unedited line is followed in the file by its own newline, unless
+      // it was the file's last line.
+      if (!isLast && data + line.extent.size < fileEnd)
+        share(data + line.extent.size, 1);
+      else if (!isLast)
+        copy("\n", 1);
+    }
+
+    return true;
+  };
+
+  visit(root.get(), 0, 0, count, addLine);
+
+  // The part not indexed yet is taken as is, minus a final newline.
+  if (hasTail)
+  {
+    size_t end = file->size;
+
+    if (file->data[end - 1] == '\n')
+      end--;
+
+    share(file->data + loadOffset, end - loadOffset);
+  }
+
+  return result;
+}
+
+std::unique_ptr<TextBuffer::Node> TextBuffer::buildFromLines(std::vector<std::string> &&lines)
+{
+  std::vector<Line> owned;
+  owned.reserve(lines.size());
+
+  for (const std::string &line : lines)
+    owned.push_back(makeLine(line));
+
+  lines.clear();
+
+  return buildFromLines(std::move(owned));
+}
+
+std::unique_ptr<TextBuffer::Node> TextBuffer::buildFromLines(std::vector<Line> &&lines)
+{
+  std::vector<std::unique_ptr<Node>> leaves;
+
+  // Leaves start half full so early edits do not immediately split them.
+  const size_t leafLines = LEAF_MAX_LINES / 2;
+
+  for (size_t i = 0; i < lines.size(); i += leafLines)
+  {
+    std::unique_ptr<Node> leaf = std::make_unique<Node>();
+    size_t end = std::min(lines.size(), i + leafLines);
+
+    leaf->lines.reserve(end - i);
+    for (size_t j = i; j < end; j++)
+      leaf->lines.push_back(std::move(lines[j]));
+
+    leaf->lineCount = leaf->lines.size();
+    leaves.push_back(std::move(leaf));
+  }
+
+  lines.clear();
+
+  return build(leaves, 0, leaves.size());
+}
+
+void TextBuffer::update(Node *node)
+{
+  node->lineCount = lineCount(node->left) + ownLines(node) + lineCount(node->right);
+  node->nodeCount = nodeCount(node->left) + 1 + nodeCount(node->right);
+  node->treeKnown = false;
+}
+
+uint64_t TextBuffer::nextRandom()
+{
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 7;
+  rngState ^= rngState << 17;
+  return rngState;
+}
+
+// Randomized merge: the root is picked with probability proportional to
+// subtree size.
+std::unique_ptr<TextBuffer::Node> TextBuffer::merge(std::unique_ptr<Node> a, std::unique_ptr<Node> b)
+{
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+
+  if (nextRandom() % (a->nodeCount + b->nodeCount) < a->nodeCount)
+  {
+    a->right = merge(std::move(a->right), std::move(b));
+    update(a.get());
+    return a;
+  }
+
+  b->left = merge(std::move(a), std::move(b->left));
+  update(b.get());
+  return b;
+}
+
+// Splits off the leaves covering the first `lines` lines. `lines` must fall
+// on a leaf boundary.
+std::pair<std::unique_ptr<TextBuffer::Node>, std::unique_ptr<TextBuffer::Node>> TextBuffer::split(std::unique_ptr<Node> node, size_t lines)
+{
+  if (!node)
+    return {nullptr, nullptr};
+
+  size_t leftLines = lineCount(node->left);
+
+  if (lines <= leftLines)
+  {
+    auto parts = split(std::move(node->left), lines);
+    node->left = std::move(parts.second);
+    update(node.get());
+    return {std::move(parts.first), std::move(node)};
+  }
+
+  auto parts = split(std::move(node->right), lines - leftLines - ownLines(node.get()));
+  node->right = std::move(parts.first);
+  update(node.get());
+  return {std::move(node), std::move(parts.second)};
+}
+
+std::unique_ptr<TextBuffer::Node> TextBuffer::build(std::vector<std::unique_ptr<Node>> &leaves, size_t first, size_t last)
+{
+  if (first >= last)
+    return nullptr;
+
+  size_t mid = first + (last - first) / 2;
+
+  std::unique_ptr<Node> node = std::move(leaves[mid]);
+  node->left = build(leaves, first, mid);
+  node->right = build(leaves, mid + 1, last);
+  update(node.get());
+
+  return node;
+}
+
+// Finds the leaf holding line `index` and rewrites `index` to the position
+// inside that leaf.
+TextBuffer::Node *TextBuffer::locate(size_t &index) const
+{
+  Node *node = root.get();
+
+  while (node)
+  {
+    size_t leftLines = lineCount(node->left);
+
+    if (index < leftLines)
+    {
+      node = node->left.get();
+    }
+    else if (index < leftLines + ownLines(node))
+    {
+      index -= leftLines;
+      expand(node);
+      return node;
+    }
+    else
+    {
+      index -= leftLines + ownLines(node);
+      node = node->right.get();
+    }
+  }
+
+  return nullptr;
+}
+
+// Adds `delta` to the line counts on the path to the leaf starting at
+// `leafStart`. Must run before the leaf's own lines change.
+void TextBuffer::adjustPath(size_t leafStart, long delta)
+{
+  Node *node = root.get();
+
+  while (node)
+  {
+    size_t leftLines = lineCount(node->left);
+
+    node->lineCount += delta;
+    node->treeKnown = false;
+
+    if (leafStart < leftLines)
+    {
+      node = node->left.get();
+    }
+    else if (leafStart < leftLines + ownLines(node))
+    {
+      node->leafKnown = false;
+      return;
+    }
+    else
+    {
+      leafStart -= leftLines + ownLines(node);
+      node = node->right.get();
+    }
+  }
+}
+
+// Moves the lines from `at` onwards into a new leaf placed right after
+// this one.
+void TextBuffer::splitLeaf(Node *leaf, size_t leafStart, size_t at)
+{
+  auto before = split(std::move(root), leafStart);
+  auto rest = split(std::move(before.second), leaf->lines.size());
+
+  std::unique_ptr<Node> upper = std::make_unique<Node>();
+  upper->lines.assign(std::make_move_iterator(leaf->lines.begin() + at), std::make_move_iterator(leaf->lines.end()));
+  leaf->lines.erase(leaf->lines.begin() + at, leaf->lines.end());
+  leaf->leafKnown = false;
+  changedLeaf(leaf);
+  update(rest.first.get());
+  update(upper.get());
+
+  Node *added = upper.get();
+  root = merge(merge(std::move(before.first), std::move(rest.first)), merge(std::move(upper), std::move(rest.second)));
+
+  if (budget)
+    touch(added);
+}
+
+void TextBuffer::removeLeaf(size_t leafStart, size_t leafLines)
+{
+  auto before = split(std::move(root), leafStart);
+  auto rest = split(std::move(before.second), leafLines);
+
+  forgetLeaves(rest.first.get());
+  root = merge(std::move(before.first), std::move(rest.second));
+}
@@ -0,0 +1,556 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Bytes of a loaded file. Large files are memory-mapped, small ones read
+// into a single heap block; either way lines point into it until edited.
+struct FileData
+{
+  const char *data = nullptr;
+  size_t size = 0;
+  bool mapped = false;
+  int fd = -1;
+
+  ~FileData();
+};
+
+// The text of a buffer at one point in time: lines joined by '\n' and
+// split into pieces, in order. Pieces point either into the loaded file,
+// which the snapshot keeps alive, or into its own copies of edited lines.
+struct TextSnapshot
+{
+  std::shared_ptr<FileData> file;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  std::vector<std::string_view> pieces;
+  size_t size = 0;
+};
+
+// Line storage for the editor: leaves of at most LEAF_MAX_LINES lines in a
+// randomized balanced tree, so lookup, insertion and removal are O(log n).
+// Loaded lines are views into the file and edited ones live in a pool.
+// Under a memory budget, cold leaves are packed. Lines longer than
+// LONG_LINE_BYTES are kept as chunks of around CHUNK_BYTES.
+class TextBuffer
+{
+public:
+  static const uint16_t STATE_UNKNOWN = UINT16_MAX;
+  static const size_t LONG_LINE_BYTES = 64 << 10;
+  static const size_t CHUNK_BYTES = 16 << 10;
+
+  static const uint8_t ASCII_UNKNOWN = 2;
+
+  // Per-line cache owned by the highlighter: the lexer state at the end of
+  // the line, its bracket summary and whether it is all ASCII.
+  struct LineState
+  {
+    uint16_t value = STATE_UNKNOWN;
+    bool dirty = true;
+    uint8_t ascii = ASCII_UNKNOWN;
+    int32_t bracketSum = 0, bracketMin = 0;
+  };
+
+  // Lines [0, lexValid) have up-to-date end states; [0, lexEnd) have been
+  // lexed at some point, lexDirty of them edited since.
+  size_t lexValid = 0, lexEnd = 0, lexDirty = 0;
+
+  TextBuffer();
+  ~TextBuffer();
+
+  TextBuffer(TextBuffer &&other) noexcept;
+  TextBuffer &operator=(TextBuffer &&other) noexcept;
+
+  TextBuffer(const TextBuffer &) = delete;
+  TextBuffer &operator=(const TextBuffer &) = delete;
+
+  size_t size() const;
+
+  // Changes whenever the text does.
+  uint64_t version() const { return changes; }
+
+  std::string_view line(size_t index) const;
+  size_t lineSize(size_t index) const;
+
+  // Edits within one line; on a long line only the chunks concerned.
+  void insertInLine(size_t index, size_t column, std::string_view text);
+  std::string eraseInLine(size_t index, size_t from, size_t to);
+
+  // The bytes [from, to) of a line and what replaces them.
+  struct LineEdit
+  {
+    size_t from = 0, to = 0;
+    std::string_view text;
+  };
+
+  // Edits lines [first, last) in one pass: fn(index, text, edit) returns
+  // whether to apply `edit` to the line.
+  template <typename Fn>
+  void editLines(size_t first, size_t last, Fn &&fn)
+  {
+    auto withEdit = [&](size_t i, Line &line)
+    {
+      LineEdit edit;
+
+      if (fn(i, text(line), edit))
+        replaceInLine(line, i, edit);
+      return true;
+    };
+
+    changes++;
+    visit(root.get(), 0, first, last, withEdit, true);
+  }
+
+  void insertLine(size_t index, std::string text);
+  void insertLines(size_t index, std::vector<std::string> &&lines);
+  void eraseLine(size_t index);
+  void eraseLines(size_t index, size_t count);
+
+  void assign(std::vector<std::string> &&lines);
+  void clear();
+
+  bool load(const std::string &fileName);
+  bool isLoading() const;
+  void continueLoading(size_t maxBytes);
+  void finishLoading();
+
+  // Takes over the file of `other`, a fresh load of the same text, keeping
+  // lexer states. Returns false, changing nothing, if the texts differ.
+  bool adopt(TextBuffer &&other);
+
+  // A mapped file shows writes made to it in place and faults past its end
+  // if it shrinks; copyFile() takes a copy of it up to where it now ends.
+  bool isMapped() const { return file && file->mapped; }
+  void copyFile();
+
+  // Captures the current text for writing out, sharing unedited lines with
+  // the loaded file.
+  TextSnapshot snapshot() const;
+
+  // Bytes of heap the buffer holds on to, roughly.
+  struct MemoryUse
+  {
+    size_t index = 0, packed = 0, pool = 0, poolFree = 0, longLines = 0, file = 0;
+
+    size_t total() const { return index + packed + pool + longLines + file; }
+  };
+
+  // Walks every leaf, unless nothing changed since the last call.
+  MemoryUse memoryUse() const;
+  size_t memoryUsed() const { return memoryUse().total(); }
+
+  // Copies edited lines into fresh pool blocks once half the pool is freed
+  // space. Invalidates views of line text.
+  void compact();
+
+  // Bytes the line index and its file pages should stay within; 0 for no
+  // limit.
+  void setMemoryBudget(size_t bytes);
+  size_t memoryBudget() const { return budget; }
+
+  // Whether the line holds only ASCII; cached until the line is edited.
+  bool isAscii(size_t index) const;
+
+  LineState lineState(size_t index) const;
+  void invalidateState(size_t index);
+
+  // Bracket nesting depth at the start of line `index`, which must be in
+  // [0, lexValid). O(log n).
+  long bracketDepth(size_t index) const;
+
+  // The first line in [from, last), or the last one in [first, before),
+  // whose brackets reach `depth` or below; SIZE_MAX if none.
+  size_t firstLineReaching(size_t from, size_t last, long depth) const;
+  size_t lastLineReaching(size_t first, size_t before, long depth) const;
+
+  // Calls fn(index, line) for every line in [first, last) in order; stops
+  // early when fn returns false.
+  template <typename Fn>
+  void forEachLine(size_t first, size_t last, Fn &&fn) const
+  {
+    auto textOnly = [&](size_t i, Line &line)
+    { return fn(i, text(line)); };
+
+    if (first < last)
+      visit(root.get(), 0, first, last, textOnly);
+  }
+
+  // Calls fn(index, text, start, size, ascii) for every line in [first,
+  // last), where text covers at least columns [column, column + count) and
+  // starts at column `start`. Long lines are not joined.
+  template <typename Fn>
+  void forEachSlice(size_t first, size_t last, size_t column, size_t count, Fn &&fn) const
+  {
+    std::string joined;
+
+    auto sliceOnly = [&](size_t i, Line &line)
+    {
+      size_t start;
+      std::string_view sliced = slice(line, column, count, joined, start);
+      return fn(i, sliced, start, length(line), isAscii(line));
+    };
+
+    if (first < last)
+      visit(root.get(), 0, first, last, sliceOnly);
+  }
+
+  // Calls fn(column, text) for each chunk of the line in order, or once
+  // with the whole line if it is not split.
+  template <typename Fn>
+  void forEachPiece(size_t index, Fn &&fn) const
+  {
+    Node *leaf = locate(index);
+    const Line &line = leaf->lines[index];
+
+    if (line.place != LONG)
+    {
+      fn(0, text(line));
+      return;
+    }
+
+    size_t column = 0;
+
+    for (const Chunk &chunk : line.longLine->chunks)
+    {
+      fn(column, std::string_view(chunk.text));
+      column += chunk.text.size();
+    }
+  }
+
+  // Like forEachLine, but fn(index, column, text, state) may update the
+  // cached lexer state. Long lines come one chunk at a time.
+  template <typename Fn>
+  void forEachLineState(size_t first, size_t last, Fn &&fn)
+  {
+    size_t changedFirst = SIZE_MAX, changedLast = 0;
+
+    auto withState = [&](size_t i, Line &line)
+    {
+      LineState before = stateOf(line);
+      bool wasDirty = before.dirty && i < lexEnd;
+      bool result = true;
+
+      if (line.place != LONG && length(line) > LONG_LINE_BYTES)
+      {
+        splitIntoChunks(line, text(line));
+        measuredChanges = UINT64_MAX;
+      }
+
+      if (line.place == LONG)
+      {
+        size_t column = 0;
+
+        for (Chunk &chunk : line.longLine->chunks)
+        {
+          if (!(result = fn(i, column, std::string_view(chunk.text), chunk.state)))
+            break;
+          column += chunk.text.size();
+        }
+
+        combineChunkStates(line);
+      }
+      else
+      {
+        LineState state = before;
+        result = fn(i, (size_t)0, text(line), state);
+        setState(line, state);
+      }
+
+      LineState after = stateOf(line);
+
+      if (wasDirty && !after.dirty)
+        lexDirty--;
+
+      if (after.bracketSum != before.bracketSum || after.bracketMin != before.bracketMin)
+      {
+        changedFirst = std::min(changedFirst, i);
+        changedLast = i + 1;
+      }
+
+      return result;
+    };
+
+    if (first < last)
+      visit(root.get(), 0, first, last, withState, true);
+
+    if (changedFirst < changedLast)
+      forgetBrackets(root.get(), 0, changedFirst, changedLast);
+  }
+
+  // Calls fn(index, text) for the lines in [first, last), where text is one
+  // or more whole lines joined by '\n', up to RUN_MAX_BYTES of unedited
+  // ones at a time. Stops early when fn returns false.
+  template <typename Fn>
+  void forEachRun(size_t first, size_t last, Fn &&fn) const
+  {
+    size_t runStart = 0;
+    std::string_view run;
+    bool hasRun = false, runShared = false, stopped = false;
+
+    auto extend = [&](size_t i, Line &line)
+    {
+      bool shared = line.place == IN_FILE;
+
+      if (hasRun && runShared && shared && run.data() + run.size() + 1 == file->data + line.offset && run.size() < RUN_MAX_BYTES)
+      {
+        run = std::string_view(run.data(), run.size() + 1 + line.extent.size);
+        return true;
+      }
+
+      if (hasRun && !fn(runStart, run))
+      {
+        stopped = true;
+        return false;
+      }
+
+      runStart = i;
+      run = text(line);
+      hasRun = true;
+      runShared = shared;
+      return true;
+    };
+
+    if (first < last)
+      visit(root.get(), 0, first, last, extend);
+
+    if (hasRun && !stopped)
+      fn(runStart, run);
+  }
+
+private:
+  struct Chunk
+  {
+    std::string text;
+    LineState state;
+  };
+
+  // A long line's chunks, with the state combined from theirs. line()
+  // joins them into `joined`, which is kept until the next edit.
+  struct LongLine
+  {
+    std::vector<Chunk> chunks;
+    size_t size = 0;
+    LineState state;
+    mutable std::unique_ptr<std::string> joined;
+  };
+
+  enum Place : uint8_t
+  {
+    IN_FILE,
+    IN_POOL,
+    LONG,
+  };
+
+  // 16 bytes a line. The text is at `offset` in the file or the pool, or in
+  // a LongLine. The bracket summary is kept as how far the depth dips below
+  // the line's start and then rises, which chunking keeps within 17 bits.
+  struct Line
+  {
+    static const uint64_t MAX_SIZE = (1u << 30) - 1;
+    static const uint8_t VALUE_UNKNOWN = UINT8_MAX;
+
+    struct Extent
+    {
+      uint64_t size : 30;
+      uint64_t dip : 17;
+      uint64_t rise : 17;
+    };
+
+    uint64_t offset : 48;
+    uint64_t place : 2;
+    uint64_t value : 8;
+    uint64_t dirty : 1;
+    uint64_t ascii : 2;
+
+    union
+    {
+      Extent extent;
+      LongLine *longLine;
+    };
+
+    Line() : offset(0), place(IN_POOL), value(VALUE_UNKNOWN), dirty(1), ascii(ASCII_UNKNOWN), extent{0, 0, 0} {}
+    Line(Line &&other) noexcept;
+    Line &operator=(Line &&other) noexcept;
+    ~Line();
+  };
+
+  static_assert(sizeof(Line) == 16, "lines are packed into 16 bytes");
+
+  // A link in the list of expanded leaves kept under a memory budget.
+  struct HotLink
+  {
+    HotLink *prev = nullptr, *next = nullptr;
+
+    HotLink() = default;
+    HotLink(const HotLink &) = delete;
+    HotLink &operator=(const HotLink &) = delete;
+    ~HotLink() { unlink(); }
+
+    bool isLinked() const { return prev != nullptr; }
+    void linkAfter(HotLink *at);
+    void unlink();
+  };
+
+  // A leaf's lines encoded and compressed, kept until they change.
+  struct PackedLines
+  {
+    uint32_t lines = 0, encodedBytes = 0;
+    std::vector<char> bytes;
+  };
+
+  struct Node : HotLink
+  {
+    std::vector<Line> lines;
+    std::unique_ptr<Node> left, right;
+    size_t lineCount = 0;
+    size_t nodeCount = 1;
+
+    // Bracket summaries of the node's own lines and of its subtree.
+    long leafSum = 0, leafMin = 0, treeSum = 0, treeMin = 0;
+    bool leafKnown = false, treeKnown = false;
+
+    // Visits in progress pin the leaf expanded.
+    bool isPacked = false;
+    std::atomic<uint16_t> pins{0};
+    uint32_t hotBytes = 0;
+    std::unique_ptr<PackedLines> packed;
+  };
+
+  static const size_t LEAF_MAX_LINES = 512;
+  static const size_t RUN_MAX_BYTES = 64 << 10;
+
+  // Leaves that stay expanded under any budget, such as those on screen.
+  static const size_t MIN_HOT_LEAVES = 16;
+
+  // Expanded leaves, most recently used first, while there is a budget.
+  // Declared before the tree so that it outlives the leaves linked to it.
+  mutable HotLink hotLeaves;
+  size_t budget = 0;
+  mutable size_t hotCount = 0, hotBytes = 0, packedBytes = 0;
+  mutable std::atomic<size_t> packedLeaves{0};
+  mutable std::vector<char> packScratch;
+  mutable std::mutex leafMutex;
+
+  std::unique_ptr<Node> root;
+  uint64_t rngState = 0x9E3779B97F4A7C15ull;
+  uint64_t changes = 0;
+
+  mutable MemoryUse measuredMemory;
+  mutable uint64_t measuredChanges = UINT64_MAX;
+
+  std::shared_ptr<FileData> file;
+  size_t loadOffset = 0, scanOffset = 0;
+  std::vector<uint64_t> newlines;
+
+  // Blocks of edited lines' text, which never move. poolBytes counts the
+  // bytes handed out and poolFreed those no line uses any more.
+  static const size_t POOL_BLOCK_BITS = 20;
+  std::vector<std::unique_ptr<char[]>> pool;
+  size_t poolUsed = 0, poolBytes = 0, poolFreed = 0;
+
+  static size_t lineCount(const std::unique_ptr<Node> &node) { return node ? node->lineCount : 0; }
+  static size_t ownLines(const Node *node) { return node->isPacked ? node->packed->lines : node->lines.size(); }
+  static size_t nodeCount(const std::unique_ptr<Node> &node) { return node ? node->nodeCount : 0; }
+  static void update(Node *node);
+  static void nodeMemory(const Node *node, MemoryUse &use);
+
+  uint64_t nextRandom();
+  std::unique_ptr<Node> merge(std::unique_ptr<Node> a, std::unique_ptr<Node> b);
+  std::pair<std::unique_ptr<Node>, std::unique_ptr<Node>> split(std::unique_ptr<Node> node, size_t lines);
+  static std::unique_ptr<Node> build(std::vector<std::unique_ptr<Node>> &leaves, size_t first, size_t last);
+  std::unique_ptr<Node> buildFromLines(std::vector<std::string> &&lines);
+  static std::unique_ptr<Node> buildFromLines(std::vector<Line> &&lines);
+
+  Node *locate(size_t &index) const;
+  void adjustPath(size_t leafStart, long delta);
+  void splitLeaf(Node *leaf, size_t leafStart, size_t at);
+  void removeLeaf(size_t leafStart, size_t leafLines);
+  void invalidateLine(Line &line, size_t index);
+  void insertInto(Line &line, size_t index, size_t column, std::string_view inserted);
+  std::string eraseFrom(Line &line, size_t index, size_t from, size_t to);
+  void replaceInLine(Line &line, size_t index, const LineEdit &edit);
+
+  static size_t length(const Line &line) { return line.place == LONG ? line.longLine->size : line.extent.size; }
+  static LineState stateOf(const Line &line);
+  static void setState(Line &line, const LineState &state);
+
+  std::string_view text(const Line &line) const;
+  std::string_view slice(const Line &line, size_t column, size_t count, std::string &joined, size_t &start) const;
+
+  static size_t slotBytes(size_t size);
+  char *allocate(size_t size, uint64_t &offset);
+  char *poolText(uint64_t offset) const { return pool[offset >> POOL_BLOCK_BITS].get() + (offset & (((uint64_t)1 << POOL_BLOCK_BITS) - 1)); }
+  void release(const Line &line);
+  void store(Line &line, std::string_view text);
+  Line makeLine(std::string_view text);
+
+  static LongLine *chunksOf(std::string_view text);
+  void splitIntoChunks(Line &line, std::string_view whole);
+  void joinChunks(Line &line);
+  static void rechunk(LongLine &chunks, size_t first, size_t last);
+  static size_t chunkAt(const LongLine &chunks, size_t &column);
+  static void combineChunkStates(Line &line);
+  bool isAscii(Line &line) const;
+  static bool checkAscii(std::string_view text, LineState &state);
+
+  void summarizeLeaf(Node *node) const;
+  void summarize(Node *node) const;
+  static void forgetBrackets(Node *node, size_t offset, size_t first, size_t last);
+  size_t findForward(Node *node, size_t offset, long base, size_t from, size_t last, long depth) const;
+  size_t findBackward(Node *node, size_t offset, long base, size_t first, size_t before, long depth) const;
+
+  void expand(Node *node) const;
+  void touch(Node *node) const;
+  void shrinkHotLeaves(const Node *keep) const;
+  bool pack(Node *node) const;
+  void packCold(Node *node) const;
+  void pin(Node *node, bool writes) const;
+  void unpin(Node *node) const;
+  void changedLeaf(Node *node) const;
+  void forgetLeaves(Node *node) const;
+  void releasePages(const Node *node) const;
+  void takeHotLeaves(TextBuffer &other);
+
+  // Calls fn on lines [first, last) in order, expanding leaves on the way;
+  // with `writes`, fn may change them.
+  template <typename Fn>
+  bool visit(Node *node, size_t offset, size_t first, size_t last, Fn &fn, bool writes = false) const
+  {
+    if (!node || offset >= last || offset + node->lineCount <= first)
+      return true;
+
+    size_t leftLines = node->left ? node->left->lineCount : 0;
+
+    if (!visit(node->left.get(), offset, first, last, fn, writes))
+      return false;
+
+    // From the subtree counts, which other threads' packing leaves alone.
+    size_t start = offset + leftLines;
+    size_t own = node->lineCount - leftLines - lineCount(node->right);
+    size_t from = first > start ? first - start : 0;
+    size_t to = std::min(own, last > start ? last - start : 0);
+
+    if (from < to)
+    {
+      pin(node, writes);
+
+      size_t i = from;
+      while (i < to && fn(start + i, node->lines[i]))
+        i++;
+
+      unpin(node);
+
+      if (i < to)
+        return false;
+    }
+
+    return visit(node->right.get(), start + own, first, last, fn, writes);
+  }
+};
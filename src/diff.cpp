@@ -0,0 +1,251 @@
+#include "diff.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+
+// Ranges that differ in more lines than this are matched up by unique
+// lines instead of line by line, which would cost O(lines * edits).
+static const long MAX_SHORTEST_EDITS = 512;
+
+struct Range
+{
+  size_t oldStart, oldEnd, newStart, newEnd;
+};
+
+static std::vector<uint64_t> hashLines(const TextBuffer &buffer)
+{
+  std::vector<uint64_t> hashes;
+  hashes.reserve(buffer.size());
+
+  buffer.forEachLine(0, buffer.size(), [&](size_t, std::string_view line)
+                     {
+                       hashes.push_back(std::hash<std::string_view>()(line));
+                       return true; });
+
+  return hashes;
+}
+
+// Appends the range's hunks with Myers' O((N + M) D) algorithm if they are
+// few enough, and returns whether it did.
+static bool shortestEdit(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b, const Range &range, std::vector<LineHunk> &hunks)
+{
+  long n = range.oldEnd - range.oldStart, m = range.newEnd - range.newStart;
+  long maxEdits = std::min(n + m, MAX_SHORTEST_EDITS);
+  long offset = maxEdits + 1;
+
+  std::vector<long> furthest(2 * offset + 1, 0);
+  std::vector<long> trace;
+  long edits = -1;
+
+  for (long d = 0; d <= maxEdits && edits < 0; d++)
+  {
+    for (long k = -d; k <= d; k += 2)
+    {
+      long x = k == -d || (k != d && furthest[offset + k - 1] < furthest[offset + k + 1]) ? furthest[offset + k + 1] : furthest[offset + k - 1] + 1;
+      long y = x - k;
+
+      while (x < n && y < m && a[range.oldStart + x] == b[range.newStart + y])
+      {
+        x++;
+        y++;
+      }
+
+      furthest[offset + k] = x;
+
+      if (x >= n && y >= m)
+      {
+        edits = d;
+        break;
+      }
+    }
+
+    // Round d takes diagonals -d to d, starting at d * d in the trace.
+    trace.insert(trace.end(), furthest.begin() + offset - d, furthest.begin() + offset + d + 1);
+  }
+
+  if (edits < 0)
+    return false;
+
+  // Single line edits, last first: where each happened, and whether it
+  // inserted a new line or removed an old one.
+  struct Edit
+  {
+    long x, y;
+    bool inserted;
+  };
+
+  std::vector<Edit> path;
+
+  for (long d = edits, x = n, y = m; d > 0; d--)
+  {
+    const long *previous = trace.data() + (d - 1) * (d - 1) + (d - 1);
+    long k = x - y;
+    bool inserted = k == -d || (k != d && previous[k - 1] < previous[k + 1]);
+    long previousK = inserted ? k + 1 : k - 1;
+
+    x = previous[previousK];
+    y = x - previousK;
+    path.push_back({x, y, inserted});
+  }
+
+  // Edits with no common line between them make one hunk.
+  size_t firstHunk = hunks.size();
+
+  for (auto edit = path.rbegin(); edit != path.rend(); ++edit)
+  {
+    size_t oldAt = range.oldStart + edit->x, newAt = range.newStart + edit->y;
+    LineHunk *last = hunks.size() > firstHunk ? &hunks.back() : nullptr;
+
+    if (!last || last->oldStart + last->oldCount != oldAt || last->newStart + last->newCount != newAt)
+    {
+      hunks.push_back({oldAt, 0, newAt, 0});
+      last = &hunks.back();
+    }
+
+    if (edit->inserted)
+      last->newCount++;
+    else
+      last->oldCount++;
+  }
+
+  return true;
+}
+
+// The lines unique to each side of the range, reduced to the longest run
+// in order on both sides.
+static std::vector<std::pair<size_t, size_t>> uniqueAnchors(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b, const Range &range)
+{
+  struct Occurrences
+  {
+    uint64_t hash;
+    uint32_t oldCount, newCount;
+    size_t oldAt, newAt;
+  };
+
+  size_t capacity = 16;
+  while (capacity < 2 * (range.oldEnd - range.oldStart))
+    capacity *= 2;
+
+  std::vector<Occurrences> table(capacity, Occurrences{0, 0, 0, 0, 0});
+
+  auto find = [&](uint64_t hash) -> Occurrences &
+  {
+    size_t slot = (hash * 0x9E3779B97F4A7C15ull) >> 32 & (capacity - 1);
+
+    while (table[slot].oldCount != 0 && table[slot].hash != hash)
+      slot = (slot + 1) & (capacity - 1);
+
+    return table[slot];
+  };
+
+  for (size_t i = range.oldStart; i < range.oldEnd; i++)
+  {
+    Occurrences &found = find(a[i]);
+    found.hash = a[i];
+    found.oldCount++;
+    found.oldAt = i;
+  }
+
+  for (size_t j = range.newStart; j < range.newEnd; j++)
+  {
+    Occurrences &found = find(b[j]);
+
+    if (found.oldCount != 0)
+    {
+      found.newCount++;
+      found.newAt = j;
+    }
+  }
+
+  std::vector<std::pair<size_t, size_t>> pairs;
+
+  for (size_t i = range.oldStart; i < range.oldEnd; i++)
+  {
+    const Occurrences &found = find(a[i]);
+
+    if (found.oldCount == 1 && found.newCount == 1)
+      pairs.emplace_back(i, found.newAt);
+  }
+
+  // Longest increasing run of new positions, by patience sorting: tops[k]
+  // is the pair ending the best run of length k + 1 found so far.
+  std::vector<size_t> tops, previous(pairs.size());
+
+  for (size_t p = 0; p < pairs.size(); p++)
+  {
+    auto pile = std::lower_bound(tops.begin(), tops.end(), pairs[p].second, [&](size_t top, size_t at)
+                                 { return pairs[top].second < at; });
+
+    previous[p] = pile == tops.begin() ? SIZE_MAX : *(pile - 1);
+
+    if (pile == tops.end())
+      tops.push_back(p);
+    else
+      *pile = p;
+  }
+
+  std::vector<std::pair<size_t, size_t>> anchors(tops.size());
+  size_t p = tops.empty() ? SIZE_MAX : tops.back();
+
+  for (size_t k = anchors.size(); k-- > 0; p = previous[p])
+    anchors[k] = pairs[p];
+
+  return anchors;
+}
+
+std::vector<LineHunk> diffLines(const TextBuffer &before, const TextBuffer &after)
+{
+  std::vector<uint64_t> a = hashLines(before), b = hashLines(after);
+  std::vector<LineHunk> hunks;
+  std::vector<Range> pending = {{0, a.size(), 0, b.size()}};
+
+  while (!pending.empty())
+  {
+    Range range = pending.back();
+    pending.pop_back();
+
+    while (range.oldStart < range.oldEnd && range.newStart < range.newEnd && a[range.oldStart] == b[range.newStart])
+    {
+      range.oldStart++;
+      range.newStart++;
+    }
+
+    while (range.oldStart < range.oldEnd && range.newStart < range.newEnd && a[range.oldEnd - 1] == b[range.newEnd - 1])
+    {
+      range.oldEnd--;
+      range.newEnd--;
+    }
+
+    if (range.oldStart == range.oldEnd && range.newStart == range.newEnd)
+      continue;
+
+    if (shortestEdit(a, b, range, hunks))
+      continue;
+
+    std::vector<std::pair<size_t, size_t>> anchors = uniqueAnchors(a, b, range);
+
+    if (anchors.empty())
+    {
+      hunks.push_back({range.oldStart, range.oldEnd - range.oldStart, range.newStart, range.newEnd - range.newStart});
+      continue;
+    }
+
+    size_t oldAt = range.oldStart, newAt = range.newStart;
+
+    for (auto [i, j] : anchors)
+    {
+      pending.push_back({oldAt, i, newAt, j});
+      oldAt = i + 1;
+      newAt = j + 1;
+    }
+
+    pending.push_back({oldAt, range.oldEnd, newAt, range.newEnd});
+  }
+
+  std::sort(hunks.begin(), hunks.end(), [](const LineHunk &x, const LineHunk &y)
+            { return x.oldStart < y.oldStart; });
+
+  return hunks;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "buffer.h"
+
+// Lines [oldStart, oldStart + oldCount) of one text replaced by lines
+// [newStart, newStart + newCount) of another.
+struct LineHunk
+{
+  size_t oldStart, oldCount;
+  size_t newStart, newCount;
+};
+
+// The hunks that turn `before` into `after`, in order, matching lines by
+// hash patience-style. Both buffers must be fully loaded.
+std::vector<LineHunk> diffLines(const TextBuffer &before, const TextBuffer &after);
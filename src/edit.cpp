@@ -0,0 +1,69 @@
+#include "edit.h"
+
+#include <vector>
+
+TextPos insertText(TextBuffer &buffer, TextPos pos, std::string_view text)
+{
+  size_t newline = text.find('\n');
+
+  if (newline == std::string_view::npos)
+  {
+    buffer.insertInLine(pos.line, pos.column, text);
+    return {pos.line, pos.column + text.size()};
+  }
+
+  // Lines after the first are spliced in as one run.
+  std::vector<std::string> lines;
+  size_t start = newline + 1, end;
+
+  while ((end = text.find('\n', start)) != std::string_view::npos)
+  {
+    lines.emplace_back(text.substr(start, end - start));
+    start = end + 1;
+  }
+  lines.emplace_back(text.substr(start));
+
+  TextPos after = {pos.line + lines.size(), lines.back().size()};
+
+  lines.back() += buffer.eraseInLine(pos.line, pos.column, buffer.lineSize(pos.line));
+  buffer.insertInLine(pos.line, pos.column, text.substr(0, newline));
+  buffer.insertLines(pos.line + 1, std::move(lines));
+
+  return after;
+}
+
+std::string eraseText(TextBuffer &buffer, TextPos from, TextPos to)
+{
+  if (from.line == to.line)
+    return buffer.eraseInLine(from.line, from.column, to.column);
+
+  std::string removed(buffer.line(from.line).substr(from.column));
+
+  buffer.forEachLine(from.line + 1, to.line + 1, [&](size_t i, std::string_view line)
+                     {
+                       removed += '\n';
+                       removed += i == to.line ? line.substr(0, to.column) : line;
+                       return true; });
+
+  std::string rest(buffer.line(to.line).substr(to.column));
+
+  buffer.eraseInLine(from.line, from.column, buffer.lineSize(from.line));
+  buffer.insertInLine(from.line, from.column, rest);
+  buffer.eraseLines(from.line + 1, to.line - from.line);
+
+  return removed;
+}
+
+TextPos textEnd(TextPos pos, std::string_view text)
+{
+  size_t lastNewline = text.rfind('\n');
+
+  if (lastNewline == std::string_view::npos)
+    return {pos.line, pos.column + text.size()};
+
+  size_t lines = 0;
+  for (char c : text)
+    lines += c == '\n';
+
+  return {pos.line + lines, text.size() - lastNewline - 1};
+}
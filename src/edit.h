@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "buffer.h"
+
+struct TextPos
+{
+  size_t line = 0, column = 0;
+};
+
+// The two primitive edits every change to the text is made of. Text may
+// span lines, joined by '\n'.
+
+// Inserts text at pos and returns the position just past it.
+TextPos insertText(TextBuffer &buffer, TextPos pos, std::string_view text);
+
+// Removes the text from `from` up to `to` and returns it.
+std::string eraseText(TextBuffer &buffer, TextPos from, TextPos to);
+
+// Where text inserted at pos would end.
+TextPos textEnd(TextPos pos, std::string_view text);
+
+// Told of each primitive edit made on the caller's behalf, such as by undo:
+// text inserted at `at`, or removed from there.
+using EditObserver = std::function<void(bool inserted, TextPos at, std::string_view text)>;
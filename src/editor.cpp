@@ -0,0 +1,1998 @@
+#include "editor.h"
+
+#include <ncurses.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+#include "diff.h"
+#include "edit.h"
+#include "highlight.h"
+#include "stats.h"
+
+#define ASYNC_SAVE_BYTES (8 << 20)
+
+// Search matches are looked for this far left of the screen on long lines,
+// which are not scanned whole on every redraw.
+#define MATCH_MARGIN ((size_t)256)
+
+// What Tab inserts, and what indenting a selection adds to each line.
+#define INDENT "    "
+
+// Journals the edits to fileName from now on. A journal left by a crash is
+// kept until the user decides about it.
+static void attachJournal(Editor &e, const std::string &fileName)
+{
+  e.crashJournal.attach(fileName, e.disk);
+
+  if (hasNewerJournal(fileName))
+  {
+    e.crashJournal.pause();
+    e.message = "UNSAVED EDITS FROM A CRASH - :recover TO REPLAY THEM, :discard TO DROP THEM";
+  }
+}
+
+// Loads fileName into the buffer. On failure the buffer and its journal are
+// left as they were, for the caller to keep or to start the file empty.
+bool loadFromFile(Editor &e, const std::string &fileName)
+{
+  StatTimer timer(STAT_LOAD);
+
+  // Taken first, so that a change made while loading still shows.
+  e.disk = diskState(fileName);
+  e.changedOnDisk = false;
+  e.columns.clear();
+
+  if (!e.buffer.load(fileName))
+    return false;
+
+  attachJournal(e, fileName);
+  e.undo.clear();
+
+  if (e.buffer.size() == 0)
+    e.buffer.insertLine(0, "");
+
+  return true;
+}
+
+void openFile(Editor &e, const std::string &fileName)
+{
+  e.fileName = fileName;
+  e.language = languageFor(fileName);
+
+  if (!loadFromFile(e, e.fileName))
+  {
+    e.buffer.insertLine(0, "");
+    attachJournal(e, e.fileName);
+  }
+
+  e.watch.watch(e.fileName);
+}
+
+// Exchanges the file being edited, with everything that belongs to it, for
+// a stashed one.
+static void swapWithStash(Editor &e, StashedFile &file)
+{
+  std::swap(e.fileName, file.fileName);
+  std::swap(e.buffer, file.buffer);
+  std::swap(e.undo, file.undo);
+  std::swap(e.crashJournal, file.crashJournal);
+  std::swap(e.x, file.x);
+  std::swap(e.y, file.y);
+  std::swap(e.snapX, file.snapX);
+  std::swap(e.rowOffset, file.rowOffset);
+  std::swap(e.colOffset, file.colOffset);
+  std::swap(e.language, file.language);
+  std::swap(e.unSavedChanges, file.unSavedChanges);
+  std::swap(e.disk, file.disk);
+  std::swap(e.changedOnDisk, file.changedOnDisk);
+
+  e.columns.clear();
+  e.highlighter.forget();
+}
+
+// Gives every buffer that maps fileName a copy of its own, before the file
+// is truncated in place.
+static void copyMappedFile(Editor &e, const std::string &fileName)
+{
+  DiskState target = diskState(fileName);
+
+  if (target.isSameFile(e.disk))
+    e.buffer.copyFile();
+
+  for (StashedFile &file : e.stash)
+    if (target.isSameFile(file.disk))
+      file.buffer.copyFile();
+}
+
+// Drops the least recently used stashed files until the stash fits its
+// cap. Files with unsaved changes are never dropped.
+static void trimStash(Editor &e)
+{
+  size_t total = 0;
+
+  for (const StashedFile &file : e.stash)
+    total += file.memory;
+
+  for (auto it = e.stash.end(); it != e.stash.begin() && total > e.stashCap;)
+  {
+    --it;
+
+    if (it->unSavedChanges)
+      continue;
+
+    total -= it->memory;
+    it = e.stash.erase(it);
+  }
+}
+
+// Makes fileName the file being edited, from the stash or from disk, and
+// stashes the current one. Returns false, changing nothing, if the file
+// cannot be had and `create` does not allow starting it empty.
+static bool switchToFile(Editor &e, const std::string &fileName, bool create)
+{
+  if (fileName == e.fileName)
+    return true;
+
+  auto stashed = std::find_if(e.stash.begin(), e.stash.end(), [&](const StashedFile &file)
+                              { return file.fileName == fileName; });
+
+  StashedFile current;
+  size_t undoCap = e.undo.cap();
+  size_t memoryBudget = e.buffer.memoryBudget();
+
+  swapWithStash(e, current);
+
+  if (stashed != e.stash.end())
+  {
+    swapWithStash(e, *stashed);
+    e.stash.erase(stashed);
+  }
+  else if (loadFromFile(e, fileName) || create)
+  {
+    // Not loaded, so started empty.
+    if (e.buffer.size() == 0)
+    {
+      e.buffer.insertLine(0, "");
+      attachJournal(e, fileName);
+    }
+
+    e.fileName = fileName;
+    e.language = languageFor(fileName);
+  }
+  else
+  {
+    swapWithStash(e, current);
+    return false;
+  }
+
+  e.undo.setCap(undoCap);
+  e.buffer.setMemoryBudget(memoryBudget);
+  e.selection = Editor::SELECT_NONE;
+
+  // A stashed file may have changed on disk while it was away.
+  e.watch.watch(e.fileName);
+  e.diskCheckPending = true;
+
+  current.memory = current.buffer.memoryUsed() + current.undo.memoryUsed();
+  e.stash.push_front(std::move(current));
+  trimStash(e);
+  return true;
+}
+
+// Whether any file, stashed or not, has changes that are not on disk.
+static bool hasUnsavedChanges(const Editor &e)
+{
+  if (e.unSavedChanges)
+    return true;
+
+  for (const StashedFile &file : e.stash)
+    if (file.unSavedChanges)
+      return true;
+
+  return false;
+}
+
+bool reportSave(Editor &e, const std::string &fileName, const SaveResult &result)
+{
+  if (!result.ok)
+  {
+    // A background save may finish after its file was switched away from.
+    if (fileName == e.fileName)
+      e.unSavedChanges = true;
+
+    for (StashedFile &file : e.stash)
+      if (file.fileName == fileName)
+        file.unSavedChanges = true;
+
+    e.message = "SAVE FAILED - " + result.error;
+    return false;
+  }
+
+  // Remembered so that the watch does not take the save for someone else's.
+  DiskState saved = diskState(fileName);
+
+  // The journal only needs what came after the save.
+  if (fileName == e.fileName)
+  {
+    e.disk = saved;
+    e.crashJournal.saved(saved);
+  }
+
+  for (StashedFile &file : e.stash)
+  {
+    if (file.fileName == fileName)
+    {
+      file.disk = saved;
+      file.crashJournal.saved(saved);
+    }
+  }
+
+  statRecordSeconds(STAT_SAVE, result.seconds);
+  statAdd(STAT_SAVED_BYTES, result.bytes);
+
+  char rate[32] = "";
+  double bytesPerSecond = result.seconds > 0 ? result.bytes / result.seconds : 0;
+
+  if (bytesPerSecond >= 1e6)
+    snprintf(rate, sizeof(rate), " (%.1f MB/s)", bytesPerSecond / 1e6);
+  else if (bytesPerSecond > 0)
+    snprintf(rate, sizeof(rate), " (%.1f KB/s)", bytesPerSecond / 1e3);
+
+  e.message = "SAVED " + std::to_string(result.bytes) + " BYTES" + rate;
+  return true;
+}
+
+// Waits for a background save, if any, and reports how it went. Returns
+// false only if that save failed.
+bool waitForSave(Editor &e)
+{
+  if (!e.pendingSave.valid())
+    return true;
+
+  return reportSave(e, e.pendingSaveName, e.pendingSave.get());
+}
+
+// Reports a background save once its thread has finished. Returns whether
+// it had.
+bool pollSave(Editor &e)
+{
+  if (!e.pendingSave.valid() || e.pendingSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return false;
+
+  reportSave(e, e.pendingSaveName, e.pendingSave.get());
+  return true;
+}
+
+// Writes the buffer out, large ones on a background thread unless `wait`.
+// A file changed on disk is only overwritten by force.
+void saveToFile(Editor &e, bool wait = false, bool force = false)
+{
+  waitForSave(e);
+
+  if (e.changedOnDisk && !force)
+  {
+    e.message = "FILE CHANGED ON DISK - :reload TO LOAD IT, :s! TO OVERWRITE";
+    return;
+  }
+
+  e.changedOnDisk = false;
+
+  TextSnapshot snapshot = e.buffer.snapshot();
+  e.buffer.compact();
+  e.unSavedChanges = false;
+  e.crashJournal.saving();
+
+  if (wait || snapshot.size < ASYNC_SAVE_BYTES)
+  {
+    reportSave(e, e.fileName, writeSnapshot(e.fileName, snapshot, e.syncOnSave));
+    return;
+  }
+
+  e.message = "SAVING...";
+  e.pendingSaveName = e.fileName;
+  e.pendingSave = std::async(std::launch::async, [fileName = e.fileName, snapshot = std::move(snapshot), sync = e.syncOnSave]()
+                             { return writeSnapshot(fileName, snapshot, sync); });
+}
+
+// The cursor's screen column within its line; e.x counts bytes.
+static int cursorColumn(Editor &e)
+{
+  return e.columns.columnOf(e.buffer, e.y, e.x);
+}
+
+// Keeps the cursor's column for moves up and down to return to.
+static void rememberColumn(Editor &e)
+{
+  e.snapX = cursorColumn(e);
+}
+
+// Where on the cursor's line the kept column falls.
+static int snappedX(Editor &e)
+{
+  return e.columns.byteAt(e.buffer, e.y, e.snapX);
+}
+
+void placeCursor(Editor &e)
+{
+  int maxLineNumberLength = std::to_string(e.buffer.size()).size();
+
+  if (e.isChord)
+  {
+    e.renderer.cursorY = e.screenRows - 1;
+    e.renderer.cursorX = std::min((int)e.chord.size(), e.screenCols - 1);
+  }
+  else
+  {
+    e.renderer.cursorY = e.y - e.rowOffset;
+    e.renderer.cursorX = cursorColumn(e) - e.colOffset + maxLineNumberLength + 1;
+  }
+}
+
+// Draws the :stats report over the top rows of the text, followed by what
+// the buffer's lines cost in memory.
+static void drawStats(Frame &frame, int rows, const TextBuffer &buffer)
+{
+  std::vector<std::string> report = statsReport();
+  TextBuffer::MemoryUse use = buffer.memoryUse();
+  const double MB = 1 << 20;
+  char line[192];
+
+  snprintf(line, sizeof(line), "%-11s %7zu  %.1f B/line  index %.1fM  packed %.1fM  pool %.1fM (%.1fM free)  long %.1fM  file %.1fM", "lines",
+           buffer.size(), buffer.size() ? (double)use.total() / buffer.size() : 0.0,
+           use.index / MB, use.packed / MB, use.pool / MB, use.poolFree / MB, use.longLines / MB, use.file / MB);
+  report.push_back(line);
+
+  for (int i = 0; i < (int)report.size() && i < rows; i++)
+  {
+    clearRow(frame, i);
+    putText(frame, i, 0, report[i].data(), report[i].size(), A_NORMAL);
+    putAttr(frame, i, 0, frame.cols, OVERLAY);
+  }
+}
+
+// Draws a line holding more than ASCII at screen row `row`, given its bytes
+// from `start` on.
+static void drawWideLine(Editor &e, int row, int textStart, int textCols, size_t i, std::string_view text, size_t start, const HighlightData *highlight, const HighlightData *highlightsEnd, std::vector<std::pair<size_t, size_t>> &matches)
+{
+  Frame &frame = e.renderer.next;
+
+  // A wide character cut by the left edge leaves its visible half blank.
+  size_t first = e.columns.byteAt(e.buffer, i, e.colOffset);
+  size_t firstColumn = e.columns.columnOf(e.buffer, i, first);
+
+  if ((int)firstColumn < e.colOffset)
+  {
+    first = e.columns.nextChar(e.buffer, i, first);
+    firstColumn = e.colOffset + 1;
+  }
+
+  size_t last = std::max(first, e.columns.byteAt(e.buffer, i, e.colOffset + textCols));
+  size_t end = std::min(last, start + text.size());
+  int x = textStart + firstColumn - e.colOffset;
+
+  if (first >= start && first < end)
+    putText(frame, row, x, text.data() + first - start, end - first, A_NORMAL);
+
+  size_t walkByte = first, walkColumn = firstColumn;
+
+  auto columnAt = [&](size_t at)
+  {
+    if (at < walkByte)
+    {
+      walkByte = first;
+      walkColumn = firstColumn;
+    }
+
+    while (walkByte < at && walkByte < start + text.size())
+    {
+      char32_t c;
+      walkByte += decodeUtf8(text, walkByte - start, c);
+      walkColumn += charWidth(c);
+    }
+
+    return (int)walkColumn;
+  };
+
+  auto mark = [&](size_t from, size_t to, attr_t attr)
+  {
+    from = std::max(from, first);
+    to = std::min(to, last);
+
+    if (from < to)
+    {
+      int column = columnAt(from);
+      putAttr(frame, row, textStart + column - e.colOffset, columnAt(to) - column, attr);
+    }
+  };
+
+  for (; highlight < highlightsEnd; highlight++)
+    mark(highlight->position, highlight->position + highlight->length, highlight->color);
+
+  if (e.showMatches)
+  {
+    matches.clear();
+    e.search.matchesInLine(text, matches);
+
+    walkByte = first;
+    walkColumn = firstColumn;
+
+    for (auto [column, length] : matches)
+      mark(start + column, start + column + length, FIND);
+  }
+}
+
+// Lines [first, last) of the selection.
+static void selectedLines(Editor &e, size_t &first, size_t &last)
+{
+  first = std::min(e.anchorY, e.y);
+  last = std::min((size_t)std::max(e.anchorY, e.y) + 1, e.buffer.size());
+}
+
+// Screen columns [left, right) of a block selection; a line selection
+// spans whole lines.
+static void selectedColumns(Editor &e, size_t &left, size_t &right)
+{
+  if (e.selection == Editor::SELECT_LINES)
+  {
+    left = 0;
+    right = SIZE_MAX;
+    return;
+  }
+
+  int column = cursorColumn(e);
+
+  left = std::min(e.anchorColumn, column);
+  right = std::max(e.anchorColumn, column) + 1;
+}
+
+// Marks the part of the selection on screen.
+static void drawSelection(Editor &e, int textStart, int textCols)
+{
+  size_t first, last, left, right;
+
+  selectedLines(e, first, last);
+  selectedColumns(e, left, right);
+
+  size_t from = std::max(left, (size_t)e.colOffset), to = std::min(right, (size_t)e.colOffset + textCols);
+
+  if (from >= to)
+    return;
+
+  for (size_t i = std::max(first, (size_t)e.rowOffset); i < last && i < (size_t)(e.rowOffset + e.maxY); i++)
+    putAttr(e.renderer.next, i - e.rowOffset, textStart + from - e.colOffset, to - from, SELECTION);
+}
+
+void drawEditor(Editor &e)
+{
+  StatTimer timer(STAT_DRAW);
+  uint64_t allocations = statThreadAllocations();
+
+  int maxLineNumberLength = std::to_string(e.buffer.size()).size();
+
+  e.maxY = e.screenRows - 1;
+  e.maxX = e.screenCols;
+
+  beginFrame(e.renderer, e.maxY + 1, e.maxX);
+  Frame &frame = e.renderer.next;
+
+  std::vector<HighlightData> highlights;
+
+  if (!e.isChord)
+  {
+    int textStart = maxLineNumberLength + 1;
+    int textCols = std::max(1, e.maxX - textStart);
+
+    // With the highlighter running, the screen gets whatever it last
+    // published, and asks for the view at the end.
+    HighlightView view;
+    view.screen = {(size_t)e.rowOffset, (size_t)std::min(e.maxY + e.rowOffset, (int)e.buffer.size()), (size_t)e.colOffset, (size_t)textCols};
+
+    if (e.language)
+    {
+      StatTimer highlightTimer(STAT_HIGHLIGHT);
+
+      if (e.highlighter.isRunning())
+        e.highlighter.screenHighlights(view.screen.first, view.screen.last, highlights);
+      else
+        highlightLines(*e.language, e.buffer, view.screen.first, view.screen.last, highlights, view.screen.column, view.screen.width);
+
+      statRecord(STAT_FRAME_HIGHLIGHTS, highlights.size());
+    }
+
+    size_t nextHighlight = 0;
+    std::vector<std::pair<size_t, size_t>> matches;
+    std::vector<size_t> longWideLines;
+
+    // Only the columns on screen are taken from long lines, plus a margin
+    // for search matches that start before them.
+    size_t margin = e.showMatches ? std::max(MATCH_MARGIN, e.search.pattern().size()) : 0;
+    size_t sliceStart = e.colOffset > (int)margin ? e.colOffset - margin : 0;
+
+    for (int i = 0; i < e.maxY; i++)
+      clearRow(frame, i);
+
+    e.buffer.forEachSlice(e.rowOffset, e.maxY + e.rowOffset, sliceStart, e.colOffset - sliceStart + textCols + margin, [&](size_t i, std::string_view text, size_t start, size_t lineSize, bool ascii)
+                          {
+                            int offseti = i - e.rowOffset;
+
+                            std::string lineNumber = std::to_string(i + 1);
+                            putText(frame, offseti, 0, lineNumber.data(), lineNumber.size(), LINE_NUMBER);
+
+                            size_t firstHighlight = nextHighlight;
+                            while (nextHighlight < highlights.size() && highlights[nextHighlight].lineNumber == (int)i)
+                              nextHighlight++;
+
+                            // Long lines beyond ASCII are drawn after this walk.
+                            if (!ascii)
+                            {
+                              if (start == 0 && text.size() == lineSize)
+                                drawWideLine(e, offseti, textStart, textCols, i, text, 0, highlights.data() + firstHighlight, highlights.data() + nextHighlight, matches);
+                              else
+                                longWideLines.push_back(i);
+                              return true;
+                            }
+
+                            if (e.colOffset < (int)(start + text.size()))
+                              putText(frame, offseti, textStart, text.data() + e.colOffset - start, start + text.size() - e.colOffset, A_NORMAL);
+
+                            for (size_t h = firstHighlight; h < nextHighlight; h++)
+                            {
+                              const HighlightData &highlight = highlights[h];
+                              int from = std::max(highlight.position, e.colOffset);
+                              int to = std::min(highlight.position + highlight.length, (int)lineSize);
+                              putAttr(frame, offseti, textStart + from - e.colOffset, to - from, highlight.color);
+                            }
+
+                            if (e.showMatches)
+                            {
+                              matches.clear();
+                              e.search.matchesInLine(text, matches);
+
+                              for (auto [column, length] : matches)
+                              {
+                                int from = std::max((int)(start + column), e.colOffset);
+                                int to = start + column + length;
+                                putAttr(frame, offseti, textStart + from - e.colOffset, to - from, FIND);
+                              }
+                            }
+
+                            return true; });
+
+    // The highlighter only went through the bytes of long lines below the
+    // columns on screen, so those with wider characters get theirs anew.
+    for (size_t i : longWideLines)
+    {
+      size_t first = e.columns.byteAt(e.buffer, i, e.colOffset);
+      size_t last = e.columns.byteAt(e.buffer, i, e.colOffset + textCols);
+      std::vector<HighlightData> lineHighlights;
+
+      HighlightWindow window{i, i + 1, first, last - first + 1};
+
+      if (e.language && e.highlighter.isRunning())
+      {
+        view.lines.push_back(window);
+        e.highlighter.lineHighlights(window, lineHighlights);
+      }
+      else if (e.language)
+      {
+        highlightLines(*e.language, e.buffer, window.first, window.last, lineHighlights, window.column, window.width);
+      }
+
+      size_t from = first > margin ? first - margin : 0;
+
+      e.buffer.forEachSlice(i, i + 1, from, last - from + margin + 4, [&](size_t, std::string_view text, size_t start, size_t, bool)
+                            {
+                              drawWideLine(e, i - e.rowOffset, textStart, textCols, i, text, start, lineHighlights.data(), lineHighlights.data() + lineHighlights.size(), matches);
+                              return true; });
+    }
+
+    if (e.selection != Editor::SELECT_NONE)
+      drawSelection(e, textStart, textCols);
+
+    if (e.highlighter.isRunning())
+      e.highlighter.show(e.language, view);
+
+    if (e.showStats)
+      drawStats(frame, e.maxY, e.buffer);
+
+    std::string status = e.message;
+
+    if (status.size() == 0)
+    {
+      status = e.fileName.substr(e.fileName.find_last_of("/") + 1, e.fileName.size() - e.fileName.find_last_of("/") - 1) + " - " + std::to_string(e.buffer.size()) + " lines";
+
+      if (e.buffer.isLoading())
+        status += " (loading)";
+
+      if (e.unSavedChanges)
+        status += " (modified)";
+    }
+
+    clearRow(frame, e.maxY);
+    putText(frame, e.maxY, 0, status.data(), status.size(), MESSAGE);
+  }
+  else
+  {
+    e.message = "";
+
+    clearRow(frame, e.maxY);
+    putText(frame, e.maxY, 0, e.chord.data(), e.chord.size(), MESSAGE);
+  }
+
+  placeCursor(e);
+  statRecord(STAT_FRAME_ALLOCATIONS, statThreadAllocations() - allocations);
+}
+
+// Centers the cursor's column on screen if it is out of view. Returns
+// whether the view moved.
+static bool scrollToColumn(Editor &e)
+{
+  int textCols = std::max(1, e.screenCols - (int)std::to_string(e.buffer.size()).size() - 1);
+
+  int column = cursorColumn(e);
+
+  if (column >= e.colOffset && column < e.colOffset + textCols)
+    return false;
+
+  e.colOffset = std::max(0, column - textCols / 2);
+  return true;
+}
+
+// Centers the cursor's line on screen if it is out of view, and its column.
+void scrollToCursor(Editor &e)
+{
+  if (e.y < e.rowOffset || e.y >= e.rowOffset + e.screenRows - 1)
+    e.rowOffset = std::max(0, e.y - e.screenRows / 2);
+
+  scrollToColumn(e);
+}
+
+// All changes to the text go through editInsert() and editErase(), which
+// record them for undo. `typed` marks single keystrokes.
+TextPos editInsert(Editor &e, TextPos at, std::string_view text, bool typed = false)
+{
+  e.undo.recordInsert(at, text, typed);
+  e.crashJournal.recordInsert(at, text);
+  e.unSavedChanges = true;
+
+  return insertText(e.buffer, at, text);
+}
+
+void editErase(Editor &e, TextPos from, TextPos to, bool typed = false)
+{
+  std::string removed = eraseText(e.buffer, from, to);
+
+  e.undo.recordErase(from, removed, typed);
+  e.crashJournal.recordErase(from, to);
+  e.unSavedChanges = true;
+}
+
+// Collects a UTF-8 character typed in insert mode a byte at a time, and
+// inserts it once whole. A byte that cannot continue it starts over.
+static void typeByte(Editor &e, int ch)
+{
+  if (utf8SequenceLength(ch) > 1)
+    e.typedChar.assign(1, (char)ch);
+  else if (!e.typedChar.empty() && (ch & 0xC0) == 0x80)
+    e.typedChar += (char)ch;
+  else
+  {
+    e.typedChar.clear();
+    return;
+  }
+
+  if (e.typedChar.size() < utf8SequenceLength(e.typedChar[0]))
+    return;
+
+  editInsert(e, {(size_t)e.y, (size_t)e.x}, e.typedChar, true);
+  e.x += e.typedChar.size();
+  e.typedChar.clear();
+  rememberColumn(e);
+}
+
+// Inserts text at the cursor and moves the cursor past it.
+void insertText(Editor &e, const std::string &text)
+{
+  TextPos end = editInsert(e, {(size_t)e.y, (size_t)e.x}, text);
+
+  e.y = end.line;
+  e.x = end.column;
+  rememberColumn(e);
+
+  if (e.y >= e.screenRows + e.rowOffset - 1)
+    e.rowOffset = e.y - e.screenRows + 2;
+}
+
+void undoOrRedo(Editor &e, bool isRedo)
+{
+  TextPos cursor;
+
+  auto journal = [&](bool inserted, TextPos at, std::string_view text)
+  {
+    if (inserted)
+      e.crashJournal.recordInsert(at, text);
+    else
+      e.crashJournal.recordErase(at, textEnd(at, text));
+  };
+
+  if (!(isRedo ? e.undo.redo(e.buffer, cursor, journal) : e.undo.undo(e.buffer, cursor, journal)))
+  {
+    e.message = isRedo ? "NOTHING TO REDO" : "NOTHING TO UNDO";
+    return;
+  }
+
+  e.unSavedChanges = true;
+
+  e.y = cursor.line;
+  e.x = cursor.column;
+  rememberColumn(e);
+
+  scrollToCursor(e);
+}
+
+// Moves the cursor to the next match of the current search at or after
+// `from`, or the previous one before it, and reports the total count.
+void jumpToMatch(Editor &e, TextPos from, bool backwards)
+{
+  e.buffer.finishLoading();
+
+  TextPos match;
+  bool found = backwards ? e.search.previous(e.buffer, from, match) : e.search.next(e.buffer, from, match);
+
+  if (!found)
+  {
+    e.showMatches = false;
+    e.message = "NOT FOUND";
+    return;
+  }
+
+  e.y = match.line;
+  e.x = match.column;
+  rememberColumn(e);
+
+  scrollToCursor(e);
+
+  e.showMatches = true;
+
+  size_t count = e.search.count(e.buffer, e.workers);
+  e.message = std::to_string(count) + (count == 1 ? " MATCH" : " MATCHES");
+}
+
+// Moves the cursor to the bracket matching the first one at or after it on
+// the current line.
+void jumpToBracket(Editor &e)
+{
+  e.buffer.finishLoading();
+
+  TextPos match;
+
+  if (!findMatchingBracket(e.language ? *e.language : plainText(), e.buffer, {(size_t)e.y, (size_t)e.x}, match))
+  {
+    e.message = "NO MATCHING BRACKET";
+    return;
+  }
+
+  e.y = match.line;
+  e.x = match.column;
+  rememberColumn(e);
+
+  scrollToCursor(e);
+}
+
+// Splits "a/b/c" on slashes that are not escaped with a backslash. The
+// escapes themselves are kept for the regex and replacement parsers.
+std::vector<std::string> splitOnSlashes(const std::string &text)
+{
+  std::vector<std::string> parts(1);
+
+  for (size_t i = 0; i < text.size(); i++)
+  {
+    if (text[i] == '\\' && i + 1 < text.size())
+    {
+      parts.back() += text.substr(i++, 2);
+    }
+    else if (text[i] == '/')
+    {
+      parts.emplace_back();
+    }
+    else
+    {
+      parts.back() += text[i];
+    }
+  }
+
+  return parts;
+}
+
+// Replaces every match of the search in the buffer. The new lines are
+// computed in parallel and applied as one undo step.
+void replaceAll(Editor &e, const std::string &replacement)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  e.buffer.finishLoading();
+
+  size_t count;
+  std::vector<LineReplacement> lines = e.search.replaceAll(e.buffer, replacement, e.workers, count);
+
+  e.undo.beginGroup();
+
+  for (LineReplacement &line : lines)
+  {
+    editErase(e, {line.line, 0}, {line.line, e.buffer.lineSize(line.line)});
+    editInsert(e, {line.line, 0}, line.text);
+  }
+
+  e.undo.endGroup();
+
+  e.x = std::min(e.x, (int)e.buffer.lineSize(e.y));
+  rememberColumn(e);
+
+  double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  e.message = std::to_string(count) + " REPLACED IN " + std::to_string(lines.size()) + " LINES (" + std::to_string((int)milliseconds) + " ms)";
+}
+
+// Starts a selection at the cursor, or ends one of the same kind.
+static void toggleSelection(Editor &e, Editor::Selection kind)
+{
+  if (e.selection == kind)
+  {
+    e.selection = Editor::SELECT_NONE;
+    e.message = "";
+    return;
+  }
+
+  e.selection = kind;
+  e.anchorY = e.y;
+  e.anchorColumn = cursorColumn(e);
+  e.message = kind == Editor::SELECT_LINES ? "SELECT LINES" : "SELECT BLOCK";
+  e.message += " - > < TO INDENT, x TO DELETE, :i OR :a TO INSERT";
+}
+
+// Edits lines [first, last) in one pass as fn(text, edit) decides, undone as
+// one step. Returns how many lines changed.
+template <typename Fn>
+static size_t editLines(Editor &e, size_t first, size_t last, Fn &&fn)
+{
+  size_t changed = 0;
+
+  e.undo.seal();
+  e.undo.beginGroup();
+
+  e.buffer.editLines(first, last, [&](size_t i, std::string_view text, TextBuffer::LineEdit &edit)
+                     {
+                       if (!fn(text, edit))
+                         return false;
+
+                       if (edit.to > edit.from)
+                       {
+                         e.undo.recordErase({i, edit.from}, text.substr(edit.from, edit.to - edit.from), false);
+                         e.crashJournal.recordErase({i, edit.from}, {i, edit.to});
+                       }
+
+                       if (!edit.text.empty())
+                       {
+                         e.undo.recordInsert({i, edit.from}, edit.text, false);
+                         e.crashJournal.recordInsert({i, edit.from}, edit.text);
+                       }
+
+                       changed++;
+                       return true; });
+
+  e.undo.endGroup();
+
+  if (changed > 0)
+    e.unSavedChanges = true;
+
+  // The cursor's line may have got shorter.
+  e.x = std::min(e.x, (int)e.buffer.lineSize(e.y));
+  rememberColumn(e);
+
+  return changed;
+}
+
+static void reportLines(Editor &e, const char *what, size_t changed, std::chrono::steady_clock::time_point start)
+{
+  double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  e.message = std::string(what) + " " + std::to_string(changed) + (changed == 1 ? " LINE" : " LINES") + " (" + std::to_string((int)milliseconds) + " ms)";
+}
+
+// Indents each non-empty line of the selection, or takes one level of
+// indentation, up to a tab or as many spaces as Tab inserts, off each.
+static void indentSelection(Editor &e, bool outdent)
+{
+  auto start = std::chrono::steady_clock::now();
+  size_t first, last;
+
+  selectedLines(e, first, last);
+
+  size_t changed = editLines(e, first, last, [&](std::string_view text, TextBuffer::LineEdit &edit)
+                             {
+                               if (!outdent)
+                               {
+                                 edit.text = INDENT;
+                                 return !text.empty();
+                               }
+
+                               size_t spaces = 0;
+                               while (spaces < sizeof(INDENT) - 1 && spaces < text.size() && text[spaces] == ' ')
+                                 spaces++;
+
+                               edit.to = spaces == 0 && !text.empty() && text[0] == '\t' ? 1 : spaces;
+                               return edit.to > 0; });
+
+  reportLines(e, outdent ? "OUTDENTED" : "INDENTED", changed, start);
+}
+
+// Inserts text on every line of the selection, at its left edge or with
+// `after` past its right edge. Lines that end before the column are skipped.
+static void insertIntoSelection(Editor &e, const std::string &text, bool after)
+{
+  auto start = std::chrono::steady_clock::now();
+  size_t first, last, left, right;
+
+  selectedLines(e, first, last);
+  selectedColumns(e, left, right);
+
+  size_t column = after ? right : left;
+
+  size_t changed = editLines(e, first, last, [&](std::string_view line, TextBuffer::LineEdit &edit)
+                             {
+                               edit.from = edit.to = byteAtColumn(line, column);
+                               edit.text = text;
+
+                               return column == 0 || column == SIZE_MAX || edit.from < line.size() || byteAtColumn(line, column - 1) < line.size(); });
+
+  reportLines(e, "INSERTED ON", changed, start);
+}
+
+// Deletes the selection: its lines whole, in one edit, or the columns of
+// the block from each line.
+static void eraseSelection(Editor &e)
+{
+  auto start = std::chrono::steady_clock::now();
+  size_t first, last, left, right;
+
+  selectedLines(e, first, last);
+  selectedColumns(e, left, right);
+
+  if (e.selection == Editor::SELECT_BLOCK)
+  {
+    size_t changed = editLines(e, first, last, [&](std::string_view line, TextBuffer::LineEdit &edit)
+                               {
+                                 edit.from = byteAtColumn(line, left);
+                                 edit.to = byteAtColumn(line, right);
+                                 return edit.to > edit.from; });
+
+    e.y = first;
+    e.x = e.columns.byteAt(e.buffer, e.y, left);
+    rememberColumn(e);
+    scrollToCursor(e);
+
+    e.selection = Editor::SELECT_NONE;
+    reportLines(e, "DELETED FROM", changed, start);
+    return;
+  }
+
+  // The buffer keeps at least one line, so deleting the last lines takes
+  // the newline before them instead of after.
+  size_t size = e.buffer.size();
+
+  e.undo.seal();
+
+  if (last < size)
+    editErase(e, {first, 0}, {last, 0});
+  else if (first > 0)
+    editErase(e, {first - 1, e.buffer.lineSize(first - 1)}, {size - 1, e.buffer.lineSize(size - 1)});
+  else
+    editErase(e, {0, 0}, {size - 1, e.buffer.lineSize(size - 1)});
+
+  e.undo.seal();
+
+  e.y = std::min(first, e.buffer.size() - 1);
+  e.x = 0;
+  rememberColumn(e);
+  scrollToCursor(e);
+
+  e.selection = Editor::SELECT_NONE;
+  reportLines(e, "DELETED", last - first, start);
+}
+
+// Replaces the hunk's old lines with its lines from `after`, as an erase and
+// an insert. A hunk at the end takes the newline before it.
+static void applyHunk(Editor &e, const LineHunk &hunk, const TextBuffer &after)
+{
+  std::string text;
+
+  after.forEachLine(hunk.newStart, hunk.newStart + hunk.newCount, [&](size_t i, std::string_view line)
+                    {
+                      if (i > hunk.newStart)
+                        text += '\n';
+                      text += line;
+                      return true; });
+
+  size_t first = hunk.oldStart, end = hunk.oldStart + hunk.oldCount, size = e.buffer.size();
+
+  if (end < size)
+  {
+    if (hunk.oldCount > 0)
+      editErase(e, {first, 0}, {end, 0});
+    if (hunk.newCount > 0)
+      editInsert(e, {first, 0}, text + '\n');
+  }
+  else if (first > 0)
+  {
+    TextPos before = {first - 1, e.buffer.lineSize(first - 1)};
+
+    if (hunk.oldCount > 0)
+      editErase(e, before, {size - 1, e.buffer.lineSize(size - 1)});
+    if (hunk.newCount > 0)
+      editInsert(e, before, '\n' + text);
+  }
+  else
+  {
+    editErase(e, {0, 0}, {size - 1, e.buffer.lineSize(size - 1)});
+    editInsert(e, {0, 0}, text);
+  }
+}
+
+// Where a line ends up once a hunk above or around it is applied. Lines
+// inside the hunk keep their offset into it, as far as the new one goes.
+static int lineAfterHunk(int line, const LineHunk &hunk)
+{
+  if (line >= (int)(hunk.oldStart + hunk.oldCount))
+    return line + (int)hunk.newCount - (int)hunk.oldCount;
+
+  if (line >= (int)hunk.oldStart)
+    return hunk.oldStart + std::min<size_t>(line - hunk.oldStart, std::max<size_t>(hunk.newCount, 1) - 1);
+
+  return line;
+}
+
+// Brings the buffer in line with the file on disk by changing only the
+// lines that differ, as one undo step. A mapped file rewritten in place
+// already shows the new text, so that is taken whole.
+static void reloadFromDisk(Editor &e)
+{
+  auto start = std::chrono::steady_clock::now();
+  TextBuffer after;
+  DiskState now = diskState(e.fileName);
+  bool rewritten = e.buffer.isMapped() && now.isSameFile(e.disk) && now != e.disk;
+
+  e.disk = now;
+
+  if (!after.load(e.fileName))
+  {
+    e.message = "RELOAD FAILED - CANNOT READ FILE";
+    return;
+  }
+
+  after.finishLoading();
+
+  if (after.size() == 0)
+    after.insertLine(0, "");
+
+  std::vector<LineHunk> hunks;
+  size_t changed = 0;
+
+  if (rewritten)
+  {
+    changed = after.size();
+  }
+  else
+  {
+    e.buffer.finishLoading();
+    hunks = diffLines(e.buffer, after);
+  }
+
+  e.undo.seal();
+  e.undo.beginGroup();
+
+  // Bottom up, so that the hunks still to come keep their line numbers.
+  for (auto hunk = hunks.rbegin(); hunk != hunks.rend(); ++hunk)
+  {
+    applyHunk(e, *hunk, after);
+
+    e.y = lineAfterHunk(e.y, *hunk);
+    e.rowOffset = lineAfterHunk(e.rowOffset, *hunk);
+    changed += std::max(hunk->oldCount, hunk->newCount);
+  }
+
+  e.undo.endGroup();
+
+  // Edited lines then become views into the new file, or should two lines
+  // have collided in the diff, the new text is taken whole.
+  if (rewritten || !e.buffer.adopt(std::move(after)))
+  {
+    size_t memoryBudget = e.buffer.memoryBudget();
+
+    e.buffer = std::move(after);
+    e.buffer.setMemoryBudget(memoryBudget);
+    e.columns.clear();
+    e.undo.clear();
+    e.highlighter.forget();
+  }
+
+  e.unSavedChanges = false;
+  e.changedOnDisk = false;
+
+  // The text is the file's again, so the journal starts over from it.
+  if (!e.crashJournal.isPaused())
+  {
+    e.crashJournal.saving();
+    e.crashJournal.saved(e.disk);
+  }
+
+  e.y = std::min(e.y, (int)e.buffer.size() - 1);
+  e.x = std::min(e.x, (int)e.buffer.lineSize(e.y));
+  rememberColumn(e);
+  e.rowOffset = std::min(e.rowOffset, e.y);
+  scrollToCursor(e);
+
+  double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  e.message = "RELOADED - " + std::to_string(changed) + (changed == 1 ? " LINE" : " LINES") + " CHANGED (" + std::to_string((int)milliseconds) + " ms)";
+}
+
+static bool isInBuffer(const TextBuffer &buffer, TextPos at)
+{
+  return at.line < buffer.size() && at.column <= buffer.lineSize(at.line);
+}
+
+// Replays the crash journal's edits as one undo step, into a new journal
+// that replaces the old one once synced.
+static void recoverFromJournal(Editor &e)
+{
+  std::vector<JournalEdit> edits;
+  std::string error;
+
+  if (!e.crashJournal.isPaused())
+  {
+    e.message = "NOTHING TO RECOVER";
+    return;
+  }
+
+  if (e.unSavedChanges)
+  {
+    e.message = "CANNOT RECOVER ONTO EDITED TEXT - :reload FIRST";
+    return;
+  }
+
+  if (!readJournal(e.fileName, e.disk, edits, error))
+  {
+    e.message = "CANNOT RECOVER - " + error;
+    return;
+  }
+
+  e.buffer.finishLoading();
+  e.crashJournal.attach(e.fileName, e.disk);
+
+  TextPos cursor = {(size_t)e.y, (size_t)e.x};
+  size_t applied = 0;
+  bool damaged = false;
+
+  e.undo.seal();
+  e.undo.beginGroup();
+
+  for (const JournalEdit &edit : edits)
+  {
+    if (edit.kind == JournalEdit::CHECKPOINT)
+    {
+      damaged = edit.lines != 0 && edit.lines != e.buffer.size();
+      cursor = edit.from;
+    }
+    else if (!isInBuffer(e.buffer, edit.from))
+    {
+      damaged = true;
+    }
+    else if (edit.kind == JournalEdit::INSERT)
+    {
+      cursor = editInsert(e, edit.from, edit.text);
+      applied++;
+    }
+    else if (isInBuffer(e.buffer, edit.to) && (edit.to.line > edit.from.line || edit.to.column >= edit.from.column))
+    {
+      editErase(e, edit.from, edit.to);
+      cursor = edit.from;
+      applied++;
+    }
+    else
+    {
+      damaged = true;
+    }
+
+    if (damaged)
+      break;
+  }
+
+  e.undo.endGroup();
+
+  if (applied == 0 && !damaged)
+    e.crashJournal.discard();
+
+  e.y = std::min(cursor.line, e.buffer.size() - 1);
+  e.x = std::min(cursor.column, e.buffer.lineSize(e.y));
+  rememberColumn(e);
+  scrollToCursor(e);
+
+  e.message = "RECOVERED " + std::to_string(applied) + (applied == 1 ? " EDIT" : " EDITS");
+
+  if (damaged)
+    e.message += " - THE REST OF THE JOURNAL IS DAMAGED";
+}
+
+void flushJournal(Editor &e)
+{
+  size_t lines = e.buffer.isLoading() ? 0 : e.buffer.size();
+
+  if (!e.crashJournal.flush(lines, {(size_t)e.y, (size_t)e.x}))
+    e.message = "CANNOT WRITE CRASH JOURNAL - EDITS ARE NOT PROTECTED";
+}
+
+void discardJournals(Editor &e)
+{
+  if (!e.crashJournal.isPaused())
+    e.crashJournal.discard();
+
+  for (StashedFile &file : e.stash)
+    if (!file.crashJournal.isPaused())
+      file.crashJournal.discard();
+}
+
+bool checkDisk(Editor &e)
+{
+  if (e.watch.changed())
+    e.diskCheckPending = true;
+
+  // A save of our own looks like someone else's until it is reported.
+  if (!e.diskCheckPending || e.pendingSave.valid())
+    return false;
+
+  e.diskCheckPending = false;
+
+  DiskState now = diskState(e.fileName);
+
+  if (now == e.disk)
+    return false;
+
+  if (!now.exists)
+  {
+    e.disk = now;
+    e.message = "FILE REMOVED ON DISK";
+  }
+  else if (e.unSavedChanges)
+  {
+    // Unedited lines of a mapped file rewritten in place already show the
+    // new text; copied now, they at least stop changing under the buffer.
+    if (now.isSameFile(e.disk))
+      e.buffer.copyFile();
+
+    e.disk = now;
+    e.changedOnDisk = true;
+    e.message = "FILE CHANGED ON DISK - :reload TO LOAD IT, :s! TO OVERWRITE";
+  }
+  else
+  {
+    reloadFromDisk(e);
+  }
+
+  return true;
+}
+
+bool pasteText(Editor &e, const std::string &text)
+{
+  if (e.macro.isRecording())
+    e.macro.recordPaste(text);
+
+  if (e.isChord)
+  {
+    e.chord += text.substr(0, text.find('\n'));
+  }
+  else if (e.inCmdMode)
+  {
+    e.message = "PASTE IGNORED - PRESS i TO INSERT";
+  }
+  else
+  {
+    insertText(e, text);
+    scrollToColumn(e);
+  }
+
+  return true;
+}
+
+// Plays one operation of a macro; typing outside insert mode goes through
+// processKey() a key at a time.
+static void playOp(Editor &e, const Macro::Op &op)
+{
+  std::string_view text = e.macro.text(op);
+
+  switch (op.kind)
+  {
+  case Macro::Op::TYPE:
+    if (e.inCmdMode || e.isChord)
+    {
+      for (char c : text)
+        processKey(e, (unsigned char)c);
+      break;
+    }
+
+    editInsert(e, {(size_t)e.y, (size_t)e.x}, text, true);
+    e.x += text.size();
+    rememberColumn(e);
+    break;
+
+  case Macro::Op::PASTE:
+    pasteText(e, std::string(text));
+    break;
+
+  case Macro::Op::KEY:
+    processKey(e, op.key);
+    break;
+  }
+}
+
+// Plays the macro back `times` times, undone as one step unless it undoes
+// itself, and drawn once by the caller afterwards.
+static void replayMacro(Editor &e, size_t times)
+{
+  if (e.isReplaying)
+    return;
+
+  if (e.macro.isRecording())
+  {
+    e.message = "CANNOT REPLAY WHILE RECORDING";
+    return;
+  }
+
+  if (e.macro.empty())
+  {
+    e.message = "NO MACRO - PRESS q TO RECORD ONE";
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  bool grouped = !e.macro.undoes();
+  size_t done = 0;
+
+  e.isReplaying = true;
+  e.undo.seal();
+
+  if (grouped)
+    e.undo.beginGroup();
+
+  while (done < times && !e.shouldQuit)
+  {
+    for (const Macro::Op &op : e.macro.ops())
+      playOp(e, op);
+
+    done++;
+  }
+
+  if (grouped)
+    e.undo.endGroup();
+
+  e.isReplaying = false;
+  scrollToCursor(e);
+
+  double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  e.message = "REPLAYED " + (done < times ? std::to_string(done) + " OF " : "") + std::to_string(times) + (times == 1 ? " TIME" : " TIMES");
+
+  e.message += " (" + std::to_string((int)milliseconds) + " ms)";
+}
+
+// Applies one key press to the editor. Returns whether the screen needs a
+// full refresh afterwards, as opposed to just moving the cursor.
+bool processKey(Editor &e, int ch)
+{
+  bool shouldRefresh = true;
+
+  // The q that ends a recording is left out of it.
+  if (e.macro.isRecording() && (e.isChord || !e.inCmdMode || ch != 'q'))
+    e.macro.recordKey(ch, e.isChord ? Macro::CHORD : e.inCmdMode ? Macro::COMMAND : Macro::INSERT);
+
+  if (e.isChord)
+  {
+    if (ch == KEY_ENTER || ch == '\n')
+    {
+      e.chord = e.chord.substr(1, e.chord.size() - 1);
+
+      if (e.chord == "q")
+      {
+        if (hasUnsavedChanges(e))
+        {
+          e.message = "UNSAVED CHANGES - :q! TO QUIT";
+        }
+        else
+        {
+          e.shouldQuit = true;
+        }
+      }
+      else if (e.chord == "q!")
+      {
+        e.shouldQuit = true;
+      }
+      else if (e.chord == "sq" || e.chord == "wq")
+      {
+        saveToFile(e, true);
+        e.shouldQuit = !hasUnsavedChanges(e);
+
+        if (!e.shouldQuit && !e.unSavedChanges)
+          e.message = "UNSAVED CHANGES IN OTHER FILES - :q! TO QUIT";
+      }
+      else if (e.chord == "s" || e.chord == "w")
+      {
+        saveToFile(e);
+        e.isChord = false;
+      }
+      else if (e.chord == "s!" || e.chord == "w!")
+      {
+        saveToFile(e, false, true);
+      }
+      else if (e.chord == "recover")
+      {
+        recoverFromJournal(e);
+      }
+      else if (e.chord == "discard")
+      {
+        if (e.crashJournal.isPaused())
+        {
+          e.crashJournal.discard();
+          e.message = "CRASH JOURNAL DELETED";
+        }
+        else
+        {
+          e.message = "NOTHING TO DISCARD";
+        }
+      }
+      else if (e.chord == "reload")
+      {
+        // Local edits are dropped, but stay one undo away.
+        waitForSave(e);
+        reloadFromDisk(e);
+      }
+      else if (e.chord.substr(0, 8) == "undocap ")
+      {
+        std::string megabytes = e.chord.substr(8);
+
+        if (megabytes.size() != 0 && megabytes.size() <= 9 && megabytes.find_first_not_of("0123456789") == std::string::npos)
+        {
+          e.undo.setCap(std::stoull(megabytes) << 20);
+          e.message = "UNDO CAP " + megabytes + " MB";
+        }
+        else
+        {
+          e.message = "USAGE - :undocap <MB>";
+        }
+      }
+      else if (e.chord.substr(0, 10) == "membudget ")
+      {
+        std::string megabytes = e.chord.substr(10);
+
+        if (megabytes.size() != 0 && megabytes.size() <= 9 && megabytes.find_first_not_of("0123456789") == std::string::npos)
+        {
+          e.buffer.setMemoryBudget(std::stoull(megabytes) << 20);
+          e.message = megabytes == "0" ? "NO MEMORY BUDGET" : "MEMORY BUDGET " + megabytes + " MB";
+        }
+        else
+        {
+          e.message = "USAGE - :membudget <MB>";
+        }
+      }
+      else if (e.chord == "stats")
+      {
+        e.showStats = !e.showStats;
+      }
+      else if (e.chord == "fsync")
+      {
+        e.syncOnSave = !e.syncOnSave;
+        e.message = e.syncOnSave ? "FSYNC ON SAVE" : "NO FSYNC ON SAVE";
+      }
+      else if (e.chord == "i")
+      {
+        e.inCmdMode = false;
+        e.message = "INSERT - PRESS ESC TO EXIT";
+      }
+      else if (e.chord == "@" || e.chord.substr(0, 2) == "@ ")
+      {
+        std::string count = e.chord.size() > 2 ? e.chord.substr(2) : "1";
+
+        if (count.size() != 0 && count.size() <= 9 && count.find_first_not_of("0123456789") == std::string::npos)
+        {
+          // The keys played back are not part of this command.
+          e.chord = "";
+          e.isChord = false;
+          replayMacro(e, std::stoull(count));
+        }
+        else
+        {
+          e.message = "USAGE - :@ <COUNT>";
+        }
+      }
+      else if (e.chord.substr(0, 2) == "i " || e.chord.substr(0, 2) == "a ")
+      {
+        if (e.selection == Editor::SELECT_NONE)
+          e.message = "NO SELECTION - PRESS v OR b";
+        else if (e.chord.size() == 2)
+          e.message = "USAGE - :i <TEXT> OR :a <TEXT>";
+        else
+          insertIntoSelection(e, e.chord.substr(2), e.chord[0] == 'a');
+      }
+      else if (e.chord.substr(0, 2) == "l " || e.chord.substr(0, 2) == "l")
+      {
+        std::string lineNumberString = e.chord.length() > 2 ? e.chord.substr(2) : "1";
+
+        e.buffer.finishLoading();
+
+        if (lineNumberString == "e")
+          lineNumberString = std::to_string(e.buffer.size());
+        else if (lineNumberString.size() == 0 || lineNumberString.find_first_not_of(" 0123456789") != std::string::npos || lineNumberString == "0")
+          lineNumberString = "1";
+
+        int lineNumber = std::min(std::stoi(lineNumberString), (int)e.buffer.size());
+
+        if (lineNumber > 0)
+        {
+          e.y = lineNumber - 1;
+          e.x = 0;
+          rememberColumn(e);
+
+          if (e.y < e.rowOffset || e.y >= e.rowOffset + e.screenRows)
+            e.rowOffset = std::max(0, e.y - e.screenRows / 2);
+        }
+      }
+      else if (e.chord.substr(0, 2) == "f ")
+      {
+        std::string targetString = e.chord.substr(2, e.chord.size() - 2);
+
+        if (targetString.size() != 0)
+        {
+          e.search.setPattern(targetString);
+          jumpToMatch(e, {(size_t)e.y, (size_t)e.x}, false);
+        }
+      }
+      else if (e.chord.substr(0, 2) == "f/" || e.chord.substr(0, 2) == "r/")
+      {
+        std::vector<std::string> parts = splitOnSlashes(e.chord.substr(2));
+        bool isReplace = e.chord[0] == 'r';
+        std::string error;
+
+        if (parts[0].empty() || (isReplace && parts.size() < 2))
+          e.message = isReplace ? "USAGE - :r/PATTERN/REPLACEMENT/" : "USAGE - :f/PATTERN/";
+        else if (!e.search.setRegex(parts[0], error))
+          e.message = "BAD PATTERN - " + error;
+        else if (isReplace)
+          replaceAll(e, parts[1]);
+        else
+          jumpToMatch(e, {(size_t)e.y, (size_t)e.x}, false);
+      }
+      else if (e.chord.substr(0, 4) == "swp ")
+      {
+        if (e.unSavedChanges)
+          saveToFile(e);
+
+        std::string newFileName = e.chord.substr(4, e.chord.size() - 4);
+
+        if (newFileName.size() != 0)
+        {
+          newFileName = newFileName.substr(0, newFileName.find_first_of(" "));
+
+          if (!switchToFile(e, newFileName, false))
+            e.message = "FILE NOT FOUND - USE :cswp TO CREATE NEW FILE";
+        }
+      }
+      else if (e.chord.substr(0, 2) == "c ")
+      {
+        std::string newFileName = e.chord.substr(2, e.chord.size() - 2);
+
+        if (newFileName.size() != 0)
+        {
+          copyMappedFile(e, newFileName);
+          std::ofstream file(newFileName);
+          file.close();
+        }
+        else
+        {
+          e.message = "NO FILE NAME";
+        }
+      }
+      else if (e.chord.substr(0, 5) == "cswp ")
+      {
+        std::string newFileName = e.chord.substr(5, e.chord.size() - 5);
+
+        if (newFileName.size() != 0)
+        {
+          newFileName = newFileName.substr(0, newFileName.find_first_of(" "));
+
+          copyMappedFile(e, newFileName);
+          std::ofstream ofile(newFileName);
+          ofile.close();
+
+          // The file now starts out empty, whatever was kept of it before.
+          e.stash.remove_if([&](const StashedFile &file)
+                            { return file.fileName == newFileName; });
+
+          if (newFileName != e.fileName)
+          {
+            switchToFile(e, newFileName, true);
+          }
+          else
+          {
+            if (!loadFromFile(e, e.fileName))
+            {
+              e.buffer.clear();
+              e.buffer.insertLine(0, "");
+              e.undo.clear();
+              attachJournal(e, e.fileName);
+            }
+
+            e.y = 0;
+            e.x = 0;
+            rememberColumn(e);
+            e.rowOffset = 0;
+            e.colOffset = 0;
+            e.watch.watch(e.fileName);
+          }
+        }
+        else
+        {
+          e.message = "NO FILE NAME";
+        }
+      }
+      else if (e.chord.substr(0, 7) == "bufcap ")
+      {
+        std::string megabytes = e.chord.substr(7);
+
+        if (megabytes.size() != 0 && megabytes.size() <= 9 && megabytes.find_first_not_of("0123456789") == std::string::npos)
+        {
+          e.stashCap = std::stoull(megabytes) << 20;
+          trimStash(e);
+          e.message = "BUFFER CAP " + megabytes + " MB";
+        }
+        else
+        {
+          e.message = "USAGE - :bufcap <MB>";
+        }
+      }
+      else
+      {
+        e.message = "UNKNOWN COMMAND";
+      }
+
+      e.chord = "";
+      e.isChord = false;
+    }
+    else if (ch == KEY_BACKSPACE || ch == 127)
+    {
+      if (e.chord.size() > 1)
+      {
+        size_t end = e.chord.size() - 1;
+        while (end > 1 && ((unsigned char)e.chord[end] & 0xC0) == 0x80)
+          end--;
+        e.chord.erase(end);
+      }
+      else
+      {
+        e.chord = "";
+        e.isChord = false;
+      }
+    }
+    else if (ch != ERR && (isprint(ch) || (ch >= 0x80 && ch < 0x100)))
+    {
+      e.chord += ch;
+    }
+
+    return true;
+  }
+
+  switch (ch)
+  {
+  case KEY_UP:
+    shouldRefresh = false;
+    if (e.y > 0)
+    {
+      e.y--;
+      if (e.y < e.rowOffset)
+      {
+        e.rowOffset--;
+        shouldRefresh = true;
+      }
+
+      e.x = snappedX(e);
+    }
+    else if (e.x > 0)
+    {
+      e.x = 0;
+    }
+    else
+      rememberColumn(e);
+    break;
+
+  case KEY_DOWN:
+    shouldRefresh = false;
+    if (e.y >= 0 && (size_t)e.y + 1 < e.buffer.size())
+    {
+      e.maxY = e.screenRows + e.rowOffset - 1;
+
+      e.y++;
+      if (e.y >= e.maxY)
+      {
+        e.rowOffset++;
+        shouldRefresh = true;
+      }
+
+      e.x = snappedX(e);
+    }
+    else if (e.x >= 0 && (size_t)e.x < e.buffer.lineSize(e.y))
+    {
+      e.x = e.buffer.lineSize(e.y);
+    }
+    else
+      rememberColumn(e);
+    break;
+
+  case KEY_LEFT:
+    shouldRefresh = false;
+    if (e.x > 0)
+    {
+      e.x = e.columns.previousChar(e.buffer, e.y, e.x);
+    }
+    else if (e.y > 0)
+    {
+      e.y--;
+      if (e.y < e.rowOffset)
+      {
+        e.rowOffset--;
+        shouldRefresh = true;
+      }
+      e.x = e.buffer.lineSize(e.y);
+    }
+    rememberColumn(e);
+    break;
+
+  case KEY_RIGHT:
+    shouldRefresh = false;
+    if (e.x >= 0 && (size_t)e.x < e.buffer.lineSize(e.y))
+    {
+      e.x = e.columns.nextChar(e.buffer, e.y, e.x);
+      e.maxX = e.screenCols;
+    }
+    else if (e.y >= 0 && (size_t)e.y + 1 < e.buffer.size())
+    {
+      e.maxY = e.screenRows + e.rowOffset - 1;
+
+      e.y++;
+      if (e.y >= e.maxY)
+      {
+        e.rowOffset++;
+        shouldRefresh = true;
+      }
+
+      e.x = 0;
+    }
+    rememberColumn(e);
+    break;
+
+  case 127:
+  case '\b':
+  case KEY_BACKSPACE:
+    if (e.inCmdMode)
+      break;
+
+    if (e.x > 0)
+    {
+      int before = e.columns.previousChar(e.buffer, e.y, e.x);
+      editErase(e, {(size_t)e.y, (size_t)before}, {(size_t)e.y, (size_t)e.x}, true);
+      e.x = before;
+    }
+    else if (e.y > 0)
+    {
+      e.x = e.buffer.lineSize(e.y - 1);
+      editErase(e, {(size_t)e.y - 1, (size_t)e.x}, {(size_t)e.y, 0});
+      e.y--;
+
+      if (e.y < e.rowOffset)
+        e.rowOffset--;
+    }
+
+    rememberColumn(e);
+
+    break;
+
+  case '\n':
+  case KEY_ENTER:
+    if (e.inCmdMode)
+      break;
+
+    editInsert(e, {(size_t)e.y, (size_t)e.x}, "\n");
+
+    e.y++;
+    if (e.y >= e.screenRows + e.rowOffset - 1)
+      e.rowOffset++;
+
+    e.x = 0;
+    rememberColumn(e);
+    break;
+
+  case '\t':
+    if (e.inCmdMode)
+      break;
+
+    editInsert(e, {(size_t)e.y, (size_t)e.x}, INDENT, true);
+    e.x += sizeof(INDENT) - 1;
+    rememberColumn(e);
+    break;
+
+  case 27:
+    // A second Esc in command mode hides the search highlights and stats.
+    if (e.inCmdMode)
+    {
+      e.showMatches = false;
+      e.showStats = false;
+    }
+
+    e.inCmdMode = true;
+    e.selection = Editor::SELECT_NONE;
+    e.message = "";
+    e.undo.seal();
+    break;
+
+  default:
+    if (e.inCmdMode)
+    {
+      switch (ch)
+      {
+      case ':':
+      case ';':
+        e.isChord = true;
+        e.chord = ch;
+        break;
+
+      case 'i':
+        e.inCmdMode = false;
+        e.message = "INSERT - PRESS ESC TO EXIT";
+        break;
+
+      case 'u':
+        undoOrRedo(e, false);
+        break;
+
+      case 'r':
+        undoOrRedo(e, true);
+        break;
+
+      case 'n':
+      case 'N':
+        if (e.search.active())
+          jumpToMatch(e, {(size_t)e.y, (size_t)e.x + (ch == 'n')}, ch == 'N');
+        else
+          e.message = "NO SEARCH - USE :f";
+        break;
+
+      case '%':
+        jumpToBracket(e);
+        break;
+
+      case 'v':
+        toggleSelection(e, Editor::SELECT_LINES);
+        break;
+
+      case 'q':
+        if (e.macro.isRecording())
+        {
+          e.macro.stop();
+          e.message = "RECORDED " + std::to_string(e.macro.keys()) + " KEYS - @ OR :@ <COUNT> TO REPLAY";
+        }
+        else
+        {
+          e.macro.start();
+          e.message = "RECORDING - q TO STOP";
+        }
+        break;
+
+      case '@':
+        replayMacro(e, 1);
+        break;
+
+      case 'b':
+        toggleSelection(e, Editor::SELECT_BLOCK);
+        break;
+
+      case '>':
+      case '<':
+        if (e.selection != Editor::SELECT_NONE)
+          indentSelection(e, ch == '<');
+        else
+          e.message = "NO SELECTION - PRESS v OR b";
+        break;
+
+      case 'x':
+        if (e.selection != Editor::SELECT_NONE)
+          eraseSelection(e);
+        else
+          e.message = "NO SELECTION - PRESS v OR b";
+        break;
+
+      case 'w':
+        shouldRefresh = false;
+        if (e.y > 0)
+        {
+          e.y--;
+          if (e.y < e.rowOffset)
+          {
+            e.rowOffset--;
+            shouldRefresh = true;
+          }
+
+          e.x = snappedX(e);
+        }
+        else if (e.x > 0)
+        {
+          e.x = 0;
+        }
+        else
+          rememberColumn(e);
+        break;
+
+      case 's':
+        shouldRefresh = false;
+        if (e.y >= 0 && (size_t)e.y + 1 < e.buffer.size())
+        {
+          e.maxY = e.screenRows + e.rowOffset - 1;
+
+          e.y++;
+          if (e.y >= e.maxY)
+          {
+            e.rowOffset++;
+            shouldRefresh = true;
+          }
+
+          e.x = snappedX(e);
+        }
+        else if (e.x >= 0 && (size_t)e.x < e.buffer.lineSize(e.y))
+        {
+          e.x = e.buffer.lineSize(e.y);
+        }
+        else
+          rememberColumn(e);
+        break;
+
+      case 'a':
+        e.x = 0;
+        rememberColumn(e);
+        break;
+
+      case 'd':
+        e.x = e.buffer.lineSize(e.y);
+        rememberColumn(e);
+        break;
+      }
+
+      break;
+    }
+
+    if (ch != ERR && isprint(ch))
+    {
+      editInsert(e, {(size_t)e.y, (size_t)e.x}, std::string(1, (char)ch), true);
+      e.x++;
+      rememberColumn(e);
+    }
+    else if (ch >= 0x80 && ch < 0x100)
+    {
+      typeByte(e, ch);
+    }
+    break;
+  }
+
+  if (scrollToColumn(e))
+    shouldRefresh = true;
+
+  // Moving the cursor reshapes the selection.
+  if (e.selection != Editor::SELECT_NONE)
+    shouldRefresh = true;
+
+  return shouldRefresh;
+}
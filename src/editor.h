@@ -0,0 +1,151 @@
+#pragma once
+
+#include <future>
+#include <list>
+#include <string>
+
+#include "buffer.h"
+#include "highlighter.h"
+#include "journal.h"
+#include "language.h"
+#include "macro.h"
+#include "render.h"
+#include "save.h"
+#include "search.h"
+#include "undo.h"
+#include "utf8.h"
+#include "watch.h"
+#include "workers.h"
+
+// A file switched away from with :swp, kept as it was left, highlight
+// cache included, so that switching back costs nothing.
+struct StashedFile
+{
+  std::string fileName;
+  TextBuffer buffer;
+  UndoJournal undo;
+  CrashJournal crashJournal;
+  int x = 0, y = 0, snapX = 0, rowOffset = 0, colOffset = 0;
+  const Language *language = nullptr;
+  bool unSavedChanges = false;
+  DiskState disk;
+  bool changedOnDisk = false;
+  size_t memory = 0;
+};
+
+// The editor without a terminal, drawing into an off-screen frame; main.cpp
+// and the benchmarks drive it.
+struct Editor
+{
+  static const size_t DEFAULT_STASH_CAP = (size_t)1 << 30;
+
+  TextBuffer buffer;
+
+  // x is a byte offset into line y; colOffset and snapX are screen columns.
+  int x = 0, y = 0, maxY = 0, maxX = 0, rowOffset = 0, colOffset = 0;
+
+  int snapX = 0;
+  ColumnCache columns;
+
+  // The bytes of a UTF-8 character typed so far, which arrive as separate
+  // keys.
+  std::string typedChar;
+
+  // Size of the screen, status row included, set by the front end.
+  int screenRows = 0, screenCols = 0;
+
+  bool isChord = false;
+  std::string chord = "";
+
+  std::string message = "";
+
+  bool inCmdMode = true;
+
+  std::string fileName = "";
+
+  // How the file is highlighted, or nullptr if it isn't.
+  const Language *language = nullptr;
+
+  bool unSavedChanges = false;
+
+  // The file as it was on disk when last loaded or saved. Changes by other
+  // programs to a file with local edits set changedOnDisk instead.
+  FileWatch watch;
+  DiskState disk;
+  bool diskCheckPending = false;
+  bool changedOnDisk = false;
+
+  UndoJournal undo;
+  CrashJournal crashJournal;
+
+  bool syncOnSave = false;
+  std::future<SaveResult> pendingSave;
+  std::string pendingSaveName;
+
+  // Files switched away from, most recently used first. Once they hold
+  // more than stashCap bytes, the least recently used saved ones go.
+  std::list<StashedFile> stash;
+  size_t stashCap = DEFAULT_STASH_CAP;
+
+  Search search;
+  bool showMatches = false;
+
+  // A selection runs from the anchor to the cursor, as whole lines or as a
+  // block of screen columns.
+  enum Selection
+  {
+    SELECT_NONE,
+    SELECT_LINES,
+    SELECT_BLOCK,
+  };
+
+  Selection selection = SELECT_NONE;
+  int anchorY = 0, anchorColumn = 0;
+
+  // Keys recorded with q, for playing back with @ or :@ <count>. Playback
+  // hands them to processKey() without drawing in between.
+  Macro macro;
+  bool isReplaying = false;
+
+  bool showStats = false;
+
+  WorkerPool workers;
+
+  // Lexes in the background once the front end starts it; until then the
+  // screen is highlighted as it is drawn.
+  Highlighter highlighter;
+
+  Renderer renderer;
+
+  bool shouldQuit = false;
+};
+
+// Sets the file to edit and starts loading it. A file that cannot be read
+// leaves an empty buffer to be saved under that name.
+void openFile(Editor &e, const std::string &fileName);
+
+bool waitForSave(Editor &e);
+bool pollSave(Editor &e);
+
+// Looks into changes to the file by other programs, once e.watch reports
+// any. Returns whether the screen needs a redraw.
+bool checkDisk(Editor &e);
+
+// Writes the crash journal's records of the keys handled so far. Called
+// once per batch of keys.
+void flushJournal(Editor &e);
+
+// Deletes the crash journals of all files, for a deliberate exit. Journals
+// still waiting for :recover are kept.
+void discardJournals(Editor &e);
+
+// Applies one key press to the editor. Returns whether the screen needs a
+// full redraw afterwards, as opposed to just moving the cursor.
+bool processKey(Editor &e, int ch);
+bool pasteText(Editor &e, const std::string &text);
+
+// Composes the whole screen into e.renderer.next and places the cursor.
+void drawEditor(Editor &e);
+
+// Places the cursor only, for keys that leave the text on screen as it is.
+void placeCursor(Editor &e);
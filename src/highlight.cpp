@@ -0,0 +1,401 @@
+#include "highlight.h"
+
+#include <string_view>
+
+int BRACKET_HIGHLIGHTS[] = {
+    BRACKET_LEVEL_1,
+    BRACKET_LEVEL_2,
+    BRACKET_LEVEL_3};
+
+static uint32_t packState(const LexState &state)
+{
+  return state.machine;
+}
+
+static LexState unpackState(uint32_t value)
+{
+  LexState state;
+  state.machine = value < Language::TENTATIVE ? value : Language::START;
+  return state;
+}
+
+void lexLine(const Language &language, std::string_view line, int lineNumber, LexState &state, std::vector<HighlightData> &highlights, std::vector<int> *brackets, int column)
+{
+  const char *text = line.data();
+  int size = line.size();
+
+  const Language::Transition *table = language.table.data();
+  const uint8_t *kinds = language.kinds.data();
+
+  // On directive lines the text between tokens keeps the directive colour.
+  bool isDirective = false;
+  int plainStart = 0;
+
+  auto emit = [&](int start, int end, Highlights color)
+  {
+    if (isDirective && start > plainStart)
+      highlights.push_back({lineNumber, column + plainStart, start - plainStart, DIRECTIVE});
+
+    if (end > start)
+      highlights.push_back({lineNumber, column + start, end - start, color});
+
+    plainStart = end;
+  };
+
+  auto finish = [&](int start, int end, uint8_t kind)
+  {
+    if (start >= end)
+      return;
+
+    switch (kind)
+    {
+    case Language::IDENTIFIER:
+      if (language.isKeyword(text + start, end - start) || (language.definition->colonKeys && end < size && text[end] == ':' && (end + 1 == size || text[end + 1] == ' ')))
+        emit(start, end, KEYWORD);
+      break;
+
+    case Language::NUMBER:
+      emit(start, end, NUMBER);
+      break;
+
+    case Language::STRING:
+      emit(start, end, STRING);
+      break;
+
+    case Language::COMMENT:
+      emit(start, end, COMMENT);
+      break;
+
+    case Language::KEYWORD:
+      emit(start, end, KEYWORD);
+      break;
+
+    case Language::DIRECTIVE:
+      isDirective = true;
+      plainStart = start;
+      emit(start, end, DIRECTIVE);
+      break;
+
+    case Language::BRACKET:
+      if (text[start] == '(' || text[start] == '[' || text[start] == '{')
+      {
+        state.bracketLevel++;
+        emit(start, end, (Highlights)BRACKET_HIGHLIGHTS[(state.bracketLevel % 3 + 3) % 3]);
+      }
+      else
+      {
+        emit(start, end, (Highlights)BRACKET_HIGHLIGHTS[(state.bracketLevel % 3 + 3) % 3]);
+        state.bracketLevel--;
+        state.lowestBracketLevel = std::min(state.lowestBracketLevel, state.bracketLevel);
+      }
+
+      if (brackets)
+        brackets->push_back(column + start);
+      break;
+    }
+  };
+
+  uint8_t current = state.machine < language.stateCount() ? state.machine : Language::START;
+
+  if (column > 0 && current == Language::START)
+    current = Language::NORMAL;
+
+  int tokenStart = 0;
+  uint8_t tokenKind = kinds[current];
+
+  // A tentative token still going at the end is lexed again from its start.
+  for (int i = 0;; i = tokenStart)
+  {
+    // Most bytes leave the state as it is, and those do not wait for the
+    // previous lookup to know which row to look in.
+    const Language::Transition *row = table + current * 256;
+
+    for (; i < size; i++)
+    {
+      Language::Transition transition = row[(unsigned char)text[i]];
+
+      if (transition.next == current && transition.action == Language::CONTINUE)
+        continue;
+
+      current = transition.next;
+      row = table + current * 256;
+
+      if (transition.action == Language::REWIND)
+      {
+        i = tokenStart - 1;
+        tokenKind = kinds[current];
+        continue;
+      }
+
+      if (transition.action == Language::CONTINUE)
+        continue;
+
+      int start = i + 2 - transition.action;
+      finish(tokenStart, start, tokenKind);
+      tokenStart = start;
+      tokenKind = kinds[current];
+    }
+
+    if (language.resume[current] != Language::TENTATIVE)
+      break;
+
+    current = language.afterRewind;
+    tokenKind = kinds[current];
+  }
+
+  finish(tokenStart, size, tokenKind);
+
+  if (isDirective)
+    emit(size, size, DIRECTIVE);
+
+  state.machine = language.resume[current];
+}
+
+static bool relex(const Language &language, TextBuffer &buffer, size_t i, size_t column, std::string_view text, TextBuffer::LineState &cached, LexState &state, std::vector<HighlightData> &out)
+{
+  uint32_t previous = cached.value;
+  int start = state.bracketLevel;
+
+  state.lowestBracketLevel = start;
+  lexLine(language, text, i, state, out, nullptr, column);
+
+  cached.value = packState(state);
+  cached.dirty = false;
+  cached.bracketSum = state.bracketLevel - start;
+  cached.bracketMin = state.lowestBracketLevel - start;
+
+  buffer.lexValid = std::max(buffer.lexValid, i + 1);
+  buffer.lexEnd = std::max(buffer.lexEnd, i + 1);
+
+  return cached.value == previous;
+}
+
+// Lexing starts from the first edited line and stops once a line ends in
+// its old state with no edited lines left. Chunks count as lines here.
+void lexUpTo(const Language &language, TextBuffer &buffer, size_t first)
+{
+  std::vector<HighlightData> discarded;
+
+  while (buffer.lexValid < first)
+  {
+    size_t from = buffer.lexValid;
+
+    LexState state;
+    if (from > 0)
+      state = unpackState(buffer.lineState(from - 1).value);
+
+    bool converged = false;
+
+    buffer.forEachLineState(from, first, [&](size_t i, size_t column, std::string_view text, TextBuffer::LineState &cached)
+                            {
+                              if (converged && !cached.dirty && (column > 0 || i < buffer.lexEnd))
+                              {
+                                state = unpackState(cached.value);
+                                buffer.lexValid = std::max(buffer.lexValid, i + 1);
+                              }
+                              else
+                              {
+                                discarded.clear();
+                                state.bracketLevel = 0;
+                                converged = relex(language, buffer, i, column, text, cached, state, discarded);
+                              }
+
+                              if (converged && buffer.lexDirty == 0 && buffer.lexValid < buffer.lexEnd)
+                              {
+                                buffer.lexValid = buffer.lexEnd;
+                                return false;
+                              }
+
+                              return true; });
+
+    // Stopping at `first` after a line whose end state changed leaves the
+    // line below lexed from a stale start state.
+    if (!converged && buffer.lexValid == first && first < buffer.lexEnd)
+      buffer.invalidateState(first);
+  }
+}
+
+// Lexes [first, last) into highlights from the cached state of the line
+// above. Of a long line, only chunks near the window are highlighted.
+void highlightLines(const Language &language, TextBuffer &buffer, size_t first, size_t last, std::vector<HighlightData> &highlights, size_t column, size_t width)
+{
+  if (first >= last)
+    return;
+
+  lexUpTo(language, buffer, first);
+
+  LexState state;
+  if (first > 0)
+    state = unpackState(buffer.lineState(first - 1).value);
+
+  state.bracketLevel = buffer.bracketDepth(first);
+
+  std::vector<HighlightData> discarded;
+  size_t columnEnd = width > SIZE_MAX - column ? SIZE_MAX : column + width;
+  bool unchanged = true;
+
+  buffer.forEachLineState(first, last, [&](size_t i, size_t start, std::string_view text, TextBuffer::LineState &cached)
+                          {
+                            bool visible = start < columnEnd && start + text.size() >= column;
+
+                            if (start > 0 && !visible && unchanged && !cached.dirty)
+                            {
+                              int level = state.bracketLevel + cached.bracketSum;
+                              state = unpackState(cached.value);
+                              state.bracketLevel = level;
+                              return true;
+                            }
+
+                            discarded.clear();
+                            unchanged = relex(language, buffer, i, start, text, cached, state, visible ? highlights : discarded);
+                            return true; });
+
+  // The line below the window was lexed from a start state that no longer
+  // holds, so it has to be re-lexed like an edited line.
+  if (!unchanged && last < buffer.lexEnd)
+    buffer.invalidateState(last);
+}
+
+long bracketDepth(const Language &language, TextBuffer &buffer, size_t line)
+{
+  lexUpTo(language, buffer, line);
+  return buffer.bracketDepth(line);
+}
+
+static bool isOpenBracket(char c)
+{
+  return c == '(' || c == '[' || c == '{';
+}
+
+struct Bracket
+{
+  size_t column;
+  bool open;
+};
+
+// The brackets on the line, lexed piece by piece from its cached start
+// state the same way the highlighter lexes it.
+static std::vector<Bracket> bracketsOn(const Language &language, TextBuffer &buffer, size_t line)
+{
+  lexUpTo(language, buffer, line + 1);
+
+  LexState state;
+  if (line > 0)
+    state = unpackState(buffer.lineState(line - 1).value);
+
+  std::vector<HighlightData> discarded;
+  std::vector<int> columns;
+  std::vector<Bracket> brackets;
+
+  buffer.forEachPiece(line, [&](size_t column, std::string_view text)
+                      {
+                        discarded.clear();
+                        columns.clear();
+                        lexLine(language, text, line, state, discarded, &columns, column);
+
+                        for (int at : columns)
+                          brackets.push_back({(size_t)at, isOpenBracket(text[at - column])}); });
+
+  return brackets;
+}
+
+// Brackets are matched by depth alone, so "(]" counts as a pair just like
+// the highlighting colours it as one.
+bool findMatchingBracket(const Language &language, TextBuffer &buffer, TextPos at, TextPos &match)
+{
+  if (at.line >= buffer.size())
+    return false;
+
+  std::vector<Bracket> brackets = bracketsOn(language, buffer, at.line);
+
+  size_t k = 0;
+  while (k < brackets.size() && brackets[k].column < at.column)
+    k++;
+
+  if (k == brackets.size())
+    return false;
+
+  // Depths just before each bracket, relative to the line start.
+  std::vector<long> before(brackets.size());
+
+  for (size_t j = 1; j < brackets.size(); j++)
+    before[j] = before[j - 1] + (brackets[j - 1].open ? 1 : -1);
+
+  long base = buffer.bracketDepth(at.line);
+
+  if (brackets[k].open)
+  {
+    long depth = base + before[k];
+
+    for (size_t j = k + 1; j < brackets.size(); j++)
+      if (!brackets[j].open && base + before[j] - 1 == depth)
+      {
+        match = {at.line, brackets[j].column};
+        return true;
+      }
+
+    // The match is on the first line below whose depth dips to `depth`.
+    // Lines are lexed in growing chunks until one is found or the file ends.
+    size_t searched = at.line + 1;
+    size_t found = SIZE_MAX;
+
+    for (size_t chunk = 4096; found == SIZE_MAX && searched < buffer.size(); chunk *= 2)
+    {
+      size_t last = std::min(buffer.size(), std::max(buffer.lexValid, searched + chunk));
+      lexUpTo(language, buffer, last);
+      found = buffer.firstLineReaching(searched, last, depth);
+      searched = last;
+    }
+
+    if (found == SIZE_MAX)
+      return false;
+
+    long level = buffer.bracketDepth(found);
+
+    for (const Bracket &bracket : bracketsOn(language, buffer, found))
+    {
+      level += bracket.open ? 1 : -1;
+
+      if (level == depth)
+      {
+        match = {found, bracket.column};
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  long depth = base + before[k] - 1;
+
+  for (size_t j = k; j-- > 0;)
+    if (brackets[j].open && base + before[j] == depth)
+    {
+      match = {at.line, brackets[j].column};
+      return true;
+    }
+
+  // The match is on the last line above that ends up deeper than `depth`
+  // after dipping to it, i.e. the last one reaching `depth` from its start.
+  size_t found = buffer.lastLineReaching(0, at.line, depth);
+
+  if (found == SIZE_MAX)
+    return false;
+
+  long level = buffer.bracketDepth(found);
+  size_t result = SIZE_MAX;
+
+  for (const Bracket &bracket : bracketsOn(language, buffer, found))
+  {
+    if (bracket.open && level == depth)
+      result = bracket.column;
+
+    level += bracket.open ? 1 : -1;
+  }
+
+  if (result == SIZE_MAX)
+    return false;
+
+  match = {found, result};
+  return true;
+}
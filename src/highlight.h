@@ -0,0 +1,73 @@
+#pragma once
+
+#include <ncurses.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "buffer.h"
+#include "edit.h"
+#include "language.h"
+
+enum Colors
+{
+  WHITE,
+  CYAN,
+  RED,
+  GREEN,
+  YELLOW,
+  BLUE,
+  MAGENTA,
+  CYAN_BACK,
+};
+
+enum Highlights
+{
+  LINE_NUMBER = COLOR_PAIR(CYAN) | A_BOLD,
+  MESSAGE = COLOR_PAIR(GREEN) | A_BOLD,
+  DIRECTIVE = COLOR_PAIR(RED),
+  STRING = COLOR_PAIR(GREEN),
+  KEYWORD = COLOR_PAIR(YELLOW),
+  NUMBER = COLOR_PAIR(MAGENTA),
+  COMMENT = COLOR_PAIR(CYAN),
+  BRACKET_LEVEL_1 = COLOR_PAIR(RED),
+  BRACKET_LEVEL_2 = COLOR_PAIR(YELLOW),
+  BRACKET_LEVEL_3 = COLOR_PAIR(GREEN),
+  FIND = COLOR_PAIR(CYAN_BACK),
+  SELECTION = A_REVERSE,
+  OVERLAY = A_REVERSE
+};
+
+struct HighlightData
+{
+  int lineNumber;
+  int position;
+  int length;
+  Highlights color;
+};
+
+// Only the language's state carries over between lines. Bracket levels are
+// relative to the line start; the buffer's bracket index makes them depths.
+struct LexState
+{
+  uint8_t machine = Language::START;
+  int bracketLevel = 0;
+  int lowestBracketLevel = 0;
+};
+
+// Appends the columns of brackets outside strings and comments to brackets,
+// if given. A nonzero column marks a later chunk of a long line.
+void lexLine(const Language &language, std::string_view line, int lineNumber, LexState &state, std::vector<HighlightData> &highlights, std::vector<int> *brackets = nullptr, int column = 0);
+
+// Highlights lines [first, last), long ones only around columns [column,
+// column + width). Calls for one buffer must pass the same language.
+void highlightLines(const Language &language, TextBuffer &buffer, size_t first, size_t last, std::vector<HighlightData> &highlights, size_t column = 0, size_t width = SIZE_MAX);
+
+// Brings the cached end states of lines [0, first) up to date.
+void lexUpTo(const Language &language, TextBuffer &buffer, size_t first);
+
+// Bracket depth at the start of the line, lexing up to it if needed.
+long bracketDepth(const Language &language, TextBuffer &buffer, size_t line);
+
+// Finds the bracket matching the first one at or after `at` on its line.
+bool findMatchingBracket(const Language &language, TextBuffer &buffer, TextPos at, TextPos &match);
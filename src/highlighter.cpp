@@ -0,0 +1,164 @@
+#include "highlighter.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// Lines the worker lexes while holding the buffer, which bounds how long a
+// key can wait for it.
+static const size_t SLICE_LINES = 1024;
+
+bool HighlightWindow::operator==(const HighlightWindow &other) const
+{
+  return first == other.first && last == other.last && column == other.column && width == other.width;
+}
+
+Highlighter::~Highlighter()
+{
+  if (worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+
+    wake.notify_one();
+    worker.join();
+  }
+
+  if (eventFd >= 0)
+    close(eventFd);
+}
+
+void Highlighter::start(TextBuffer &text)
+{
+  buffer = &text;
+  eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  worker = std::thread(&Highlighter::work, this);
+}
+
+void Highlighter::lock()
+{
+  ownerWaiting = true;
+  mutex.lock();
+  ownerWaiting = false;
+  wake.notify_one();
+}
+
+void Highlighter::unlock()
+{
+  mutex.unlock();
+}
+
+bool Highlighter::takeUpdate()
+{
+  uint64_t count = 0;
+
+  return eventFd >= 0 && read(eventFd, &count, sizeof(count)) == sizeof(count) && count > 0;
+}
+
+void Highlighter::show(const Language *shown, const HighlightView &shownView)
+{
+  language = shown;
+  view = shownView;
+
+  // An edit since the last draw changed the buffer's version, which leaves
+  // work even for the same view.
+  wake.notify_one();
+}
+
+void Highlighter::screenHighlights(size_t first, size_t last, std::vector<HighlightData> &out) const
+{
+  for (const HighlightData &highlight : published.screen)
+    if (highlight.lineNumber >= (int)first && highlight.lineNumber < (int)last)
+      out.push_back(highlight);
+}
+
+void Highlighter::lineHighlights(const HighlightWindow &window, std::vector<HighlightData> &out) const
+{
+  for (size_t i = 0; i < published.view.lines.size(); i++)
+    if (published.view.lines[i] == window)
+      out.insert(out.end(), published.lines[i].begin(), published.lines[i].end());
+}
+
+void Highlighter::forget()
+{
+  published = Published();
+}
+
+bool Highlighter::isFresh() const
+{
+  return published.language == language && published.version == buffer->version() && published.view == view;
+}
+
+bool Highlighter::hasWork() const
+{
+  return language && (!isFresh() || buffer->lexValid < buffer->size());
+}
+
+// Highlights the view with a screen's margin above and below, so that
+// scrolling by up to a screen finds fresh highlights already there.
+void Highlighter::publish()
+{
+  const HighlightWindow &screen = view.screen;
+  size_t rows = screen.last - std::min(screen.first, screen.last);
+  size_t top = std::min(buffer->size(), screen.first > rows ? screen.first - rows : 0);
+  size_t bottom = std::min(buffer->size(), screen.last + rows);
+
+  Published next;
+  next.language = language;
+  next.version = buffer->version();
+  next.view = view;
+
+  highlightLines(*language, *buffer, top, bottom, next.screen, screen.column, screen.width);
+
+  for (const HighlightWindow &window : view.lines)
+  {
+    next.lines.emplace_back();
+    highlightLines(*language, *buffer, window.first, window.last, next.lines.back(), window.column, window.width);
+  }
+
+  published = std::move(next);
+
+  // This only fails once the count would overflow, which leaves it
+  // readable anyway.
+  uint64_t one = 1;
+  [[maybe_unused]] ssize_t written = write(eventFd, &one, sizeof(one));
+}
+
+// One slice of work: catching the cached states up to the margin above the
+// screen, then publishing, then lexing on below.
+void Highlighter::step()
+{
+  const HighlightWindow &screen = view.screen;
+  size_t rows = screen.last - std::min(screen.first, screen.last);
+  size_t top = std::min(buffer->size(), screen.first > rows ? screen.first - rows : 0);
+
+  if (buffer->lexValid < top)
+    lexUpTo(*language, *buffer, std::min(top, buffer->lexValid + SLICE_LINES));
+  else if (!isFresh())
+    publish();
+  else
+    lexUpTo(*language, *buffer, std::min(buffer->size(), buffer->lexValid + SLICE_LINES));
+}
+
+void Highlighter::work()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;)
+  {
+    wake.wait(lock, [&]
+              { return stopping || hasWork(); });
+
+    if (stopping)
+      return;
+
+    step();
+
+    // Waiting gives up the mutex until the owner has had it.
+    wake.wait(lock, [&]
+              { return stopping || !ownerWaiting; });
+  }
+}
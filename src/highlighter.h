@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "buffer.h"
+#include "highlight.h"
+#include "language.h"
+
+// Lines [first, last) of a buffer, highlighted around columns [column,
+// column + width) as highlightLines() takes them.
+struct HighlightWindow
+{
+  size_t first = 0, last = 0, column = 0, width = SIZE_MAX;
+
+  bool operator==(const HighlightWindow &other) const;
+  bool operator!=(const HighlightWindow &other) const { return !(*this == other); }
+};
+
+// What the screen shows: the window over all its lines, plus windows over
+// single lines whose visible bytes lie elsewhere.
+struct HighlightView
+{
+  HighlightWindow screen;
+  std::vector<HighlightWindow> lines;
+
+  bool operator==(const HighlightView &other) const { return screen == other.screen && lines == other.lines; }
+  bool operator!=(const HighlightView &other) const { return !(*this == other); }
+};
+
+// Lexes on a thread of its own, in slices, so that typing never waits for a
+// large file to be lexed. The owner holds the buffer's mutex except while
+// waiting for input; until fresh highlights arrive, the last ones are drawn.
+class Highlighter
+{
+public:
+  Highlighter() = default;
+  ~Highlighter();
+
+  Highlighter(const Highlighter &) = delete;
+  Highlighter &operator=(const Highlighter &) = delete;
+
+  // Starts the worker on `buffer`. Until then, which the benchmarks rely on,
+  // nothing runs in the background and the owner highlights by itself.
+  void start(TextBuffer &buffer);
+  bool isRunning() const { return worker.joinable(); }
+
+  // Taken by the owner of the buffer whenever it runs, as described above.
+  // The rest is called with it held.
+  void lock();
+  void unlock();
+
+  // Becomes readable when fresh highlights have been published; -1 if
+  // there is no worker.
+  int fd() const { return eventFd; }
+
+  // Returns whether fresh highlights have been published since the last
+  // call, which makes fd() stop being readable.
+  bool takeUpdate();
+
+  // Asks for the view to be highlighted in `language`, or for nothing to be
+  // if it is null. Called on every draw.
+  void show(const Language *language, const HighlightView &view);
+
+  // Appends the last published highlights of lines [first, last), or of a
+  // window of a single line that the view asked for, to out.
+  void screenHighlights(size_t first, size_t last, std::vector<HighlightData> &out) const;
+  void lineHighlights(const HighlightWindow &window, std::vector<HighlightData> &out) const;
+
+  // Drops the published highlights, which belong to another file once the
+  // buffer's text is exchanged for it.
+  void forget();
+
+private:
+  struct Published
+  {
+    const Language *language = nullptr;
+    uint64_t version = 0;
+    HighlightView view;
+    std::vector<HighlightData> screen;
+    std::vector<std::vector<HighlightData>> lines;
+  };
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable wake;
+  int eventFd = -1;
+  bool stopping = false;
+
+  // Set while the owner waits for the mutex; after a slice the worker waits
+  // on `wake` until the owner has taken it.
+  std::atomic<bool> ownerWaiting{false};
+
+  TextBuffer *buffer = nullptr;
+  const Language *language = nullptr;
+  HighlightView view;
+  Published published;
+
+  bool isFresh() const;
+  bool hasWork() const;
+  void step();
+  void publish();
+  void work();
+};
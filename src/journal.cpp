@@ -0,0 +1,460 @@
+#include "journal.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+const int CrashJournal::CHECKPOINT_SECONDS;
+
+static const char MAGIC[] = "TEJ1";
+static const size_t MAGIC_BYTES = 4;
+
+enum RecordKind : char
+{
+  RECORD_INSERT = 'i',
+  RECORD_ERASE = 'e',
+  RECORD_CHECKPOINT = 'c',
+  RECORD_SAVED = 's'
+};
+
+// Numbers are stored seven bits to a byte, low bits first, so that the
+// small line and column numbers of most edits take a byte or two.
+static void putNumber(std::string &out, uint64_t value)
+{
+  while (value >= 0x80)
+  {
+    out += (char)(value | 0x80);
+    value >>= 7;
+  }
+
+  out += (char)value;
+}
+
+static bool getNumber(const char *&p, const char *end, uint64_t &value)
+{
+  value = 0;
+
+  for (int shift = 0; p < end && shift < 64; shift += 7)
+  {
+    uint8_t byte = *p++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+
+    if (!(byte & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+static void putDisk(std::string &out, const DiskState &disk)
+{
+  putNumber(out, disk.exists);
+  putNumber(out, disk.device);
+  putNumber(out, disk.inode);
+  putNumber(out, disk.size);
+  putNumber(out, disk.modified.tv_sec);
+  putNumber(out, disk.modified.tv_nsec);
+}
+
+static bool getDisk(const char *&p, const char *end, DiskState &disk)
+{
+  uint64_t exists, device, inode, size, seconds, nanoseconds;
+
+  if (!getNumber(p, end, exists) || !getNumber(p, end, device) || !getNumber(p, end, inode) || !getNumber(p, end, size) ||
+      !getNumber(p, end, seconds) || !getNumber(p, end, nanoseconds))
+    return false;
+
+  disk.exists = exists;
+  disk.device = device;
+  disk.inode = inode;
+  disk.size = size;
+  disk.modified.tv_sec = seconds;
+  disk.modified.tv_nsec = nanoseconds;
+  return true;
+}
+
+CrashJournal::~CrashJournal()
+{
+  close();
+}
+
+CrashJournal::CrashJournal(CrashJournal &&other) noexcept
+{
+  *this = std::move(other);
+}
+
+CrashJournal &CrashJournal::operator=(CrashJournal &&other) noexcept
+{
+  close();
+
+  path = std::move(other.path);
+  base = other.base;
+  fd = other.fd;
+  pending = std::move(other.pending);
+  recordBytes = other.recordBytes;
+  checkpointBytes = other.checkpointBytes;
+  edits = other.edits;
+  savingBytes = other.savingBytes;
+  savingEdits = other.savingEdits;
+  lastCheckpoint = other.lastCheckpoint;
+  paused = other.paused;
+  missedEdits = other.missedEdits;
+  failed = other.failed;
+  replacing = other.replacing;
+
+  other.path.clear();
+  other.fd = -1;
+  other.pending.clear();
+  return *this;
+}
+
+std::string CrashJournal::pathFor(const std::string &fileName)
+{
+  size_t slash = fileName.find_last_of('/');
+
+  if (slash == std::string::npos)
+    return "." + fileName + ".journal";
+
+  return fileName.substr(0, slash + 1) + "." + fileName.substr(slash + 1) + ".journal";
+}
+
+void CrashJournal::attach(const std::string &fileName, const DiskState &disk)
+{
+  close();
+
+  path = pathFor(fileName);
+  base = disk;
+  pending.clear();
+  recordBytes = checkpointBytes = 0;
+  edits = savingEdits = savingBytes = 0;
+  paused = missedEdits = failed = false;
+}
+
+void CrashJournal::pause()
+{
+  paused = true;
+}
+
+bool CrashJournal::beginRecord()
+{
+  edits++;
+
+  if (paused)
+    missedEdits = true;
+
+  return recording();
+}
+
+void CrashJournal::endRecord(size_t start)
+{
+  recordBytes += pending.size() - start;
+
+  if (pending.size() >= FLUSH_BYTES)
+    writePending();
+}
+
+void CrashJournal::recordInsert(TextPos at, std::string_view text)
+{
+  if (!beginRecord())
+    return;
+
+  size_t start = pending.size();
+
+  pending += RECORD_INSERT;
+  putNumber(pending, at.line);
+  putNumber(pending, at.column);
+  putNumber(pending, text.size());
+  pending += text;
+
+  endRecord(start);
+}
+
+void CrashJournal::recordErase(TextPos from, TextPos to)
+{
+  if (!beginRecord())
+    return;
+
+  size_t start = pending.size();
+
+  pending += RECORD_ERASE;
+  putNumber(pending, from.line);
+  putNumber(pending, from.column);
+  putNumber(pending, to.line - from.line);
+  putNumber(pending, to.column);
+
+  endRecord(start);
+}
+
+bool CrashJournal::flush(size_t lines, TextPos cursor)
+{
+  if (!recording())
+    return true;
+
+  auto now = std::chrono::steady_clock::now();
+  bool checkpoint = recordBytes - checkpointBytes >= CHECKPOINT_BYTES ||
+                    (recordBytes > checkpointBytes && now - lastCheckpoint >= std::chrono::seconds(CHECKPOINT_SECONDS));
+
+  if (checkpoint)
+  {
+    size_t start = pending.size();
+
+    pending += RECORD_CHECKPOINT;
+    putNumber(pending, lines);
+    putNumber(pending, cursor.line);
+    putNumber(pending, cursor.column);
+
+    recordBytes += pending.size() - start;
+  }
+
+  if (!writePending())
+    return false;
+
+  if (replacing && !replace())
+    return false;
+
+  // The sync runs on its own thread, so that a slow disk never holds up
+  // typing; it has its own descriptor in case the journal closes first.
+  if (checkpoint)
+  {
+    int copy = dup(fd);
+
+    if (copy >= 0)
+      std::thread([copy]()
+                  { fdatasync(copy);
+                    ::close(copy); })
+          .detach();
+
+    checkpointBytes = recordBytes;
+    lastCheckpoint = now;
+  }
+
+  return true;
+}
+
+void CrashJournal::saving()
+{
+  savingBytes = recordBytes;
+  savingEdits = edits;
+}
+
+void CrashJournal::saved(const DiskState &disk)
+{
+  if (edits == savingEdits)
+  {
+    discard();
+    base = disk;
+    missedEdits = false;
+    return;
+  }
+
+  if (!recording())
+    return;
+
+  size_t start = pending.size();
+
+  pending += RECORD_SAVED;
+  putDisk(pending, disk);
+  putNumber(pending, savingBytes);
+
+  recordBytes += pending.size() - start;
+  writePending();
+}
+
+void CrashJournal::discard()
+{
+  pending.clear();
+  replacing = false;
+  close();
+
+  // Along with what a crash may have left of a replacement.
+  if (!path.empty())
+  {
+    unlink(path.c_str());
+    unlink((path + ".new").c_str());
+  }
+
+  recordBytes = checkpointBytes = 0;
+  paused = failed = false;
+}
+
+bool CrashJournal::writePending()
+{
+  if (pending.empty() || failed || path.empty())
+    return !failed;
+
+  if (fd < 0)
+  {
+    replacing = access(path.c_str(), F_OK) == 0;
+    fd = open((replacing ? path + ".new" : path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+    std::string header(MAGIC, MAGIC_BYTES);
+    putDisk(header, base);
+    pending.insert(0, header);
+  }
+
+  size_t done = 0;
+
+  while (fd >= 0 && done < pending.size())
+  {
+    ssize_t count = write(fd, pending.data() + done, pending.size() - done);
+
+    if (count < 0 && errno == EINTR)
+      continue;
+
+    if (count <= 0)
+      break;
+
+    done += count;
+  }
+
+  if (fd < 0 || done < pending.size())
+  {
+    failed = true;
+    close();
+    return false;
+  }
+
+  pending.clear();
+  return true;
+}
+
+bool CrashJournal::replace()
+{
+  if (fdatasync(fd) != 0 || rename((path + ".new").c_str(), path.c_str()) != 0)
+  {
+    failed = true;
+    close();
+    return false;
+  }
+
+  replacing = false;
+  return true;
+}
+
+void CrashJournal::close()
+{
+  writePending();
+
+  if (replacing && !failed && fd >= 0)
+    replace();
+
+  if (replacing)
+    unlink((path + ".new").c_str());
+
+  if (fd >= 0)
+    ::close(fd);
+
+  fd = -1;
+  replacing = false;
+}
+
+bool hasNewerJournal(const std::string &fileName)
+{
+  struct stat journal, file;
+
+  if (stat(CrashJournal::pathFor(fileName).c_str(), &journal) != 0)
+    return false;
+
+  if (stat(fileName.c_str(), &file) != 0)
+    return true;
+
+  return journal.st_mtim.tv_sec > file.st_mtim.tv_sec ||
+         (journal.st_mtim.tv_sec == file.st_mtim.tv_sec && journal.st_mtim.tv_nsec >= file.st_mtim.tv_nsec);
+}
+
+bool readJournal(const std::string &fileName, const DiskState &disk, std::vector<JournalEdit> &edits, std::string &error)
+{
+  int fd = open(CrashJournal::pathFor(fileName).c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    error = strerror(errno);
+    return false;
+  }
+
+  std::string bytes;
+  char block[1 << 16];
+  ssize_t count;
+
+  while ((count = read(fd, block, sizeof(block))) > 0)
+    bytes.append(block, count);
+
+  ::close(fd);
+
+  const char *p = bytes.data() + MAGIC_BYTES, *end = bytes.data() + bytes.size();
+  DiskState base;
+
+  if (bytes.compare(0, MAGIC_BYTES, MAGIC) != 0 || !getDisk(p, end, base))
+  {
+    error = "NOT A JOURNAL";
+    return false;
+  }
+
+  // Offsets count from the first record, as marks do.
+  const char *records = p;
+  std::vector<std::pair<size_t, JournalEdit>> read;
+  bool matches = base == disk;
+  size_t start = 0;
+
+  while (p < end)
+  {
+    size_t offset = p - records;
+    char kind = *p++;
+    JournalEdit edit{};
+    DiskState saved;
+    uint64_t a, b, c, d;
+
+    if (kind == RECORD_INSERT && getNumber(p, end, a) && getNumber(p, end, b) && getNumber(p, end, c) && c <= (uint64_t)(end - p))
+    {
+      edit.kind = JournalEdit::INSERT;
+      edit.from = {a, b};
+      edit.text.assign(p, c);
+      p += c;
+    }
+    else if (kind == RECORD_ERASE && getNumber(p, end, a) && getNumber(p, end, b) && getNumber(p, end, c) && getNumber(p, end, d))
+    {
+      edit.kind = JournalEdit::ERASE;
+      edit.from = {a, b};
+      edit.to = {a + c, d};
+    }
+    else if (kind == RECORD_CHECKPOINT && getNumber(p, end, a) && getNumber(p, end, b) && getNumber(p, end, c))
+    {
+      edit.kind = JournalEdit::CHECKPOINT;
+      edit.lines = a;
+      edit.from = {b, c};
+    }
+    else if (kind == RECORD_SAVED && getDisk(p, end, saved) && getNumber(p, end, a))
+    {
+      // The file on disk may be one saved along the way, holding every
+      // edit up to the mark.
+      if (saved == disk)
+      {
+        matches = true;
+        start = a;
+      }
+      continue;
+    }
+    else
+    {
+      break;
+    }
+
+    read.emplace_back(offset, std::move(edit));
+  }
+
+  if (!matches)
+  {
+    error = "JOURNAL DOES NOT MATCH THE FILE";
+    return false;
+  }
+
+  for (auto &[offset, edit] : read)
+    if (offset >= start)
+      edits.push_back(std::move(edit));
+
+  return true;
+}
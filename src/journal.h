@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "edit.h"
+#include "watch.h"
+
+// Crash recovery for one file: edits are appended to ".<name>.journal"
+// beside it, buffered until flush(), which now and then adds a checkpoint
+// and syncs. A save with no newer edits deletes the journal. An old journal
+// stays until a new one has been synced and renamed over it.
+class CrashJournal
+{
+public:
+  static const size_t FLUSH_BYTES = 64 << 10;
+  static const size_t CHECKPOINT_BYTES = 64 << 10;
+  static const int CHECKPOINT_SECONDS = 5;
+
+  CrashJournal() = default;
+  ~CrashJournal();
+
+  CrashJournal(CrashJournal &&other) noexcept;
+  CrashJournal &operator=(CrashJournal &&other) noexcept;
+
+  static std::string pathFor(const std::string &fileName);
+
+  // Journals edits to fileName, whose text on disk is described by base.
+  // Nothing is written until the first edit.
+  void attach(const std::string &fileName, const DiskState &base);
+
+  // Stops recording without touching the journal on disk, while an old one
+  // waits to be recovered. Recording starts again once :recover attaches
+  // afresh or discard() deletes it; edits missed meanwhile stop it until a
+  // save.
+  void pause();
+  bool isPaused() const { return paused; }
+
+  void recordInsert(TextPos at, std::string_view text);
+  void recordErase(TextPos from, TextPos to);
+
+  // Writes out the records made since the last flush, noting the line count
+  // and cursor at checkpoints. Returns false if writing failed.
+  bool flush(size_t lines, TextPos cursor);
+
+  // A save of the text as it is now starts, and then finishes with the
+  // file on disk as described.
+  void saving();
+  void saved(const DiskState &disk);
+
+  // Deletes the journal file and starts afresh from the same base.
+  void discard();
+
+private:
+  std::string path;
+  DiskState base;
+  int fd = -1;
+  std::string pending;
+  uint64_t recordBytes = 0, checkpointBytes = 0;
+  uint64_t edits = 0, savingBytes = 0, savingEdits = 0;
+  std::chrono::steady_clock::time_point lastCheckpoint;
+  bool paused = false, missedEdits = false, failed = false, replacing = false;
+
+  bool recording() const { return !path.empty() && !paused && !missedEdits && !failed; }
+  bool beginRecord();
+  void endRecord(size_t start);
+  bool writePending();
+  bool replace();
+  void close();
+};
+
+// One record of a journal being recovered.
+struct JournalEdit
+{
+  enum Kind
+  {
+    INSERT,
+    ERASE,
+    CHECKPOINT
+  };
+
+  Kind kind;
+  TextPos from, to;
+  std::string text;
+  size_t lines;
+};
+
+// Whether fileName has a journal written after the file last changed.
+bool hasNewerJournal(const std::string &fileName);
+
+// Reads the edits of fileName's journal that the file, as described by
+// disk, lacks; a torn record ends it. Returns false with error set if the
+// journal cannot be read or belongs to another version of the file.
+bool readJournal(const std::string &fileName, const DiskState &disk, std::vector<JournalEdit> &edits, std::string &error);
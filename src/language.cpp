@@ -0,0 +1,550 @@
+#include "language.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <map>
+
+static const size_t MAX_KEYWORD_SEEDS = 1 << 16;
+
+namespace
+{
+  // Fills in a Language's tables from its definition.
+  class Compiler
+  {
+  public:
+    Compiler(const LanguageDefinition &definition, Language &language) : definition(definition), language(language) {}
+
+    void compile()
+    {
+      for (int c = 0; c < 256; c++)
+        word[c] = isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (c && definition.wordChars.find((char)c) != std::string_view::npos);
+
+      [[maybe_unused]] uint8_t start = add(Language::PLAIN, Language::START);
+      [[maybe_unused]] uint8_t normal = add(Language::PLAIN, Language::START);
+      assert(start == Language::START && normal == Language::NORMAL);
+
+      space = definition.commentsAfterSpace ? add(Language::PLAIN, Language::START) : Language::NORMAL;
+      identifier = add(Language::IDENTIFIER, Language::START);
+      number = add(Language::NUMBER, Language::START);
+      bracket = add(Language::BRACKET, Language::START);
+
+      std::vector<Opener> openers, wordOpeners, commentOpeners;
+
+      for (const Delimited &string : definition.strings)
+        openers.push_back({std::string(string.open), addDelimited(string, Language::STRING)});
+
+      wordOpeners = openers;
+
+      for (const Delimited &comment : definition.comments)
+      {
+        openers.push_back({std::string(comment.open), addDelimited(comment, Language::COMMENT)});
+        commentOpeners.push_back(openers.back());
+      }
+
+      Trie all = createTrie(openers, Language::NORMAL);
+      Trie words = definition.commentsAfterSpace ? createTrie(wordOpeners, Language::NORMAL) : all;
+
+      codeTrie = &all;
+      wordTrie = &words;
+
+      if (definition.angleArguments)
+      {
+        language.afterRewind = add(Language::PLAIN, Language::START);
+        angleOpen = add(Language::PLAIN, Language::START);
+        angleBody = add(Language::KEYWORD, Language::TENTATIVE);
+      }
+
+      Trie paths;
+
+      if (definition.directives)
+      {
+        path = add(Language::STRING, Language::START);
+        paths = createTrie(commentOpeners, path);
+        directiveNames["#"] = add(Language::DIRECTIVE, Language::START);
+      }
+
+      for (uint8_t state : {Language::START, Language::NORMAL, space, identifier, number, bracket, language.afterRewind})
+        for (int c = 0; c < 256; c++)
+          set(state, c, code(state, c));
+
+      if (definition.angleArguments)
+        compileAngles();
+
+      if (definition.directives)
+        compileDirectives(paths);
+
+      fill(all);
+
+      if (definition.commentsAfterSpace)
+        fill(words);
+
+      if (definition.directives)
+        fill(paths);
+    }
+
+  private:
+    // An opening delimiter and the state its body is lexed in.
+    struct Opener
+    {
+      std::string text;
+      uint8_t body;
+    };
+
+    // The openers as a tree of byte strings, a state for each proper prefix.
+    struct Trie
+    {
+      std::vector<Opener> openers;
+      std::map<std::string, uint8_t> nodes;
+      std::array<uint8_t, 256> root = {};
+      uint8_t plain = Language::NORMAL;
+    };
+
+    const LanguageDefinition &definition;
+    Language &language;
+
+    static bool isDigit(int c) { return c >= '0' && c <= '9'; }
+
+    bool word[256];
+    uint8_t space = 0, identifier = 0, number = 0, bracket = 0;
+    uint8_t angleOpen = 0, angleBody = 0, path = 0;
+    std::map<std::string, uint8_t> directiveNames;
+    const Trie *codeTrie = nullptr, *wordTrie = nullptr;
+
+    // New states go on in themselves with every byte until set() says
+    // otherwise.
+    uint8_t add(Language::Kind kind, uint8_t resume)
+    {
+      uint8_t state = language.kinds.size();
+
+      language.kinds.push_back(kind);
+      language.resume.push_back(resume);
+      language.table.resize(language.kinds.size() * 256, {state, Language::CONTINUE});
+
+      return state;
+    }
+
+    void set(uint8_t state, int c, Language::Transition transition)
+    {
+      language.table[state * 256 + c] = transition;
+    }
+
+    // A token goes on from one state to the next unless the kind changes;
+    // brackets stand alone.
+    Language::Transition enter(uint8_t from, uint8_t next) const
+    {
+      uint8_t kind = language.kinds[from];
+      bool same = kind == language.kinds[next] && kind != Language::BRACKET;
+
+      return {next, same ? Language::CONTINUE : (uint8_t)2};
+    }
+
+    // A new token that started `back` bytes before the byte after this one.
+    static Language::Transition restart(uint8_t next, size_t back)
+    {
+      return {next, (uint8_t)(back + 1)};
+    }
+
+    // The transition on c from a state between tokens, or inside a name or
+    // a number.
+    Language::Transition code(uint8_t from, int c) const
+    {
+      const Trie &trie = from == Language::START || from == space ? *codeTrie : *wordTrie;
+      uint8_t next = Language::NORMAL;
+
+      if (isDigit(c))
+        next = from == identifier ? identifier : number;
+      else if (word[c])
+        next = from == number ? number : identifier;
+      else if (from == number && c && definition.numberChars.find((char)c) != std::string_view::npos)
+        next = number;
+      else if (c == '#' && definition.directives && from == Language::START)
+        next = directiveNames.at("#");
+      else if (trie.root[c])
+        next = trie.root[c];
+      else if (c == '<' && definition.angleArguments && from != language.afterRewind)
+        next = angleOpen;
+      else if (c && strchr("()[]{}", c))
+        next = bracket;
+      else if (c == ' ' || c == '\t')
+        next = from == Language::START ? Language::START : space;
+
+      return enter(from, next);
+    }
+
+    // The body of a string or comment, and a state for each part of the
+    // closing delimiter matched so far, falling back as in Knuth-Morris-Pratt.
+    uint8_t addDelimited(const Delimited &delimited, Language::Kind kind)
+    {
+      uint8_t body = add(kind, Language::START);
+
+      if (delimited.multiline)
+        language.resume[body] = body;
+
+      if (delimited.close.empty())
+        return body;
+
+      std::string_view close = delimited.close;
+      uint8_t resume = language.resume[body];
+      uint8_t escape = delimited.escape ? add(kind, resume) : 0;
+      std::vector<uint8_t> matched = {body};
+
+      for (size_t j = 1; j < close.size(); j++)
+        matched.push_back(add(kind, resume));
+
+      for (size_t j = 0; j < close.size(); j++)
+        for (int c = 0; c < 256; c++)
+        {
+          if (c == (unsigned char)close[j])
+          {
+            set(matched[j], c, j + 1 == close.size() ? restart(Language::NORMAL, 0) : Language::Transition{matched[j + 1], Language::CONTINUE});
+            continue;
+          }
+
+          std::string seen = std::string(close.substr(0, j)) + (char)c;
+          size_t k = j;
+
+          while (k > 0 && close.substr(0, k) != std::string_view(seen).substr(seen.size() - k))
+            k--;
+
+          if (k > 0)
+            set(matched[j], c, {matched[k], Language::CONTINUE});
+          else if (escape && c == (unsigned char)delimited.escape)
+            set(matched[j], c, {escape, Language::CONTINUE});
+          else
+            set(matched[j], c, {body, Language::CONTINUE});
+        }
+
+      if (escape)
+        for (int c = 0; c < 256; c++)
+          set(escape, c, {body, Language::CONTINUE});
+
+      return body;
+    }
+
+    // The longest opener that text starts with, or nullptr.
+    static const Opener *longestPrefix(const Trie &trie, std::string_view text)
+    {
+      const Opener *found = nullptr;
+
+      for (const Opener &opener : trie.openers)
+        if (text.substr(0, opener.text.size()) == opener.text && (!found || opener.text.size() > found->text.size()))
+          found = &opener;
+
+      return found;
+    }
+
+    Trie createTrie(const std::vector<Opener> &openers, uint8_t plain)
+    {
+      Trie trie;
+      trie.openers = openers;
+      trie.plain = plain;
+
+      for (const Opener &opener : openers)
+        for (size_t length = 1; length < opener.text.size(); length++)
+        {
+          std::string prefix = opener.text.substr(0, length);
+
+          if (trie.nodes.count(prefix))
+            continue;
+
+          const Opener *within = longestPrefix(trie, prefix);
+          trie.nodes[prefix] = add(within ? (Language::Kind)language.kinds[within->body] : (Language::Kind)language.kinds[plain], Language::START);
+        }
+
+      for (const Opener &opener : openers)
+      {
+        unsigned char first = opener.text[0];
+        auto node = trie.nodes.find(opener.text.substr(0, 1));
+
+        trie.root[first] = node != trie.nodes.end() ? node->second : opener.body;
+      }
+
+      return trie;
+    }
+
+    // Runs text through the table from `state` and returns where the last
+    // token started, or INT32_MIN if the first one went on throughout.
+    int simulate(uint8_t &state, std::string_view text) const
+    {
+      int start = INT32_MIN;
+
+      for (size_t t = 0; t < text.size(); t++)
+      {
+        Language::Transition transition = language.step(state, text[t]);
+        state = transition.next;
+
+        if (transition.action != Language::CONTINUE)
+          start = (int)t + 2 - transition.action;
+      }
+
+      return start;
+    }
+
+    // A prefix that stops matching is lexed as what it turned out to be;
+    // shorter prefixes are filled in first, as these runs can use them.
+    void fill(const Trie &trie)
+    {
+      std::vector<std::pair<std::string, uint8_t>> nodes(trie.nodes.begin(), trie.nodes.end());
+
+      std::stable_sort(nodes.begin(), nodes.end(), [](const auto &a, const auto &b)
+                       { return a.first.size() < b.first.size(); });
+
+      for (const auto &[prefix, node] : nodes)
+      {
+        const Opener *within = longestPrefix(trie, prefix);
+
+        for (int c = 0; c < 256; c++)
+        {
+          std::string next = prefix + (char)c;
+          auto child = trie.nodes.find(next);
+          const Opener *opener = longestPrefix(trie, next);
+
+          if (child != trie.nodes.end())
+          {
+            set(node, c, restart(child->second, next.size()));
+            continue;
+          }
+
+          if (opener && opener->text.size() == next.size())
+          {
+            set(node, c, restart(opener->body, next.size()));
+            continue;
+          }
+
+          uint8_t state = within ? within->body : trie.plain;
+          std::string rest = next.substr(within ? within->text.size() : 1);
+          int start = simulate(state, rest);
+
+          set(node, c, start == INT32_MIN ? Language::Transition{state, Language::CONTINUE} : restart(state, rest.size() - start));
+        }
+
+        if (within)
+        {
+          uint8_t state = within->body;
+          simulate(state, std::string_view(prefix).substr(within->text.size()));
+          language.resume[node] = language.resume[state];
+        }
+      }
+    }
+
+    // "<" goes to angleOpen, then angleBody; a '>' makes them keywords, and
+    // anything else rewinds to the byte after the '<'.
+    void compileAngles()
+    {
+      auto inside = [&](int c)
+      { return word[c] || (c && strchr(" :,*&<", c)); };
+
+      for (int c = 0; c < 256; c++)
+      {
+        set(angleOpen, c, inside(c) ? restart(angleBody, 1) : code(angleOpen, c));
+
+        if (inside(c))
+          set(angleBody, c, {angleBody, Language::CONTINUE});
+        else if (c == '>')
+          set(angleBody, c, restart(Language::NORMAL, 1));
+        else
+          set(angleBody, c, {language.afterRewind, Language::REWIND});
+      }
+    }
+
+    // '#' and a name, then a keyword argument, or a path for the names in
+    // pathDirectives.
+    void compileDirectives(const Trie &paths)
+    {
+      uint8_t name = add(Language::DIRECTIVE, Language::START);
+      uint8_t gap = add(Language::PLAIN, Language::START);
+      uint8_t argument = add(Language::KEYWORD, Language::START);
+      uint8_t pathGap = add(Language::PLAIN, Language::START);
+
+      for (std::string_view directive : definition.pathDirectives)
+        for (size_t length = 1; length <= directive.size(); length++)
+        {
+          std::string prefix = "#" + std::string(directive.substr(0, length));
+
+          if (!directiveNames.count(prefix))
+            directiveNames[prefix] = add(Language::DIRECTIVE, Language::START);
+        }
+
+      auto isPath = [&](const std::string &prefix)
+      { return std::find(definition.pathDirectives.begin(), definition.pathDirectives.end(), std::string_view(prefix).substr(1)) != definition.pathDirectives.end(); };
+
+      auto intoPath = [&](uint8_t from, int c)
+      { return paths.root[c] ? enter(from, paths.root[c]) : enter(from, path); };
+
+      for (int c = 0; c < 256; c++)
+      {
+        bool blank = c == ' ' || c == '\t';
+
+        set(name, c, word[c] ? Language::Transition{name, Language::CONTINUE} : blank ? enter(name, gap) : code(name, c));
+        set(gap, c, word[c] ? enter(gap, argument) : blank ? Language::Transition{gap, Language::CONTINUE} : code(gap, c));
+        set(argument, c, word[c] ? Language::Transition{argument, Language::CONTINUE} : code(argument, c));
+        set(pathGap, c, blank ? Language::Transition{pathGap, Language::CONTINUE} : intoPath(pathGap, c));
+        set(path, c, paths.root[c] ? enter(path, paths.root[c]) : Language::Transition{path, Language::CONTINUE});
+
+        for (const auto &[prefix, state] : directiveNames)
+        {
+          auto longer = directiveNames.find(prefix + (char)c);
+
+          if (longer != directiveNames.end())
+            set(state, c, {longer->second, Language::CONTINUE});
+          else if (word[c])
+            set(state, c, {name, Language::CONTINUE});
+          else if (!isPath(prefix))
+            set(state, c, blank ? enter(state, gap) : code(state, c));
+          else
+            set(state, c, blank ? enter(state, pathGap) : intoPath(state, c));
+        }
+      }
+    }
+  };
+}
+
+Language::Language(const LanguageDefinition &definition) : definition(&definition)
+{
+  const std::vector<std::string_view> &keywords = definition.keywords;
+
+  for (std::string_view keyword : keywords)
+  {
+    minKeyword = std::min(minKeyword, keyword.size());
+    maxKeyword = std::max(maxKeyword, keyword.size());
+  }
+
+  for (uint32_t seed = 1; seed < MAX_KEYWORD_SEEDS && keywords.size() < KEYWORD_SLOTS && !keywordSeed; seed++)
+  {
+    std::fill(keywordSlots, keywordSlots + KEYWORD_SLOTS, 0);
+    keywordSeed = seed;
+
+    for (size_t i = 0; i < keywords.size() && keywordSeed; i++)
+    {
+      uint8_t &slot = keywordSlots[keywordHash(keywords[i].data(), keywords[i].size(), seed)];
+
+      if (slot != 0)
+        keywordSeed = 0;
+
+      slot = i + 1;
+    }
+  }
+
+  Compiler(definition, *this).compile();
+}
+
+bool Language::isListedKeyword(std::string_view word) const
+{
+  return std::find(definition->keywords.begin(), definition->keywords.end(), word) != definition->keywords.end();
+}
+
+static LanguageDefinition cDefinition()
+{
+  LanguageDefinition c;
+
+  c.name = "c";
+  c.extensions = {"c", "cpp", "h", "hpp"};
+  c.keywords = {"auto", "bool", "break", "case", "char", "class", "const", "continue", "default", "do", "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long", "namespace", "private", "public", "register", "restrict", "return", "short", "signed", "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while"};
+  c.strings = {{"\"", "\"", '\\'}, {"'", "'", '\\'}};
+  c.comments = {{"//", ""}, {"/*", "*/", 0, true}};
+  c.directives = true;
+  c.pathDirectives = {"include"};
+  c.angleArguments = true;
+
+  return c;
+}
+
+static LanguageDefinition pythonDefinition()
+{
+  LanguageDefinition python;
+
+  python.name = "python";
+  python.extensions = {"py", "pyw", "pyi"};
+  python.keywords = {"False", "None", "True", "and", "as", "assert", "async", "await", "break", "class", "continue", "def", "del", "elif", "else", "except", "finally", "for", "from", "global", "if", "import", "in", "is", "lambda", "nonlocal", "not", "or", "pass", "raise", "return", "try", "while", "with", "yield"};
+  python.strings = {{"\"\"\"", "\"\"\"", '\\', true}, {"'''", "'''", '\\', true}, {"\"", "\"", '\\'}, {"'", "'", '\\'}};
+  python.comments = {{"#", ""}};
+
+  return python;
+}
+
+static LanguageDefinition shellDefinition()
+{
+  LanguageDefinition shell;
+
+  shell.name = "shell";
+  shell.extensions = {"sh", "bash", "zsh"};
+  shell.keywords = {"case", "declare", "do", "done", "elif", "else", "esac", "exit", "export", "fi", "for", "function", "if", "in", "local", "readonly", "return", "select", "source", "then", "time", "until", "while"};
+  shell.strings = {{"\"", "\"", '\\'}, {"'", "'"}};
+  shell.comments = {{"#", ""}};
+  shell.commentsAfterSpace = true;
+
+  return shell;
+}
+
+static LanguageDefinition goDefinition()
+{
+  LanguageDefinition go;
+
+  go.name = "go";
+  go.extensions = {"go"};
+  go.keywords = {"bool", "break", "byte", "case", "chan", "const", "continue", "default", "defer", "else", "error", "fallthrough", "false", "float32", "float64", "for", "func", "go", "goto", "if", "import", "int", "int16", "int32", "int64", "int8", "interface", "iota", "map", "nil", "package", "range", "return", "rune", "select", "string", "struct", "switch", "true", "type", "uint", "uint16", "uint32", "uint64", "uint8", "uintptr", "var"};
+  go.strings = {{"\"", "\"", '\\'}, {"'", "'", '\\'}, {"`", "`", 0, true}};
+  go.comments = {{"//", ""}, {"/*", "*/", 0, true}};
+
+  return go;
+}
+
+static LanguageDefinition yamlDefinition()
+{
+  LanguageDefinition yaml;
+
+  yaml.name = "yaml";
+  yaml.extensions = {"yaml", "yml"};
+  yaml.keywords = {"false", "no", "null", "off", "on", "true", "yes"};
+  yaml.strings = {{"\"", "\"", '\\'}, {"'", "'"}};
+  yaml.comments = {{"#", ""}};
+  yaml.wordChars = "-";
+  yaml.commentsAfterSpace = true;
+  yaml.colonKeys = true;
+
+  return yaml;
+}
+
+// Definitions are compiled together on first use, into languages that
+// point back at them.
+struct Languages
+{
+  std::vector<LanguageDefinition> definitions = {cDefinition(), pythonDefinition(), shellDefinition(), goDefinition(), yamlDefinition(), LanguageDefinition()};
+  std::vector<Language> compiled;
+
+  Languages()
+  {
+    for (const LanguageDefinition &definition : definitions)
+      compiled.emplace_back(definition);
+  }
+};
+
+static const Languages &languages()
+{
+  static const Languages all;
+  return all;
+}
+
+const Language *languageFor(const std::string &fileName)
+{
+  size_t dot = fileName.find_last_of("./");
+
+  if (dot == std::string::npos || fileName[dot] != '.')
+    return nullptr;
+
+  std::string_view extension = std::string_view(fileName).substr(dot + 1);
+
+  for (const Language &language : languages().compiled)
+    for (std::string_view candidate : language.definition->extensions)
+      if (candidate == extension)
+        return &language;
+
+  return nullptr;
+}
+
+const Language &plainText()
+{
+  return languages().compiled.back();
+}
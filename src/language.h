@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Text from an opening delimiter through a closing one: a string, or a
+// comment. An empty close runs to the end of the line.
+struct Delimited
+{
+  std::string_view open, close;
+
+  // Byte that makes the one after it part of the text, or 0.
+  char escape = 0;
+
+  // Whether it may go on past the end of its line.
+  bool multiline = false;
+};
+
+// How one language's source is highlighted: keywords, strings, comments and
+// a few syntax quirks, plus the file name extensions it is used for.
+struct LanguageDefinition
+{
+  std::string_view name;
+  std::vector<std::string_view> extensions;
+  std::vector<std::string_view> keywords;
+  std::vector<Delimited> strings, comments;
+
+  // Bytes besides letters, digits and '_' that identifiers may hold, and
+  // besides those that numbers, which start with a digit, may go on with.
+  std::string_view wordChars, numberChars = ".";
+
+  // Comments start only at the start of a line or after a space, as a '#'
+  // inside a shell word does not start one.
+  bool commentsAfterSpace = false;
+
+  // An identifier followed by ':' and a space or the line end is a key,
+  // coloured like a keyword.
+  bool colonKeys = false;
+
+  // A '#' starting a line starts a directive; the argument of those in
+  // pathDirectives is coloured as a string.
+  bool directives = false;
+  std::vector<std::string_view> pathDirectives;
+
+  // "<...>" holding only names, as template arguments do, is coloured as
+  // keywords.
+  bool angleArguments = false;
+};
+
+// A definition compiled into a state machine that lexes with one table
+// lookup per byte; only the state at a line's end carries over to the next.
+struct Language
+{
+  enum Kind : uint8_t
+  {
+    PLAIN,
+    IDENTIFIER,
+    NUMBER,
+    STRING,
+    COMMENT,
+    DIRECTIVE,
+    KEYWORD,
+    BRACKET,
+  };
+
+  // The token going on, or a new one starting `action - 1` bytes before the
+  // next byte. REWIND goes back to the start of a tentative "<...>".
+  struct Transition
+  {
+    uint8_t next;
+    uint8_t action;
+  };
+
+  static const uint8_t CONTINUE = 0;
+  static const uint8_t REWIND = UINT8_MAX;
+
+  // Lines start in START, which can start a directive; later chunks of long
+  // lines in NORMAL, unless inside a string or comment.
+  static const uint8_t START = 0;
+  static const uint8_t NORMAL = 1;
+
+  // The state a line ending in a state resumes in, or TENTATIVE for states
+  // whose token is given up on at the line end.
+  static const uint8_t TENTATIVE = UINT8_MAX;
+
+  const LanguageDefinition *definition = nullptr;
+
+  std::vector<Transition> table;
+  std::vector<uint8_t> kinds, resume;
+  uint8_t afterRewind = NORMAL;
+
+  explicit Language(const LanguageDefinition &definition);
+
+  size_t stateCount() const { return kinds.size(); }
+
+  Transition step(uint8_t state, char c) const { return table[state * 256 + (unsigned char)c]; }
+
+  // Keywords are found with a perfect hash over the length and three
+  // characters, or a linear search if no seed was found.
+  bool isKeyword(const char *word, size_t length) const
+  {
+    if (length < minKeyword || length > maxKeyword)
+      return false;
+
+    std::string_view text(word, length);
+
+    if (!keywordSeed)
+      return isListedKeyword(text);
+
+    uint8_t slot = keywordSlots[keywordHash(word, length, keywordSeed)];
+
+    return slot != 0 && definition->keywords[slot - 1] == text;
+  }
+
+private:
+  // One for each value of the hash's top byte.
+  static const size_t KEYWORD_SLOTS = 256;
+
+  uint32_t keywordSeed = 0;
+  uint8_t keywordSlots[KEYWORD_SLOTS] = {};
+  size_t minKeyword = SIZE_MAX, maxKeyword = 0;
+
+  // The slot is the top byte, which the multiplier's 1 << 24 term carries
+  // every character into.
+  static uint32_t keywordHash(const char *word, size_t length, uint32_t seed)
+  {
+    uint32_t hash = (seed ^ (uint32_t)length) * 0x01000193u;
+    hash = (hash ^ (unsigned char)word[0]) * 0x01000193u;
+    hash = (hash ^ (unsigned char)word[length / 2]) * 0x01000193u;
+    hash = (hash ^ (unsigned char)word[length - 1]) * 0x01000193u;
+    return hash >> 24;
+  }
+
+  bool isListedKeyword(std::string_view word) const;
+};
+
+// The language files named fileName are in, by extension, or nullptr.
+const Language *languageFor(const std::string &fileName);
+
+// Brackets alone, for matching them in files of no known language.
+const Language &plainText();
@@ -0,0 +1,155 @@
+#include "lz.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+static const int HASH_BITS = 12;
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+
+// Lengths of 15 and more carry on in extra bytes, 255 at a time.
+static const unsigned LENGTH_MORE = 15;
+
+static uint32_t hashAt(const unsigned char *at)
+{
+  uint32_t word;
+  memcpy(&word, at, sizeof(word));
+  return (word * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void putLength(size_t length, std::vector<char> &out)
+{
+  for (; length >= 255; length -= 255)
+    out.push_back((char)255);
+
+  out.push_back((char)length);
+}
+
+static bool getLength(const unsigned char *&at, const unsigned char *end, size_t &length)
+{
+  unsigned char more;
+
+  do
+  {
+    if (at == end)
+      return false;
+
+    more = *at++;
+    length += more;
+  } while (more == 255);
+
+  return true;
+}
+
+// One sequence: the literals data[from, from + literals), then, unless
+// this is the last sequence, a copy of `match` bytes from `offset` back.
+static void putSequence(const unsigned char *data, size_t from, size_t literals, size_t offset, size_t match, std::vector<char> &out)
+{
+  size_t matchCode = match ? match - MIN_MATCH : 0;
+
+  out.push_back((char)((std::min<size_t>(literals, LENGTH_MORE) << 4) | std::min<size_t>(matchCode, LENGTH_MORE)));
+
+  if (literals >= LENGTH_MORE)
+    putLength(literals - LENGTH_MORE, out);
+
+  out.insert(out.end(), data + from, data + from + literals);
+
+  if (!match)
+    return;
+
+  out.push_back((char)(offset & 0xFF));
+  out.push_back((char)(offset >> 8));
+
+  if (matchCode >= LENGTH_MORE)
+    putLength(matchCode - LENGTH_MORE, out);
+}
+
+void lzCompress(const char *data, size_t size, std::vector<char> &out)
+{
+  const unsigned char *in = (const unsigned char *)data;
+
+  // Positions plus one, so that zero means none.
+  uint32_t table[1 << HASH_BITS] = {};
+  size_t anchor = 0, at = 0;
+
+  while (at + MIN_MATCH <= size)
+  {
+    uint32_t &slot = table[hashAt(in + at)];
+    size_t candidate = slot;
+    slot = at + 1;
+
+    if (!candidate || at - (candidate - 1) > MAX_OFFSET || memcmp(in + candidate - 1, in + at, MIN_MATCH) != 0)
+    {
+      at++;
+      continue;
+    }
+
+    size_t from = candidate - 1, match = MIN_MATCH;
+
+    while (at + match < size && in[from + match] == in[at + match])
+      match++;
+
+    putSequence(in, anchor, at - anchor, at - from, match, out);
+    at += match;
+    anchor = at;
+  }
+
+  putSequence(in, anchor, size - anchor, 0, 0, out);
+}
+
+bool lzDecompress(const char *data, size_t size, char *out, size_t outSize)
+{
+  const unsigned char *at = (const unsigned char *)data, *end = at + size;
+  size_t done = 0;
+
+  while (at < end)
+  {
+    unsigned token = *at++;
+    size_t literals = token >> 4;
+
+    if (literals == LENGTH_MORE && !getLength(at, end, literals))
+      return false;
+
+    if (literals > (size_t)(end - at) || literals > outSize - done)
+      return false;
+
+    memcpy(out + done, at, literals);
+    at += literals;
+    done += literals;
+
+    if (at == end)
+      break;
+
+    if (end - at < 2)
+      return false;
+
+    size_t offset = at[0] | (size_t)at[1] << 8;
+    size_t match = token & LENGTH_MORE;
+    at += 2;
+
+    if (match == LENGTH_MORE && !getLength(at, end, match))
+      return false;
+
+    match += MIN_MATCH;
+
+    if (offset == 0 || offset > done || match > outSize - done)
+      return false;
+
+    // A copy may overlap what it writes, which repeats the last `offset`
+    // bytes, so it goes a byte at a time unless it cannot.
+    if (offset >= match)
+    {
+      memcpy(out + done, out + done - offset, match);
+    }
+    else
+    {
+      for (size_t i = 0; i < match; i++)
+        out[done + i] = out[done + i - offset];
+    }
+
+    done += match;
+  }
+
+  return done == outSize;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// A small LZ4-style codec: runs of literals alternate with copies of up to
+// 64 KB back. It favours speed over ratio.
+
+// Appends the compressed form of data to out.
+void lzCompress(const char *data, size_t size, std::vector<char> &out);
+
+// Expands data into out, which must be exactly the original size. Returns
+// false if data turns out not to be the compressed form of that many bytes.
+bool lzDecompress(const char *data, size_t size, char *out, size_t outSize);
@@ -0,0 +1,37 @@
+#include "macro.h"
+
+void Macro::start()
+{
+  recorded.clear();
+  typed.clear();
+  keyCount = 0;
+  recording = true;
+  hasUndo = false;
+}
+
+void Macro::recordKey(int key, Mode mode)
+{
+  keyCount++;
+
+  if (mode == INSERT && key >= ' ' && key < 127)
+  {
+    if (recorded.empty() || recorded.back().kind != Op::TYPE)
+      recorded.push_back({Op::TYPE, 0, (uint32_t)typed.size(), 0});
+
+    typed += (char)key;
+    recorded.back().textLength++;
+    return;
+  }
+
+  if (mode == COMMAND && (key == 'u' || key == 'r'))
+    hasUndo = true;
+
+  recorded.push_back({Op::KEY, key, 0, 0});
+}
+
+void Macro::recordPaste(std::string_view text)
+{
+  keyCount++;
+  recorded.push_back({Op::PASTE, 0, (uint32_t)typed.size(), (uint32_t)text.size()});
+  typed += text;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A keystroke macro, decoded while recording into operations for playback:
+// typed text becomes one insertion, and other keys are replayed as keys.
+class Macro
+{
+public:
+  // What the editor was doing with the keys it was given.
+  enum Mode : uint8_t
+  {
+    COMMAND,
+    INSERT,
+    CHORD
+  };
+
+  struct Op
+  {
+    enum Kind : uint8_t
+    {
+      KEY,
+      TYPE,
+      PASTE
+    };
+
+    Kind kind;
+    int key;
+    uint32_t textStart, textLength;
+  };
+
+  // Starts recording afresh, dropping the macro recorded before.
+  void start();
+  void stop() { recording = false; }
+  bool isRecording() const { return recording; }
+
+  void recordKey(int key, Mode mode);
+  void recordPaste(std::string_view text);
+
+  const std::vector<Op> &ops() const { return recorded; }
+  std::string_view text(const Op &op) const { return std::string_view(typed).substr(op.textStart, op.textLength); }
+  bool empty() const { return recorded.empty(); }
+  size_t keys() const { return keyCount; }
+
+  // Whether the macro undoes or redoes, which keeps playback from being
+  // undone as a single step.
+  bool undoes() const { return hasUndo; }
+
+private:
+  std::vector<Op> recorded;
+  std::string typed;
+  size_t keyCount = 0;
+  bool recording = false;
+  bool hasUndo = false;
+};
@@ -0,0 +1,764 @@
+#include "regex.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+
+// Limits on what a pattern may compile to.
+static const size_t MAX_DFA_STATES = 4096;
+static const int MAX_REPEAT = 1000;
+static const size_t MAX_NFA_STATES = 100000;
+
+namespace
+{
+  struct Node
+  {
+    enum Kind
+    {
+      SET,
+      CONCAT,
+      ALT,
+      STAR,
+      PLUS,
+      QUEST,
+      BOL,
+      EOL,
+      EMPTY
+    } kind;
+
+    std::bitset<256> set;
+    std::vector<Node> children;
+  };
+
+  class Parser
+  {
+  public:
+    Parser(std::string_view pattern) : text(pattern) {}
+
+    bool parse(Node &root, std::string &error)
+    {
+      root = alternation();
+
+      if (failure.empty() && position < text.size())
+        failure = "UNMATCHED )";
+
+      error = failure;
+      return failure.empty();
+    }
+
+  private:
+    std::string_view text;
+    size_t position = 0;
+    std::string failure;
+
+    bool atEnd() const { return position >= text.size(); }
+    char peek() const { return text[position]; }
+
+    Node alternation()
+    {
+      Node first = concatenation();
+
+      if (atEnd() || peek() != '|')
+        return first;
+
+      Node alt = {Node::ALT, {}, {first}};
+
+      while (!atEnd() && peek() == '|')
+      {
+        position++;
+        alt.children.push_back(concatenation());
+      }
+
+      return alt;
+    }
+
+    Node concatenation()
+    {
+      Node concat = {Node::CONCAT, {}, {}};
+
+      while (!atEnd() && peek() != '|' && peek() != ')' && failure.empty())
+        concat.children.push_back(repetition());
+
+      if (concat.children.empty())
+        return {Node::EMPTY, {}, {}};
+
+      return concat.children.size() == 1 ? concat.children[0] : concat;
+    }
+
+    Node repetition()
+    {
+      Node node = atom();
+
+      while (!atEnd() && failure.empty())
+      {
+        char c = peek();
+
+        if (c == '*' || c == '+' || c == '?')
+        {
+          position++;
+          node = {c == '*' ? Node::STAR : c == '+' ? Node::PLUS : Node::QUEST, {}, {node}};
+        }
+        else if (c == '{')
+        {
+          node = counted(node);
+        }
+        else
+        {
+          break;
+        }
+      }
+
+      return node;
+    }
+
+    bool number(int &value)
+    {
+      size_t begin = position;
+      value = 0;
+
+      while (!atEnd() && isdigit((unsigned char)peek()) && value <= MAX_REPEAT)
+        value = value * 10 + (text[position++] - '0');
+
+      return position > begin;
+    }
+
+    // {m}, {m,} and {m,n} become m copies followed by optional copies or a
+    // star.
+    Node counted(const Node &node)
+    {
+      position++;
+
+      int low, high;
+      if (!number(low))
+      {
+        failure = "BAD {}";
+        return node;
+      }
+
+      high = low;
+      bool unbounded = false;
+
+      if (!atEnd() && peek() == ',')
+      {
+        position++;
+        if (!number(high))
+          unbounded = true;
+      }
+
+      if (atEnd() || peek() != '}' || low > MAX_REPEAT || high > MAX_REPEAT || (!unbounded && high < low))
+      {
+        failure = "BAD {}";
+        return node;
+      }
+      position++;
+
+      Node concat = {Node::CONCAT, {}, std::vector<Node>(low, node)};
+
+      if (unbounded)
+        concat.children.push_back({Node::STAR, {}, {node}});
+      else
+        for (int i = low; i < high; i++)
+          concat.children.push_back({Node::QUEST, {}, {node}});
+
+      if (concat.children.empty())
+        return {Node::EMPTY, {}, {}};
+
+      return concat;
+    }
+
+    static void addEscapeClass(char c, std::bitset<256> &set)
+    {
+      std::bitset<256> members;
+
+      for (int b = 0; b < 256; b++)
+      {
+        bool digit = b >= '0' && b <= '9';
+        bool word = digit || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b == '_';
+        bool space = b == ' ' || b == '\t' || b == '\r' || b == '\f' || b == '\v';
+
+        switch (tolower(c))
+        {
+        case 'd':
+          members[b] = digit;
+          break;
+        case 'w':
+          members[b] = word;
+          break;
+        case 's':
+          members[b] = space;
+          break;
+        }
+      }
+
+      set |= isupper((unsigned char)c) ? ~members : members;
+    }
+
+    static bool isClassEscape(char c)
+    {
+      return strchr("dDwWsS", c) != nullptr;
+    }
+
+    static unsigned char escapedByte(char c)
+    {
+      switch (c)
+      {
+      case 't':
+        return '\t';
+      case 'r':
+        return '\r';
+      case 'f':
+        return '\f';
+      case 'v':
+        return '\v';
+      default:
+        return c;
+      }
+    }
+
+    Node bracket()
+    {
+      Node node = {Node::SET, {}, {}};
+      bool negate = false;
+
+      if (!atEnd() && peek() == '^')
+      {
+        negate = true;
+        position++;
+      }
+
+      bool first = true;
+
+      while (!atEnd() && (peek() != ']' || first))
+      {
+        first = false;
+        unsigned char low = text[position++];
+
+        if (low == '\\' && !atEnd())
+        {
+          char escaped = text[position++];
+
+          if (isClassEscape(escaped))
+          {
+            addEscapeClass(escaped, node.set);
+            continue;
+          }
+
+          low = escapedByte(escaped);
+        }
+
+        unsigned char high = low;
+
+        if (position + 1 < text.size() && peek() == '-' && text[position + 1] != ']')
+        {
+          position++;
+          high = text[position++];
+
+          if (high == '\\' && !atEnd())
+            high = escapedByte(text[position++]);
+
+          if (high < low)
+          {
+            failure = "BAD RANGE";
+            return node;
+          }
+        }
+
+        for (int b = low; b <= high; b++)
+          node.set.set(b);
+      }
+
+      if (atEnd())
+      {
+        failure = "UNMATCHED [";
+        return node;
+      }
+      position++;
+
+      if (negate)
+        node.set.flip();
+
+      return node;
+    }
+
+    Node atom()
+    {
+      char c = text[position++];
+      Node node = {Node::SET, {}, {}};
+
+      switch (c)
+      {
+      case '(':
+        node = alternation();
+        if (atEnd() || peek() != ')')
+          failure = "UNMATCHED (";
+        else
+          position++;
+        return node;
+
+      case '[':
+        return bracket();
+
+      case '.':
+        node.set.set();
+        node.set.reset('\n');
+        return node;
+
+      case '^':
+        return {Node::BOL, {}, {}};
+
+      case '$':
+        return {Node::EOL, {}, {}};
+
+      case '*':
+      case '+':
+      case '?':
+        failure = "NOTHING TO REPEAT";
+        return node;
+
+      case '\\':
+        if (atEnd())
+        {
+          failure = "TRAILING \\";
+          return node;
+        }
+
+        c = text[position++];
+
+        if (isClassEscape(c))
+          addEscapeClass(c, node.set);
+        else
+          node.set.set(escapedByte(c));
+        return node;
+
+      default:
+        node.set.set((unsigned char)c);
+        return node;
+      }
+    }
+  };
+
+  struct NfaState
+  {
+    enum Type
+    {
+      SET,
+      SPLIT,
+      EMPTY,
+      BOL,
+      EOL,
+      MATCH
+    } type;
+
+    int next = -1, alt = -1;
+    int set = -1;
+  };
+}
+
+// Builds the automata: pattern to syntax tree, tree to a Thompson NFA, NFA
+// to DFAs by subset construction.
+class RegexCompiler
+{
+public:
+  RegexCompiler(Regex &regex) : regex(regex) {}
+
+  bool compile(std::string_view pattern, std::string &error)
+  {
+    Node root;
+    Parser parser(pattern);
+
+    if (!parser.parse(root, error))
+      return false;
+
+    regex.literal = requiredLiteral(root);
+    regex.literalOnly = !regex.literal.empty() && isPlainSequence(root);
+
+    states.push_back({NfaState::MATCH});
+    nfaStart = build(root, 0);
+
+    if (states.size() > MAX_NFA_STATES)
+    {
+      error = "PATTERN TOO LARGE";
+      return false;
+    }
+
+    computeByteClasses();
+
+    std::vector<int> emptyLine = closure({nfaStart}, true, true);
+    regex.matchesEmptyLine = std::binary_search(emptyLine.begin(), emptyLine.end(), 0);
+
+    if (!determinize(regex.anchored, false) || !determinize(regex.unanchored, true))
+    {
+      error = "PATTERN TOO COMPLEX";
+      return false;
+    }
+
+    return true;
+  }
+
+private:
+  Regex &regex;
+  std::vector<NfaState> states;
+  std::vector<std::bitset<256>> sets;
+  int nfaStart = 0;
+
+  int add(NfaState state)
+  {
+    states.push_back(state);
+    return states.size() - 1;
+  }
+
+  // Compiles node so that it continues to `next`; returns its entry state.
+  int build(const Node &node, int next)
+  {
+    if (states.size() > MAX_NFA_STATES)
+      return next;
+
+    switch (node.kind)
+    {
+    case Node::SET:
+      sets.push_back(node.set);
+      return add({NfaState::SET, next, -1, (int)sets.size() - 1});
+
+    case Node::CONCAT:
+      for (size_t i = node.children.size(); i-- > 0;)
+        next = build(node.children[i], next);
+      return next;
+
+    case Node::ALT:
+    {
+      int entry = build(node.children.back(), next);
+
+      for (size_t i = node.children.size() - 1; i-- > 0;)
+        entry = add({NfaState::SPLIT, build(node.children[i], next), entry});
+
+      return entry;
+    }
+
+    case Node::STAR:
+    case Node::PLUS:
+    {
+      int loop = add({NfaState::SPLIT, -1, next});
+      int body = build(node.children[0], loop);
+
+      states[loop].next = body;
+      return node.kind == Node::STAR ? loop : body;
+    }
+
+    case Node::QUEST:
+      return add({NfaState::SPLIT, build(node.children[0], next), next});
+
+    case Node::BOL:
+      return add({NfaState::BOL, next});
+
+    case Node::EOL:
+      return add({NfaState::EOL, next});
+
+    case Node::EMPTY:
+      return next;
+    }
+
+    return next;
+  }
+
+  // The longest run of single characters in the pattern's top-level
+  // sequence, which any match has to contain.
+  static std::string requiredLiteral(const Node &root)
+  {
+    std::vector<const Node *> items;
+
+    if (root.kind == Node::CONCAT)
+      for (const Node &child : root.children)
+        items.push_back(&child);
+    else
+      items.push_back(&root);
+
+    std::string best, run;
+
+    for (const Node *item : items)
+    {
+      const Node *single = item->kind == Node::PLUS ? &item->children[0] : item;
+
+      if (isSingleByte(*single))
+      {
+        for (int b = 0; b < 256; b++)
+          if (single->set[b])
+            run += (char)b;
+      }
+      else if (item->kind != Node::BOL && item->kind != Node::EOL && item->kind != Node::EMPTY)
+      {
+        run.clear();
+      }
+
+      if (run.size() > best.size())
+        best = run;
+
+      // a+ contributes one a, but what follows is not adjacent to it.
+      if (item->kind == Node::PLUS)
+        run.clear();
+    }
+
+    return best;
+  }
+
+  static bool isSingleByte(const Node &node)
+  {
+    return node.kind == Node::SET && node.set.count() == 1;
+  }
+
+  static bool isPlainSequence(const Node &root)
+  {
+    if (root.kind != Node::CONCAT)
+      return isSingleByte(root);
+
+    return std::all_of(root.children.begin(), root.children.end(), isSingleByte);
+  }
+
+  // Splits the bytes into classes that every character set in the pattern
+  // either wholly contains or wholly excludes.
+  void computeByteClasses()
+  {
+    int count = 1;
+    std::fill(regex.byteClass, regex.byteClass + 256, 0);
+
+    for (const std::bitset<256> &set : sets)
+    {
+      std::map<std::pair<int, bool>, int> renamed;
+      int next = 0;
+
+      for (int b = 0; b < 256; b++)
+      {
+        auto key = std::make_pair((int)regex.byteClass[b], (bool)set[b]);
+        auto found = renamed.find(key);
+
+        if (found == renamed.end())
+          found = renamed.emplace(key, next++).first;
+
+        regex.byteClass[b] = found->second;
+      }
+
+      count = next;
+    }
+
+    regex.classCount = count;
+  }
+
+  // Follows empty moves from seeds, BOL ones only at a line's start and EOL
+  // ones only at its end.
+  std::vector<int> closure(const std::vector<int> &seeds, bool atStart, bool atEnd) const
+  {
+    std::vector<int> result, stack(seeds);
+    std::vector<bool> seen(states.size());
+
+    while (!stack.empty())
+    {
+      int s = stack.back();
+      stack.pop_back();
+
+      if (s < 0 || seen[s])
+        continue;
+      seen[s] = true;
+
+      const NfaState &state = states[s];
+
+      switch (state.type)
+      {
+      case NfaState::SPLIT:
+        stack.push_back(state.alt);
+        stack.push_back(state.next);
+        break;
+      case NfaState::EMPTY:
+        stack.push_back(state.next);
+        break;
+      case NfaState::BOL:
+        if (atStart)
+          stack.push_back(state.next);
+        break;
+      case NfaState::EOL:
+        result.push_back(s);
+        if (atEnd)
+          stack.push_back(state.next);
+        break;
+      default:
+        result.push_back(s);
+        break;
+      }
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+  }
+
+  bool determinize(Regex::Automaton &automaton, bool isUnanchored)
+  {
+    std::map<std::vector<int>, int32_t> ids;
+    std::vector<std::vector<int>> pending;
+    int classes = regex.classCount;
+
+    automaton.next.clear();
+    automaton.accepts.clear();
+    automaton.acceptsAtEnd.clear();
+
+    auto intern = [&](std::vector<int> key) -> int32_t
+    {
+      auto found = ids.find(key);
+      if (found != ids.end())
+        return found->second;
+
+      int32_t id = pending.size();
+      ids.emplace(key, id);
+
+      bool accepts = std::binary_search(key.begin(), key.end(), 0);
+      std::vector<int> atEnd = closure(key, false, true);
+
+      automaton.accepts.push_back(accepts);
+      automaton.acceptsAtEnd.push_back(accepts || std::binary_search(atEnd.begin(), atEnd.end(), 0));
+      automaton.next.resize(automaton.next.size() + classes, Regex::DEAD);
+      pending.push_back(std::move(key));
+      return id;
+    };
+
+    // State 0 is the dead state: no NFA states left.
+    intern({});
+
+    for (int atStart = 0; atStart < 2; atStart++)
+      automaton.start[atStart] = intern(closure({nfaStart}, atStart, false));
+
+    for (size_t id = 1; id < pending.size(); id++)
+    {
+      if (pending.size() > MAX_DFA_STATES)
+        return false;
+
+      for (int c = 0; c < classes; c++)
+      {
+        int representative = std::find(regex.byteClass, regex.byteClass + 256, c) - regex.byteClass;
+        std::vector<int> seeds;
+
+        for (int s : pending[id])
+          if (states[s].type == NfaState::SET && sets[states[s].set][representative])
+            seeds.push_back(states[s].next);
+
+        if (isUnanchored)
+          seeds.push_back(nfaStart);
+
+        int32_t target = intern(closure(seeds, false, false));
+        automaton.next[id * classes + c] = target;
+      }
+    }
+
+    return pending.size() <= MAX_DFA_STATES;
+  }
+};
+
+bool Regex::compile(std::string_view pattern, std::string &error)
+{
+  *this = Regex();
+
+  RegexCompiler compiler(*this);
+  return compiler.compile(pattern, error);
+}
+
+bool Regex::search(std::string_view line, size_t from, size_t &start, size_t &length) const
+{
+  if (classCount == 0 || from > line.size())
+    return false;
+
+  const unsigned char *bytes = (const unsigned char *)line.data();
+  size_t size = line.size();
+
+  if (size == 0)
+  {
+    start = length = 0;
+    return matchesEmptyLine;
+  }
+
+  // Where the earliest-ending match ends; the leftmost match starts no
+  // later than that.
+  int32_t state = unanchored.start[from == 0];
+  size_t earliestEnd = SIZE_MAX;
+
+  if (unanchored.accepts[state])
+    earliestEnd = from;
+
+  for (size_t i = from; i < size && earliestEnd == SIZE_MAX; i++)
+  {
+    state = step(unanchored, state, bytes[i]);
+
+    if (unanchored.accepts[state])
+      earliestEnd = i + 1;
+  }
+
+  if (earliestEnd == SIZE_MAX)
+  {
+    if (!unanchored.acceptsAtEnd[state])
+      return false;
+    earliestEnd = size;
+  }
+
+  // Every start up to there is a candidate, and their anchored runs go
+  // forward together. Runs that meet in one state have the same future, so
+  // only the earliest-starting one is kept, which makes the scan linear in
+  // the line times the number of distinct states live at once.
+  struct Run
+  {
+    int32_t state;
+    size_t start;
+  };
+
+  std::vector<Run> runs;
+  std::vector<size_t> seenAt(anchored.accepts.size(), SIZE_MAX);
+  size_t bestStart = SIZE_MAX, bestEnd = 0;
+
+  for (size_t i = from;; i++)
+  {
+    // Later starts lose to one that has matched already.
+    if (i <= earliestEnd && bestStart == SIZE_MAX)
+      runs.push_back({anchored.start[i == 0], i});
+
+    // Runs are in order of their starts.
+    size_t kept = 0;
+
+    for (const Run &run : runs)
+    {
+      if (run.start > bestStart)
+        break;
+
+      if (i == size ? anchored.acceptsAtEnd[run.state] : anchored.accepts[run.state])
+        if (run.start < bestStart || i > bestEnd)
+        {
+          bestStart = run.start;
+          bestEnd = i;
+        }
+
+      runs[kept++] = run;
+    }
+
+    runs.resize(kept);
+
+    if (i == size || (runs.empty() && (i >= earliestEnd || bestStart != SIZE_MAX)))
+      break;
+
+    kept = 0;
+
+    for (Run run : runs)
+    {
+      run.state = step(anchored, run.state, bytes[i]);
+
+      if (run.state == DEAD || seenAt[run.state] == i)
+        continue;
+
+      seenAt[run.state] = i;
+      runs[kept++] = run;
+    }
+
+    runs.resize(kept);
+  }
+
+  if (bestStart == SIZE_MAX)
+    return false;
+
+  start = bestStart;
+  length = bestEnd - bestStart;
+  return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A regular expression compiled into DFAs, safe to share between threads.
+// Supports literals, ., [classes], \d \w \s and their negations, grouping,
+// |, *, +, ?, {m,n}, ^ and $. Matches are leftmost-longest within a line.
+class Regex
+{
+public:
+  // Returns false and sets error if the pattern is invalid or its automaton
+  // would be too large.
+  bool compile(std::string_view pattern, std::string &error);
+
+  // Finds the leftmost-longest match starting at or after `from`.
+  bool search(std::string_view line, size_t from, size_t &start, size_t &length) const;
+
+  // A string every match contains, if the pattern has one. Scans can look
+  // for it first at memory speed and skip lines without it.
+  const std::string &requiredLiteral() const { return literal; }
+
+  // Whether the pattern matches exactly requiredLiteral() and nothing else,
+  // in which case a plain substring search gives the same matches.
+  bool isLiteral() const { return literalOnly; }
+
+private:
+  // Rows of `next` are indexed by byte class, not by byte: bytes that no
+  // part of the pattern tells apart share a column.
+  struct Automaton
+  {
+    std::vector<int32_t> next;
+    std::vector<uint8_t> accepts, acceptsAtEnd;
+    int32_t start[2] = {0, 0};
+  };
+
+  static constexpr int32_t DEAD = 0;
+
+  uint8_t byteClass[256] = {};
+  int classCount = 0;
+
+  // `anchored` matches from a given position only; `unanchored` finds where
+  // the earliest match ends.
+  Automaton anchored, unanchored;
+  std::string literal;
+  bool literalOnly = false;
+
+  // An empty line is at once a line start and a line end, which the
+  // automata track separately.
+  bool matchesEmptyLine = false;
+
+  int32_t step(const Automaton &automaton, int32_t state, unsigned char c) const
+  {
+    return automaton.next[(size_t)state * classCount + byteClass[c]];
+  }
+
+  friend class RegexCompiler;
+};
@@ -0,0 +1,220 @@
+#include "render.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "utf8.h"
+
+void beginFrame(Renderer &r, int rows, int cols)
+{
+  if (r.next.rows == rows && r.next.cols == cols)
+    return;
+
+  // After a resize nothing on the terminal can be trusted, so every cell of
+  // the new size counts as changed.
+  for (Frame *frame : {&r.next, &r.shown})
+  {
+    frame->rows = rows;
+    frame->cols = cols;
+    frame->cells.assign((size_t)rows * cols, ' ');
+    frame->glyphs.assign((size_t)rows * cols, 0);
+    frame->hasGlyphs.assign(rows, 0);
+  }
+
+  std::fill(r.shown.cells.begin(), r.shown.cells.end(), 0);
+  r.resized = true;
+}
+
+void clearRow(Frame &frame, int y)
+{
+  std::fill(frame.row(y), frame.row(y) + frame.cols, (chtype)' ');
+
+  if (frame.hasGlyphs[y])
+  {
+    std::fill(frame.glyphRow(y), frame.glyphRow(y) + frame.cols, 0);
+    frame.hasGlyphs[y] = 0;
+  }
+}
+
+// Writes UTF-8 text into a row from column x, clipped to the frame. Returns
+// the number of cells written.
+int putText(Frame &frame, int y, int x, const char *text, int length, attr_t attr)
+{
+  if (y < 0 || y >= frame.rows || x >= frame.cols)
+    return 0;
+
+  chtype *cells = frame.row(y);
+  uint32_t *glyphs = frame.glyphRow(y);
+  int count = std::min(length, frame.cols - x);
+  unsigned char high = 0;
+
+  // ASCII text, one byte to a cell, is told apart and copied by loops the
+  // compiler vectorizes.
+  for (int i = 0; i < count; i++)
+    high |= text[i];
+
+  int ascii = count;
+
+  if (high >= 0x80)
+    for (ascii = 0; (unsigned char)text[ascii] < 0x80; ascii++)
+      ;
+
+  for (int i = 0; i < ascii; i++)
+  {
+    unsigned char c = text[i];
+    cells[x + i] = (c < ' ' || c == 127 ? ' ' : c) | attr;
+  }
+
+  if (frame.hasGlyphs[y])
+    std::fill(glyphs + x, glyphs + x + ascii, 0);
+
+  if (ascii == count)
+    return count;
+
+  std::string_view view(text, length);
+  int column = x + ascii;
+
+  for (int i = ascii; i < length && column < frame.cols;)
+  {
+    char32_t glyph;
+    i += decodeUtf8(view, i, glyph);
+    int width = charWidth(glyph);
+
+    if (width == 0)
+      continue;
+
+    if (glyph < 0xA0 || column + width > frame.cols)
+    {
+      bool printable = glyph >= ' ' && glyph < 127;
+      cells[column] = (printable ? glyph : ' ') | attr;
+      glyphs[column++] = 0;
+      continue;
+    }
+
+    frame.hasGlyphs[y] = 1;
+    cells[column] = Frame::NON_ASCII | attr;
+    glyphs[column++] = glyph;
+
+    if (width == 2)
+    {
+      cells[column] = Frame::NON_ASCII | attr;
+      glyphs[column++] = Frame::WIDE_TAIL;
+    }
+  }
+
+  return column - x;
+}
+
+void putAttr(Frame &frame, int y, int x, int length, attr_t attr)
+{
+  if (y < 0 || y >= frame.rows)
+    return;
+
+  int first = std::max(0, x);
+  int last = std::min(frame.cols, x + length);
+  chtype *cells = frame.row(y);
+
+  for (int i = first; i < last; i++)
+    cells[i] = (cells[i] & A_CHARTEXT) | attr;
+}
+
+static bool isAsciiRow(const chtype *cells, int count)
+{
+  for (int i = 0; i < count; i++)
+    if ((cells[i] & A_CHARTEXT) >= 0x80)
+      return false;
+
+  return true;
+}
+
+// Rows beyond ASCII are rewritten whole, for the terminal to lay out.
+static void writeMultibyteRow(const chtype *cells, const uint32_t *glyphs, int y, int cols)
+{
+  std::vector<char> run;
+
+  move(y, 0);
+
+  for (int start = 0; start < cols;)
+  {
+    attr_t attr = cells[start] & ~A_CHARTEXT;
+    int end = start;
+
+    run.clear();
+    for (; end < cols && (cells[end] & ~A_CHARTEXT) == attr; end++)
+    {
+      char bytes[4];
+
+      if (glyphs[end] == Frame::WIDE_TAIL)
+        continue;
+
+      if (glyphs[end])
+        run.insert(run.end(), bytes, bytes + encodeUtf8(glyphs[end], bytes));
+      else
+        run.push_back(cells[end] & A_CHARTEXT);
+    }
+
+    attrset(attr);
+    addnstr(run.data(), run.size());
+    start = end;
+  }
+
+  attrset(A_NORMAL);
+  clrtoeol();
+}
+
+bool sameRow(Frame &a, Frame &b, int y)
+{
+  if (memcmp(a.row(y), b.row(y), a.cols * sizeof(chtype)) != 0)
+    return false;
+
+  return !(a.hasGlyphs[y] || b.hasGlyphs[y]) || memcmp(a.glyphRow(y), b.glyphRow(y), a.cols * sizeof(uint32_t)) == 0;
+}
+
+void copyRow(Frame &from, Frame &to, int y)
+{
+  std::copy(from.row(y), from.row(y) + from.cols, to.row(y));
+
+  if (from.hasGlyphs[y] || to.hasGlyphs[y])
+    std::copy(from.glyphRow(y), from.glyphRow(y) + from.cols, to.glyphRow(y));
+
+  to.hasGlyphs[y] = from.hasGlyphs[y];
+}
+
+void flushFrame(Renderer &r)
+{
+  Frame &next = r.next, &shown = r.shown;
+
+  if (r.resized)
+  {
+    clearok(stdscr, TRUE);
+    r.resized = false;
+  }
+
+  for (int y = 0; y < next.rows; y++)
+  {
+    chtype *now = next.row(y), *before = shown.row(y);
+
+    if (sameRow(next, shown, y))
+      continue;
+
+    if (isAsciiRow(now, next.cols) && isAsciiRow(before, next.cols))
+    {
+      int first = 0, last = next.cols - 1;
+      while (now[first] == before[first])
+        first++;
+      while (now[last] == before[last])
+        last--;
+
+      mvaddchnstr(y, first, now + first, last - first + 1);
+    }
+    else
+    {
+      writeMultibyteRow(now, next.glyphRow(y), y, next.cols);
+    }
+
+    copyRow(next, shown, y);
+  }
+
+  move(r.cursorY, r.cursorX);
+}
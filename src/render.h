@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ncurses.h>
+#include <cstdint>
+#include <vector>
+
+// A screen's worth of cells. Each refresh composes rows into `next`, and
+// flushFrame() writes only the cells that differ from `shown`. Characters
+// beyond ASCII are kept in `glyphs`, with WIDE_TAIL after wide ones.
+struct Frame
+{
+  static const chtype NON_ASCII = 0x80;
+  static const uint32_t WIDE_TAIL = UINT32_MAX;
+
+  int rows = 0, cols = 0;
+  std::vector<chtype> cells;
+  std::vector<uint32_t> glyphs;
+  std::vector<char> hasGlyphs;
+
+  chtype *row(int y) { return &cells[(size_t)y * cols]; }
+  uint32_t *glyphRow(int y) { return &glyphs[(size_t)y * cols]; }
+};
+
+// Where the cursor goes is composed along with the cells.
+struct Renderer
+{
+  Frame next, shown;
+  int cursorY = 0, cursorX = 0;
+  bool resized = false;
+};
+
+void beginFrame(Renderer &r, int rows, int cols);
+
+void clearRow(Frame &frame, int y);
+int putText(Frame &frame, int y, int x, const char *text, int length, attr_t attr);
+void putAttr(Frame &frame, int y, int x, int length, attr_t attr);
+
+// Whether row y reads the same in both frames, and copying it over.
+bool sameRow(Frame &a, Frame &b, int y);
+void copyRow(Frame &from, Frame &to, int y);
+
+void flushFrame(Renderer &r);
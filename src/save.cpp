@@ -0,0 +1,153 @@
+#include "save.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+// Pieces handed to one writev() call; Linux accepts up to 1024.
+static const size_t WRITE_BATCH = 1024;
+
+// Attempts at finding an unused temporary file name.
+static const int TEMP_ATTEMPTS = 100;
+
+static bool writePieces(int fd, const std::vector<std::string_view> &pieces)
+{
+  std::vector<iovec> batch;
+  size_t next = 0, offset = 0;
+
+  while (next < pieces.size())
+  {
+    batch.clear();
+
+    for (size_t i = next; i < pieces.size() && batch.size() < WRITE_BATCH; i++)
+    {
+      size_t skip = i == next ? offset : 0;
+      batch.push_back({(void *)(pieces[i].data() + skip), pieces[i].size() - skip});
+    }
+
+    ssize_t written = writev(fd, batch.data(), batch.size());
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    // Short writes are normal for very large batches; resume where the
+    // kernel stopped.
+    for (size_t left = written; left > 0;)
+    {
+      size_t remaining = pieces[next].size() - offset;
+
+      if (left < remaining)
+      {
+        offset += left;
+        left = 0;
+      }
+      else
+      {
+        left -= remaining;
+        next++;
+        offset = 0;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Saving through a symlink replaces the file it points to, not the link.
+static std::string resolveTarget(const std::string &fileName)
+{
+  char *resolved = realpath(fileName.c_str(), nullptr);
+
+  if (!resolved)
+    return fileName;
+
+  std::string target = resolved;
+  free(resolved);
+  return target;
+}
+
+static void syncDirectory(const std::string &dir)
+{
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (fd >= 0)
+  {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+SaveResult writeSnapshot(const std::string &fileName, const TextSnapshot &snapshot, bool sync)
+{
+  auto start = std::chrono::steady_clock::now();
+  SaveResult result;
+
+  std::string target = resolveTarget(fileName);
+  size_t slash = target.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : target.substr(0, slash + 1);
+  std::string base = slash == std::string::npos ? target : target.substr(slash + 1);
+
+  struct stat info;
+  bool exists = stat(target.c_str(), &info) == 0;
+  mode_t mode = exists ? info.st_mode & 07777 : 0666;
+
+  std::string temp;
+  int fd = -1;
+
+  for (int attempt = 0; attempt < TEMP_ATTEMPTS && fd < 0; attempt++)
+  {
+    temp = dir + (slash == std::string::npos ? "/." : ".") + base + "." + std::to_string(getpid()) + "-" + std::to_string(attempt) + ".tmp";
+    fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+
+    if (fd < 0 && errno != EEXIST)
+      break;
+  }
+
+  if (fd < 0)
+  {
+    result.error = strerror(errno);
+    return result;
+  }
+
+  // New files get the usual umask-filtered mode from open(); existing ones
+  // keep theirs.
+  bool ok = (!exists || fchmod(fd, mode) == 0) && writePieces(fd, snapshot.pieces) && (!sync || fsync(fd) == 0);
+  int error = errno;
+
+  if (close(fd) != 0 && ok)
+  {
+    ok = false;
+    error = errno;
+  }
+
+  if (ok && rename(temp.c_str(), target.c_str()) != 0)
+  {
+    ok = false;
+    error = errno;
+  }
+
+  if (!ok)
+  {
+    unlink(temp.c_str());
+    result.error = strerror(error);
+    return result;
+  }
+
+  if (sync)
+    syncDirectory(dir);
+
+  result.ok = true;
+  result.bytes = snapshot.size;
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return result;
+}
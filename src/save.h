@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "buffer.h"
+
+struct SaveResult
+{
+  bool ok = false;
+  std::string error;
+  size_t bytes = 0;
+  double seconds = 0;
+};
+
+// Writes the snapshot to a temporary file beside fileName and renames it
+// over fileName; with sync, flushed to disk first. Safe on any thread.
+SaveResult writeSnapshot(const std::string &fileName, const TextSnapshot &snapshot, bool sync);
@@ -0,0 +1,373 @@
+#include "search.h"
+
+#include <algorithm>
+
+#include "simd.h"
+
+// previous() searches backwards in blocks of this many lines, keeping the
+// last match of the nearest block that has one.
+static const size_t REVERSE_BLOCK_LINES = 16384;
+
+// Parallel scans split the buffer into this many tasks per thread, so that
+// threads that finish early can pick up the slack.
+static const size_t TASKS_PER_THREAD = 4;
+
+// Where in its run a match at `offset` falls.
+static TextPos locateInRun(size_t runStart, std::string_view run, size_t offset)
+{
+  size_t lineStart = run.rfind('\n', offset);
+  lineStart = lineStart == std::string_view::npos ? 0 : lineStart + 1;
+
+  return {runStart + countByte(run.data(), lineStart, '\n'), offset - lineStart};
+}
+
+static size_t lineStartIn(std::string_view run, size_t offset)
+{
+  size_t newline = offset == 0 ? std::string_view::npos : run.rfind('\n', offset - 1);
+  return newline == std::string_view::npos ? 0 : newline + 1;
+}
+
+static size_t lineEndIn(std::string_view run, size_t offset)
+{
+  size_t newline = run.find('\n', offset);
+  return newline == std::string_view::npos ? run.size() : newline;
+}
+
+// Splits lines [0, lines) into contiguous ranges, one per task.
+static void forEachChunk(WorkerPool &pool, size_t lines, const std::function<void(size_t, size_t, size_t)> &fn)
+{
+  size_t tasks = std::max<size_t>(1, std::min(lines, pool.size() * TASKS_PER_THREAD));
+
+  pool.run(tasks, [&](size_t task)
+           { fn(task, lines * task / tasks, lines * (task + 1) / tasks); });
+}
+
+void Search::setPattern(std::string pattern)
+{
+  if (pattern != needle || isRegex)
+    isCounted = false;
+
+  needle = std::move(pattern);
+  isRegex = false;
+}
+
+bool Search::setRegex(std::string pattern, std::string &error)
+{
+  Regex compiled;
+
+  if (!compiled.compile(pattern, error))
+    return false;
+
+  // A pattern without any special characters is searched for as text,
+  // which skips the automaton altogether.
+  if (compiled.isLiteral())
+  {
+    setPattern(compiled.requiredLiteral());
+    return true;
+  }
+
+  regex = std::move(compiled);
+  needle = std::move(pattern);
+  isRegex = true;
+  isCounted = false;
+  return true;
+}
+
+bool Search::matchInLine(std::string_view line, size_t from, size_t &start, size_t &length) const
+{
+  if (isRegex)
+    return regex.search(line, from, start, length);
+
+  if (from > line.size())
+    return false;
+
+  size_t found = findSubstring(line.data() + from, line.size() - from, needle.data(), needle.size());
+
+  if (found == SIZE_MAX)
+    return false;
+
+  start = from + found;
+  length = needle.size();
+  return true;
+}
+
+// The first match at or after offset `from` of a run of lines. A regex only
+// runs on lines holding the literal it requires.
+bool Search::matchInRun(std::string_view run, size_t from, size_t &start, size_t &length, RunLine &line) const
+{
+  if (!isRegex)
+    return matchInLine(run, from, start, length);
+
+  const std::string &literal = regex.requiredLiteral();
+
+  for (size_t position = from; position <= run.size();)
+  {
+    size_t candidate = position;
+
+    if (!literal.empty())
+    {
+      size_t found = findSubstring(run.data() + position, run.size() - position, literal.data(), literal.size());
+
+      if (found == SIZE_MAX)
+        return false;
+      candidate += found;
+    }
+
+    if (!line.known || candidate < line.start || candidate > line.end)
+      line = {lineStartIn(run, candidate), lineEndIn(run, candidate), true};
+
+    std::string_view text = run.substr(line.start, line.end - line.start);
+
+    if (regex.search(text, std::max(position, line.start) - line.start, start, length))
+    {
+      start += line.start;
+      return true;
+    }
+
+    position = line.end + 1;
+  }
+
+  return false;
+}
+
+// Calls fn(start, length) for the non-overlapping matches of a run.
+template <typename Fn>
+void Search::forEachMatchInRun(std::string_view run, Fn &&fn) const
+{
+  size_t start, length;
+  RunLine line;
+
+  for (size_t position = 0; matchInRun(run, position, start, length, line); position = start + std::max<size_t>(length, 1))
+    fn(start, length);
+}
+
+size_t Search::findLastInLine(std::string_view line, size_t before) const
+{
+  size_t last = SIZE_MAX, start, length;
+
+  for (size_t position = 0; matchInLine(line, position, start, length) && start < before; position = start + 1)
+    last = start;
+
+  return last;
+}
+
+bool Search::findInRange(const TextBuffer &buffer, size_t first, size_t last, TextPos &match) const
+{
+  bool found = false;
+
+  buffer.forEachRun(first, last, [&](size_t runStart, std::string_view run)
+                    {
+                      size_t start, length;
+                      RunLine line;
+
+                      if (!matchInRun(run, 0, start, length, line))
+                        return true;
+
+                      match = locateInRun(runStart, run, start);
+                      found = true;
+                      return false; });
+
+  return found;
+}
+
+bool Search::findLastInRange(const TextBuffer &buffer, size_t first, size_t last, TextPos &match) const
+{
+  bool found = false;
+
+  buffer.forEachRun(first, last, [&](size_t runStart, std::string_view run)
+                    {
+                      // Overlapping matches count, as they would for next().
+                      size_t lastStart = SIZE_MAX, start, length;
+                      RunLine line;
+
+                      for (size_t position = 0; matchInRun(run, position, start, length, line); position = start + 1)
+                        lastStart = start;
+
+                      if (lastStart != SIZE_MAX)
+                      {
+                        match = locateInRun(runStart, run, lastStart);
+                        found = true;
+                      }
+
+                      return true; });
+
+  return found;
+}
+
+bool Search::next(const TextBuffer &buffer, TextPos from, TextPos &match) const
+{
+  if (!active() || from.line >= buffer.size())
+    return false;
+
+  std::string_view line = buffer.line(from.line);
+  size_t start, length;
+
+  if (matchInLine(line, from.column, start, length))
+  {
+    match = {from.line, start};
+    return true;
+  }
+
+  if (findInRange(buffer, from.line + 1, buffer.size(), match) || findInRange(buffer, 0, from.line, match))
+    return true;
+
+  if (!matchInLine(line, 0, start, length))
+    return false;
+
+  match = {from.line, start};
+  return true;
+}
+
+bool Search::previous(const TextBuffer &buffer, TextPos before, TextPos &match) const
+{
+  if (!active() || before.line >= buffer.size())
+    return false;
+
+  std::string_view line = buffer.line(before.line);
+  size_t column = findLastInLine(line, before.column);
+
+  if (column != SIZE_MAX)
+  {
+    match = {before.line, column};
+    return true;
+  }
+
+  // Lines above the cursor, nearest block first, then from the end of the
+  // buffer back down to the cursor's line.
+  for (size_t end = before.line; end > 0; end -= std::min(end, REVERSE_BLOCK_LINES))
+    if (findLastInRange(buffer, end - std::min(end, REVERSE_BLOCK_LINES), end, match))
+      return true;
+
+  for (size_t end = buffer.size(); end > before.line + 1; end -= std::min(end - before.line - 1, REVERSE_BLOCK_LINES))
+    if (findLastInRange(buffer, std::max(before.line + 1, end - std::min(end, REVERSE_BLOCK_LINES)), end, match))
+      return true;
+
+  column = findLastInLine(line, SIZE_MAX);
+
+  if (column == SIZE_MAX)
+    return false;
+
+  match = {before.line, column};
+  return true;
+}
+
+size_t Search::count(const TextBuffer &buffer, WorkerPool &pool)
+{
+  if (isCounted && countedVersion == buffer.version())
+    return cachedCount;
+
+  cachedCount = 0;
+
+  if (active())
+  {
+    std::vector<size_t> counts(pool.size() * TASKS_PER_THREAD);
+
+    forEachChunk(pool, buffer.size(), [&](size_t task, size_t first, size_t last)
+                 { buffer.forEachRun(first, last, [&](size_t, std::string_view run)
+                                     {
+                                       forEachMatchInRun(run, [&](size_t, size_t)
+                                                         { counts[task]++; });
+                                       return true; }); });
+
+    for (size_t count : counts)
+      cachedCount += count;
+  }
+
+  countedVersion = buffer.version();
+  isCounted = true;
+  return cachedCount;
+}
+
+void Search::matchesInLine(std::string_view line, std::vector<std::pair<size_t, size_t>> &matches) const
+{
+  if (!active())
+    return;
+
+  forEachMatchInRun(line, [&](size_t start, size_t length)
+                    { matches.emplace_back(start, length); });
+}
+
+// Appends the replacement for one match, with \0 standing for the match and
+// a backslash escaping the character after it.
+static void expandReplacement(std::string &out, std::string_view replacement, std::string_view matched)
+{
+  for (size_t i = 0; i < replacement.size(); i++)
+  {
+    if (replacement[i] != '\\' || i + 1 == replacement.size())
+    {
+      out += replacement[i];
+      continue;
+    }
+
+    char escaped = replacement[++i];
+
+    if (escaped == '0')
+      out += matched;
+    else
+      out += escaped;
+  }
+}
+
+std::vector<LineReplacement> Search::replaceAll(const TextBuffer &buffer, std::string_view replacement, WorkerPool &pool, size_t &count) const
+{
+  std::vector<std::vector<LineReplacement>> results(pool.size() * TASKS_PER_THREAD);
+  std::vector<size_t> counts(results.size());
+
+  count = 0;
+
+  if (!active())
+    return {};
+
+  forEachChunk(pool, buffer.size(), [&](size_t task, size_t first, size_t last)
+               { buffer.forEachRun(first, last, [&](size_t runStart, std::string_view run)
+                                   {
+                                     std::vector<LineReplacement> &out = results[task];
+                                     std::string text;
+                                     size_t currentLine = SIZE_MAX, copied = 0, lineEnd = 0;
+                                     size_t countedTo = 0, linesBefore = 0;
+
+                                     auto finishLine = [&]()
+                                     {
+                                       if (currentLine == SIZE_MAX)
+                                         return;
+
+                                       text.append(run.data() + copied, lineEnd - copied);
+                                       out.push_back({currentLine, std::move(text)});
+                                       text.clear();
+                                     };
+
+                                     forEachMatchInRun(run, [&](size_t start, size_t length)
+                                                       {
+                                                         // Newlines are counted from the previous match's
+                                                         // line on, not from the start of the run each time.
+                                                         if (currentLine == SIZE_MAX || start > lineEnd)
+                                                         {
+                                                           size_t lineStart = lineStartIn(run, start);
+
+                                                           linesBefore += countByte(run.data() + countedTo, lineStart - countedTo, '\n');
+                                                           countedTo = lineStart;
+
+                                                           finishLine();
+                                                           currentLine = runStart + linesBefore;
+                                                           copied = lineStart;
+                                                           lineEnd = lineEndIn(run, start);
+                                                         }
+
+                                                         text.append(run.data() + copied, start - copied);
+                                                         expandReplacement(text, replacement, run.substr(start, length));
+                                                         copied = start + length;
+                                                         counts[task]++; });
+
+                                     finishLine();
+                                     return true; }); });
+
+  std::vector<LineReplacement> merged;
+
+  for (size_t task = 0; task < results.size(); task++)
+  {
+    count += counts[task];
+    std::move(results[task].begin(), results[task].end(), std::back_inserter(merged));
+  }
+
+  return merged;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "buffer.h"
+#include "edit.h"
+#include "regex.h"
+#include "workers.h"
+
+// A line's new text after a replacement.
+struct LineReplacement
+{
+  size_t line;
+  std::string text;
+};
+
+// Fixed-string or regex search over a buffer, scanning runs of unedited
+// lines as single blocks. Matches never span lines.
+class Search
+{
+public:
+  void setPattern(std::string pattern);
+  bool setRegex(std::string pattern, std::string &error);
+
+  const std::string &pattern() const { return needle; }
+  bool active() const { return !needle.empty(); }
+
+  // The first match at or after `from`, wrapping around past the end.
+  bool next(const TextBuffer &buffer, TextPos from, TextPos &match) const;
+
+  // The last match before `before`, wrapping around past the start.
+  bool previous(const TextBuffer &buffer, TextPos before, TextPos &match) const;
+
+  // Non-overlapping matches in the whole buffer, counted in parallel.
+  // Cached until the pattern or the text changes.
+  size_t count(const TextBuffer &buffer, WorkerPool &pool);
+
+  // Appends (column, length) of the non-overlapping matches in one line.
+  void matchesInLine(std::string_view line, std::vector<std::pair<size_t, size_t>> &matches) const;
+
+  // Computes in parallel the new text of every line with a match, where \0
+  // in the replacement stands for the match, and counts the matches.
+  std::vector<LineReplacement> replaceAll(const TextBuffer &buffer, std::string_view replacement, WorkerPool &pool, size_t &count) const;
+
+private:
+  std::string needle;
+  Regex regex;
+  bool isRegex = false;
+
+  size_t cachedCount = 0;
+  uint64_t countedVersion = 0;
+  bool isCounted = false;
+
+  // Bounds of the line in a run that the last regex match attempt was on,
+  // so that a long line's ends are not looked for again at every match.
+  struct RunLine
+  {
+    size_t start = 0, end = 0;
+    bool known = false;
+  };
+
+  bool matchInLine(std::string_view line, size_t from, size_t &start, size_t &length) const;
+  bool matchInRun(std::string_view run, size_t from, size_t &start, size_t &length, RunLine &line) const;
+  bool findInRange(const TextBuffer &buffer, size_t first, size_t last, TextPos &match) const;
+  bool findLastInRange(const TextBuffer &buffer, size_t first, size_t last, TextPos &match) const;
+  size_t findLastInLine(std::string_view line, size_t before) const;
+
+  template <typename Fn>
+  void forEachMatchInRun(std::string_view run, Fn &&fn) const;
+};
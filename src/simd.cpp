@@ -0,0 +1,280 @@
+#include "simd.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+static void findNewlinesScalar(const char *data, size_t length, uint64_t base, std::vector<uint64_t> &positions)
+{
+  const char *end = data + length;
+
+  for (const char *p = data; (p = (const char *)memchr(p, '\n', end - p)); p++)
+    positions.push_back(base + (p - data));
+}
+
+static size_t findSubstringScalar(const char *data, size_t length, const char *needle, size_t needleLength)
+{
+  size_t position = std::string_view(data, length).find(std::string_view(needle, needleLength));
+  return position == std::string_view::npos ? SIZE_MAX : position;
+}
+
+static size_t countByteScalar(const char *data, size_t length, char byte)
+{
+  size_t count = 0;
+
+  for (size_t i = 0; i < length; i++)
+    count += data[i] == byte;
+
+  return count;
+}
+
+// Eight bytes at a time, as lines are often too short for the vector loops.
+static size_t findNonAsciiScalar(const char *data, size_t length)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= length; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+
+    if (word & 0x8080808080808080ull)
+      break;
+  }
+
+  for (; i < length; i++)
+    if ((unsigned char)data[i] >= 0x80)
+      return i;
+
+  return SIZE_MAX;
+}
+
+#ifdef HAVE_X86_SIMD
+static void pushMask(uint32_t mask, uint64_t offset, std::vector<uint64_t> &positions)
+{
+  while (mask)
+  {
+    positions.push_back(offset + __builtin_ctz(mask));
+    mask &= mask - 1;
+  }
+}
+
+static void findNewlinesSSE2(const char *data, size_t length, uint64_t base, std::vector<uint64_t> &positions)
+{
+  const __m128i newline = _mm_set1_epi8('\n');
+  size_t i = 0;
+
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+    pushMask(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)), base + i, positions);
+  }
+
+  findNewlinesScalar(data + i, length - i, base + i, positions);
+}
+
+__attribute__((target("avx2"))) static void findNewlinesAVX2(const char *data, size_t length, uint64_t base, std::vector<uint64_t> &positions)
+{
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_t i = 0;
+
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+    pushMask(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)), base + i, positions);
+  }
+
+  findNewlinesSSE2(data + i, length - i, base + i, positions);
+}
+
+// Bit i of the mask marks a position where the needle's first and last
+// bytes both match; only those get a full comparison.
+static size_t confirmCandidates(uint32_t mask, const char *data, size_t i, const char *needle, size_t needleLength)
+{
+  while (mask)
+  {
+    size_t candidate = i + __builtin_ctz(mask);
+
+    if (memcmp(data + candidate + 1, needle + 1, needleLength - 2) == 0)
+      return candidate;
+
+    mask &= mask - 1;
+  }
+
+  return SIZE_MAX;
+}
+
+static size_t findSubstringSSE2(const char *data, size_t length, const char *needle, size_t needleLength)
+{
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+  size_t i = 0;
+
+  for (; i + needleLength - 1 + 16 <= length; i += 16)
+  {
+    __m128i blockFirst = _mm_loadu_si128((const __m128i *)(data + i));
+    __m128i blockLast = _mm_loadu_si128((const __m128i *)(data + i + needleLength - 1));
+    uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last)));
+
+    size_t found = confirmCandidates(mask, data, i, needle, needleLength);
+    if (found != SIZE_MAX)
+      return found;
+  }
+
+  size_t found = findSubstringScalar(data + i, length - i, needle, needleLength);
+  return found == SIZE_MAX ? SIZE_MAX : i + found;
+}
+
+__attribute__((target("avx2"))) static size_t findSubstringAVX2(const char *data, size_t length, const char *needle, size_t needleLength)
+{
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+  size_t i = 0;
+
+  for (; i + needleLength - 1 + 32 <= length; i += 32)
+  {
+    __m256i blockFirst = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i blockLast = _mm256_loadu_si256((const __m256i *)(data + i + needleLength - 1));
+    uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last)));
+
+    size_t found = confirmCandidates(mask, data, i, needle, needleLength);
+    if (found != SIZE_MAX)
+      return found;
+  }
+
+  size_t found = findSubstringSSE2(data + i, length - i, needle, needleLength);
+  return found == SIZE_MAX ? SIZE_MAX : i + found;
+}
+
+static size_t countByteSSE2(const char *data, size_t length, char byte)
+{
+  const __m128i target = _mm_set1_epi8(byte);
+  size_t count = 0, i = 0;
+
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+    count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, target)));
+  }
+
+  return count + countByteScalar(data + i, length - i, byte);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t countByteAVX2(const char *data, size_t length, char byte)
+{
+  const __m256i target = _mm256_set1_epi8(byte);
+  size_t count = 0, i = 0;
+
+  for (; i + 32 <= length; i += 32)
+  {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+    count += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, target)));
+  }
+
+  return count + countByteSSE2(data + i, length - i, byte);
+}
+
+// A byte of 0x80 or more has its top bit set, which movemask gathers.
+static size_t findNonAsciiSSE2(const char *data, size_t length)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= length; i += 16)
+  {
+    uint32_t mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(data + i)));
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  size_t found = findNonAsciiScalar(data + i, length - i);
+  return found == SIZE_MAX ? SIZE_MAX : i + found;
+}
+
+__attribute__((target("avx2"))) static size_t findNonAsciiAVX2(const char *data, size_t length)
+{
+  size_t i = 0;
+
+  for (; i + 64 <= length; i += 64)
+  {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + 32));
+
+    if (_mm256_movemask_epi8(_mm256_or_si256(a, b)))
+      break;
+  }
+
+  if (i + 32 <= length && !_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(data + i))))
+    i += 32;
+
+  size_t found = findNonAsciiSSE2(data + i, length - i);
+  return found == SIZE_MAX ? SIZE_MAX : i + found;
+}
+
+static bool hasAVX2()
+{
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
+void findNewlines(const char *data, size_t length, uint64_t base, std::vector<uint64_t> &positions)
+{
+#ifdef HAVE_X86_SIMD
+  if (hasAVX2())
+    findNewlinesAVX2(data, length, base, positions);
+  else
+    findNewlinesSSE2(data, length, base, positions);
+#else
+  findNewlinesScalar(data, length, base, positions);
+#endif
+}
+
+size_t findSubstring(const char *data, size_t length, const char *needle, size_t needleLength)
+{
+  if (needleLength == 0)
+    return 0;
+
+  if (needleLength > length)
+    return SIZE_MAX;
+
+  if (needleLength == 1)
+  {
+    const char *found = (const char *)memchr(data, needle[0], length);
+    return found ? found - data : SIZE_MAX;
+  }
+
+#ifdef HAVE_X86_SIMD
+  if (hasAVX2())
+    return findSubstringAVX2(data, length, needle, needleLength);
+  return findSubstringSSE2(data, length, needle, needleLength);
+#else
+  return findSubstringScalar(data, length, needle, needleLength);
+#endif
+}
+
+size_t countByte(const char *data, size_t length, char byte)
+{
+#ifdef HAVE_X86_SIMD
+  if (hasAVX2())
+    return countByteAVX2(data, length, byte);
+  return countByteSSE2(data, length, byte);
+#else
+  return countByteScalar(data, length, byte);
+#endif
+}
+
+size_t findNonAscii(const char *data, size_t length)
+{
+#ifdef HAVE_X86_SIMD
+  if (hasAVX2())
+    return findNonAsciiAVX2(data, length);
+  return findNonAsciiSSE2(data, length);
+#else
+  return findNonAsciiScalar(data, length);
+#endif
+}
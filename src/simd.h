@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Vectorized scanning kernels. Each picks AVX2 or SSE2 at runtime on x86 and
+// falls back to portable code elsewhere.
+
+// Appends base + i for every '\n' at data[i].
+void findNewlines(const char *data, size_t length, uint64_t base, std::vector<uint64_t> &positions);
+
+// Returns the offset of the first occurrence of needle in data, or SIZE_MAX.
+size_t findSubstring(const char *data, size_t length, const char *needle, size_t needleLength);
+
+// Returns how many bytes of data equal byte.
+size_t countByte(const char *data, size_t length, char byte);
+
+// Returns the offset of the first byte of 0x80 or more, which in UTF-8 text
+// is the first one that is not ASCII, or SIZE_MAX if there is none.
+size_t findNonAscii(const char *data, size_t length);
@@ -0,0 +1,255 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+#endif
+
+// Samples kept per series; the report covers only these.
+static const size_t RING_SAMPLES = 1024;
+
+// Histogram buckets are powers of two: of nanoseconds from 256 ns up for
+// timings, of the value itself for counts.
+static const int HISTOGRAM_BUCKETS = 16;
+static const int FIRST_TIME_BUCKET = 8;
+static const char HISTOGRAM_LEVELS[] = " .:-=+*#%@";
+
+struct Ring
+{
+  uint64_t samples[RING_SAMPLES];
+  size_t next = 0, filled = 0;
+  uint64_t count = 0;
+};
+
+struct SeriesInfo
+{
+  const char *name;
+  bool isTime;
+};
+
+static const SeriesInfo SERIES[STAT_SERIES_COUNT] = {
+    {"key", true},
+    {"draw", true},
+    {"highlight", true},
+    {"flush", true},
+    {"load", true},
+    {"save", true},
+    {"hl/frame", false},
+    {"alloc/frame", false},
+    {"bytes/frame", false}};
+
+static const char *const COUNTERS[STAT_COUNTER_COUNT] = {"allocations", "terminal bytes", "saved bytes"};
+
+static Ring rings[STAT_SERIES_COUNT];
+static std::atomic<uint64_t> counters[STAT_COUNTER_COUNT];
+
+uint64_t statCycles()
+{
+#ifdef HAVE_CYCLE_COUNTER
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// The cycle counter is calibrated against the clock over the whole run, so
+// there is no need to stall at startup to measure it.
+static const uint64_t startCycles = statCycles();
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static double cyclesPerNanosecond()
+{
+#ifdef HAVE_CYCLE_COUNTER
+  double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+
+  if (nanoseconds > 1e6)
+    return (statCycles() - startCycles) / nanoseconds;
+#endif
+  return 1;
+}
+
+void statRecord(StatSeries series, uint64_t value)
+{
+  Ring &ring = rings[series];
+
+  ring.samples[ring.next] = value;
+  ring.next = (ring.next + 1) % RING_SAMPLES;
+  ring.filled = std::min(ring.filled + 1, RING_SAMPLES);
+  ring.count++;
+}
+
+void statRecordSeconds(StatSeries series, double seconds)
+{
+  statRecord(series, (uint64_t)(seconds * 1e9 * cyclesPerNanosecond()));
+}
+
+void statAdd(StatCounter counter, uint64_t amount)
+{
+  counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+uint64_t statCount(StatCounter counter)
+{
+  return counters[counter].load(std::memory_order_relaxed);
+}
+
+static std::string formatValue(double value, bool isTime)
+{
+  static const char *const TIME_UNITS[] = {"ns", "us", "ms", "s"};
+  static const char *const COUNT_UNITS[] = {"", "k", "M", "G"};
+  const char *const *units = isTime ? TIME_UNITS : COUNT_UNITS;
+  int unit = 0;
+  char text[32];
+
+  for (; unit < 3 && value >= 1000; unit++)
+    value /= 1000;
+
+  if (unit == 0)
+    snprintf(text, sizeof(text), "%.0f%s", value, units[unit]);
+  else
+    snprintf(text, sizeof(text), "%.1f%s", value, units[unit]);
+
+  return text;
+}
+
+static int bucketOf(double value, bool isTime)
+{
+  int bucket = 0;
+
+  for (uint64_t v = (uint64_t)value + 1; v > 1; v >>= 1)
+    bucket++;
+
+  return std::clamp(isTime ? bucket - FIRST_TIME_BUCKET : bucket, 0, HISTOGRAM_BUCKETS - 1);
+}
+
+std::vector<std::string> statsReport()
+{
+  std::vector<std::string> lines;
+  double scale = cyclesPerNanosecond();
+  char line[160];
+
+  for (int series = 0; series < STAT_SERIES_COUNT; series++)
+  {
+    const Ring &ring = rings[series];
+    bool isTime = SERIES[series].isTime;
+
+    if (ring.filled == 0)
+    {
+      snprintf(line, sizeof(line), "%-11s %7s", SERIES[series].name, "-");
+      lines.push_back(line);
+      continue;
+    }
+
+    std::vector<double> values(ring.samples, ring.samples + ring.filled);
+
+    if (isTime)
+      for (double &value : values)
+        value /= scale;
+
+    std::sort(values.begin(), values.end());
+
+    int buckets[HISTOGRAM_BUCKETS] = {};
+    int tallest = 0;
+
+    for (double value : values)
+      tallest = std::max(tallest, ++buckets[bucketOf(value, isTime)]);
+
+    std::string histogram;
+
+    for (int count : buckets)
+      histogram += HISTOGRAM_LEVELS[count == 0 ? 0 : 1 + (count * (sizeof(HISTOGRAM_LEVELS) - 3)) / tallest];
+
+    snprintf(line, sizeof(line), "%-11s %7llu  p50 %7s  p99 %7s  max %7s  [%s]", SERIES[series].name, (unsigned long long)ring.count,
+             formatValue(values[values.size() / 2], isTime).c_str(),
+             formatValue(values[std::min(values.size() - 1, values.size() * 99 / 100)], isTime).c_str(),
+             formatValue(values.back(), isTime).c_str(), histogram.c_str());
+    lines.push_back(line);
+  }
+
+  std::string totals;
+
+  for (int counter = 0; counter < STAT_COUNTER_COUNT; counter++)
+    totals += std::string(counter ? "  " : "") + COUNTERS[counter] + " " + formatValue(statCount((StatCounter)counter), false);
+
+  lines.push_back(totals);
+  return lines;
+}
+
+void dumpStatsOnExit()
+{
+  const char *fileName = getenv("TEXTEDITOR_STATS");
+
+  if (!fileName || !*fileName)
+    return;
+
+  FILE *file = fopen(fileName, "w");
+
+  if (!file)
+    return;
+
+  for (const std::string &line : statsReport())
+    fprintf(file, "%s\n", line.c_str());
+
+  fclose(file);
+}
+
+// Every allocation in the program is counted, from any thread, and each
+// thread's also on their own. All the forms of new and delete are replaced
+// together, so that memory from any new goes back through the matching
+// delete to the same allocator.
+static thread_local uint64_t threadAllocations = 0;
+
+uint64_t statThreadAllocations()
+{
+  return threadAllocations;
+}
+
+static void *allocate(size_t size, size_t alignment)
+{
+  counters[STAT_ALLOCATIONS].fetch_add(1, std::memory_order_relaxed);
+  threadAllocations++;
+
+  if (alignment <= alignof(std::max_align_t))
+    return malloc(size ? size : 1);
+
+  void *memory = nullptr;
+  return posix_memalign(&memory, alignment, size ? size : 1) == 0 ? memory : nullptr;
+}
+
+static void *allocateOrThrow(size_t size, size_t alignment)
+{
+  if (void *memory = allocate(size, alignment))
+    return memory;
+
+  throw std::bad_alloc();
+}
+
+void *operator new(size_t size) { return allocateOrThrow(size, 0); }
+void *operator new[](size_t size) { return allocateOrThrow(size, 0); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return allocate(size, 0); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return allocate(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment) { return allocateOrThrow(size, (size_t)alignment); }
+void *operator new[](size_t size, std::align_val_t alignment) { return allocateOrThrow(size, (size_t)alignment); }
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return allocate(size, (size_t)alignment); }
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept { return allocate(size, (size_t)alignment); }
+
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete[](void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t) noexcept { free(memory); }
+void operator delete(void *memory, const std::nothrow_t &) noexcept { free(memory); }
+void operator delete[](void *memory, const std::nothrow_t &) noexcept { free(memory); }
+void operator delete(void *memory, std::align_val_t) noexcept { free(memory); }
+void operator delete[](void *memory, std::align_val_t) noexcept { free(memory); }
+void operator delete(void *memory, size_t, std::align_val_t) noexcept { free(memory); }
+void operator delete[](void *memory, size_t, std::align_val_t) noexcept { free(memory); }
+void operator delete(void *memory, std::align_val_t, const std::nothrow_t &) noexcept { free(memory); }
+void operator delete[](void *memory, std::align_val_t, const std::nothrow_t &) noexcept { free(memory); }
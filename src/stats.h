@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hot-path instrumentation: timers read the cycle counter into small rings
+// of samples, turned into latencies only by :stats or the TEXTEDITOR_STATS
+// dump. Main thread only, apart from the counters.
+enum StatSeries
+{
+  STAT_KEY,
+  STAT_DRAW,
+  STAT_HIGHLIGHT,
+  STAT_FLUSH,
+  STAT_LOAD,
+  STAT_SAVE,
+  STAT_FRAME_HIGHLIGHTS,
+  STAT_FRAME_ALLOCATIONS,
+  STAT_FRAME_BYTES,
+  STAT_SERIES_COUNT
+};
+
+enum StatCounter
+{
+  STAT_ALLOCATIONS,
+  STAT_TERMINAL_BYTES,
+  STAT_SAVED_BYTES,
+  STAT_COUNTER_COUNT
+};
+
+uint64_t statCycles();
+
+// Timing series take cycles; the others take plain counts.
+void statRecord(StatSeries series, uint64_t value);
+void statRecordSeconds(StatSeries series, double seconds);
+void statAdd(StatCounter counter, uint64_t amount);
+uint64_t statCount(StatCounter counter);
+
+// Allocations made by the calling thread, where STAT_ALLOCATIONS counts
+// those of the highlighter and worker threads too.
+uint64_t statThreadAllocations();
+
+// Times the enclosing scope into one of the timing series.
+struct StatTimer
+{
+  StatSeries series;
+  uint64_t start;
+
+  explicit StatTimer(StatSeries series) : series(series), start(statCycles()) {}
+  ~StatTimer() { statRecord(series, statCycles() - start); }
+};
+
+// One line per series, with its recent samples as percentiles and a
+// histogram, then the counter totals.
+std::vector<std::string> statsReport();
+
+// Writes statsReport() to the file named by TEXTEDITOR_STATS, if it is set.
+void dumpStatsOnExit();
@@ -0,0 +1,226 @@
+#include "undo.h"
+
+// Dropped records and text are only cleared out once they make up at least
+// this much, and half of what is held.
+static const size_t COMPACT_MIN_RECORDS = 1024;
+static const size_t COMPACT_MIN_BYTES = 64 << 10;
+
+void UndoJournal::recordInsert(TextPos at, std::string_view text, bool typed)
+{
+  record(INSERT, at, text, typed);
+}
+
+void UndoJournal::recordErase(TextPos at, std::string_view text, bool typed)
+{
+  record(ERASE, at, text, typed);
+}
+
+void UndoJournal::beginGroup()
+{
+  if (groupDepth++ == 0)
+    groupOpen = false;
+}
+
+void UndoJournal::endGroup()
+{
+  if (--groupDepth == 0)
+    seal();
+}
+
+void UndoJournal::seal()
+{
+  sealed = true;
+}
+
+// Typing extends an insertion ending where it starts, backspacing a removal
+// starting where it ends, within one line.
+bool UndoJournal::canCoalesce(Kind kind, TextPos at, std::string_view text, bool typed) const
+{
+  if (!typed || sealed || groupDepth > 0 || current == firstRecord || current != records.size())
+    return false;
+
+  const Record &last = records[current - 1];
+
+  if (!last.typed || last.kind != kind || last.line != at.line || text.find('\n') != std::string_view::npos)
+    return false;
+
+  if (kind == INSERT)
+    return last.column + last.textLength == at.column;
+
+  return at.column + text.size() == last.column;
+}
+
+void UndoJournal::record(Kind kind, TextPos at, std::string_view text, bool typed)
+{
+  if (canCoalesce(kind, at, text, typed))
+  {
+    Record &last = records[current - 1];
+
+    if (kind == INSERT)
+    {
+      arena.append(text);
+    }
+    else
+    {
+      arena.insert(last.textStart, text);
+      last.column = at.column;
+    }
+
+    last.textLength += text.size();
+  }
+  else
+  {
+    dropRedo();
+
+    records.push_back({at.line, at.column, arena.size(), text.size(), kind, typed, groupDepth > 0 && groupOpen});
+    arena.append(text);
+    current = records.size();
+
+    if (groupDepth > 0)
+      groupOpen = true;
+  }
+
+  sealed = !typed;
+  enforceCap();
+}
+
+void UndoJournal::dropRedo()
+{
+  if (current == records.size())
+    return;
+
+  records.resize(current);
+
+  if (current == firstRecord)
+    clear();
+  else
+    arena.resize(records.back().textStart + records.back().textLength);
+}
+
+bool UndoJournal::undo(TextBuffer &buffer, TextPos &cursor, const EditObserver &observer)
+{
+  if (current == firstRecord)
+    return false;
+
+  bool more;
+
+  do
+  {
+    const Record &record = records[--current];
+    TextPos at = {record.line, record.column};
+
+    if (record.kind == INSERT)
+    {
+      eraseText(buffer, at, textEnd(at, text(record)));
+      cursor = at;
+    }
+    else
+    {
+      cursor = insertText(buffer, at, text(record));
+    }
+
+    if (observer)
+      observer(record.kind == ERASE, at, text(record));
+
+    more = record.joinsPrevious && current > firstRecord;
+  } while (more);
+
+  sealed = true;
+  return true;
+}
+
+bool UndoJournal::redo(TextBuffer &buffer, TextPos &cursor, const EditObserver &observer)
+{
+  if (current == records.size())
+    return false;
+
+  do
+  {
+    const Record &record = records[current++];
+    TextPos at = {record.line, record.column};
+
+    if (record.kind == INSERT)
+    {
+      cursor = insertText(buffer, at, text(record));
+    }
+    else
+    {
+      eraseText(buffer, at, textEnd(at, text(record)));
+      cursor = at;
+    }
+
+    if (observer)
+      observer(record.kind == INSERT, at, text(record));
+  } while (current < records.size() && records[current].joinsPrevious);
+
+  sealed = true;
+  return true;
+}
+
+void UndoJournal::clear()
+{
+  records.clear();
+  arena.clear();
+  firstRecord = current = 0;
+  sealed = true;
+}
+
+void UndoJournal::setCap(size_t bytes)
+{
+  capBytes = bytes;
+  enforceCap();
+}
+
+size_t UndoJournal::memoryUsed() const
+{
+  if (firstRecord == records.size())
+    return 0;
+
+  return arena.size() - records[firstRecord].textStart + (records.size() - firstRecord) * sizeof(Record);
+}
+
+// Drops whole steps, redo history first and then the oldest.
+void UndoJournal::enforceCap()
+{
+  if (memoryUsed() <= capBytes)
+    return;
+
+  dropRedo();
+
+  while (memoryUsed() > capBytes && firstRecord < current)
+  {
+    size_t end = firstRecord + 1;
+    while (end < current && records[end].joinsPrevious)
+      end++;
+
+    // A group still being recorded cannot be split.
+    if (end == current && groupDepth > 0)
+      break;
+
+    firstRecord = end;
+  }
+
+  if (firstRecord == current)
+    clear();
+  else
+    compact();
+}
+
+void UndoJournal::compact()
+{
+  size_t deadBytes = records[firstRecord].textStart;
+
+  if (firstRecord >= COMPACT_MIN_RECORDS && firstRecord * 2 >= records.size())
+  {
+    records.erase(records.begin(), records.begin() + firstRecord);
+    current -= firstRecord;
+    firstRecord = 0;
+  }
+
+  if (deadBytes >= COMPACT_MIN_BYTES && deadBytes * 2 >= arena.size())
+  {
+    arena.erase(0, deadBytes);
+    for (size_t i = firstRecord; i < records.size(); i++)
+      records[i].textStart -= deadBytes;
+  }
+}
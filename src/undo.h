@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "buffer.h"
+#include "edit.h"
+
+// Undo history as a journal of primitive edits, with their text in one
+// arena. Runs of typing or backspacing coalesce into one record, records
+// between beginGroup() and endGroup() undo as one step, and the oldest
+// steps go once the journal outgrows its cap.
+class UndoJournal
+{
+public:
+  static const size_t DEFAULT_CAP = 64 << 20;
+
+  // `typed` marks single keystroke edits, which may join the previous one.
+  void recordInsert(TextPos at, std::string_view text, bool typed);
+  void recordErase(TextPos at, std::string_view text, bool typed);
+
+  void beginGroup();
+  void endGroup();
+
+  // Keeps the next typed edit from joining the last record.
+  void seal();
+
+  // Both return false when there is nothing to do, and otherwise set cursor
+  // to where the change happened.
+  bool undo(TextBuffer &buffer, TextPos &cursor, const EditObserver &observer = nullptr);
+  bool redo(TextBuffer &buffer, TextPos &cursor, const EditObserver &observer = nullptr);
+
+  void clear();
+
+  void setCap(size_t bytes);
+  size_t cap() const { return capBytes; }
+  size_t memoryUsed() const;
+
+private:
+  enum Kind : uint8_t
+  {
+    INSERT,
+    ERASE
+  };
+
+  struct Record
+  {
+    size_t line, column;
+    size_t textStart, textLength;
+    Kind kind;
+    bool typed;
+    bool joinsPrevious;
+  };
+
+  // Records [firstRecord, current) can be undone, [current, end) redone.
+  std::vector<Record> records;
+  size_t firstRecord = 0, current = 0;
+  std::string arena;
+
+  size_t capBytes = DEFAULT_CAP;
+  int groupDepth = 0;
+  bool groupOpen = false;
+  bool sealed = true;
+
+  std::string_view text(const Record &record) const { return std::string_view(arena).substr(record.textStart, record.textLength); }
+
+  bool canCoalesce(Kind kind, TextPos at, std::string_view text, bool typed) const;
+  void record(Kind kind, TextPos at, std::string_view text, bool typed);
+  void dropRedo();
+  void enforceCap();
+  void compact();
+};
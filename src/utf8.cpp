@@ -0,0 +1,421 @@
+#include "utf8.h"
+
+#include <algorithm>
+
+#include "simd.h"
+
+static const char32_t REPLACEMENT = 0xFFFD;
+
+struct CharRange
+{
+  char32_t first, last;
+};
+
+// Combining marks, joiners and other characters that take no column of
+// their own, for the scripts and symbols most often met.
+static const CharRange ZERO_WIDTH[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+    {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711},
+    {0x0730, 0x074A}, {0x07A6, 0x07B0}, {0x07EB, 0x07F3}, {0x0900, 0x0902}, {0x093A, 0x093A},
+    {0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963},
+    {0x0981, 0x0981}, {0x09BC, 0x09BC}, {0x09C1, 0x09C4}, {0x09CD, 0x09CD}, {0x0A01, 0x0A02},
+    {0x0A3C, 0x0A3C}, {0x0A41, 0x0A51}, {0x0A70, 0x0A71}, {0x0ABC, 0x0ABC}, {0x0AC1, 0x0AC8},
+    {0x0ACD, 0x0ACD}, {0x0B3C, 0x0B3C}, {0x0B41, 0x0B44}, {0x0B4D, 0x0B4D}, {0x0BCD, 0x0BCD},
+    {0x0C3E, 0x0C40}, {0x0C46, 0x0C56}, {0x0CBC, 0x0CBC}, {0x0CCC, 0x0CCD}, {0x0D41, 0x0D44},
+    {0x0D4D, 0x0D4D}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1},
+    {0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x0F71, 0x0F7E}, {0x0F80, 0x0F84}, {0x1160, 0x11FF},
+    {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064},
+    {0x20D0, 0x20FF}, {0x302A, 0x302D}, {0x3099, 0x309A}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+    {0xFEFF, 0xFEFF}, {0x1D167, 0x1D169}, {0x1D173, 0x1D182}, {0xE0001, 0xE007F}, {0xE0100, 0xE01EF},
+};
+
+// East Asian wide and fullwidth characters, and emoji shown as such.
+static const CharRange WIDE[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0},
+    {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F},
+    {0x2693, 0x2693}, {0x26A1, 0x26A1}, {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B}, {0x2728, 0x2728},
+    {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55},
+    {0x2E80, 0x3029}, {0x302E, 0x303E}, {0x3041, 0x3098}, {0x309B, 0x33FF}, {0x3400, 0x4DBF},
+    {0x4E00, 0x9FFF}, {0xA000, 0xA4CF}, {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF},
+    {0xFE10, 0xFE19}, {0xFE30, 0xFE6F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4},
+    {0x17000, 0x18CFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E},
+    {0x1F191, 0x1F19A}, {0x1F200, 0x1F2FF}, {0x1F300, 0x1F320}, {0x1F32D, 0x1F335}, {0x1F337, 0x1F37C},
+    {0x1F37E, 0x1F393}, {0x1F3A0, 0x1F3CA}, {0x1F3CF, 0x1F3D3}, {0x1F3E0, 0x1F3F0}, {0x1F3F4, 0x1F3F4},
+    {0x1F3F8, 0x1F43E}, {0x1F440, 0x1F440}, {0x1F442, 0x1F4FC}, {0x1F4FF, 0x1F53D}, {0x1F54B, 0x1F54E},
+    {0x1F550, 0x1F567}, {0x1F57A, 0x1F57A}, {0x1F595, 0x1F596}, {0x1F5A4, 0x1F5A4}, {0x1F5FB, 0x1F64F},
+    {0x1F680, 0x1F6C5}, {0x1F6CC, 0x1F6CC}, {0x1F6D0, 0x1F6D2}, {0x1F6D5, 0x1F6DF}, {0x1F6EB, 0x1F6EC},
+    {0x1F6F4, 0x1F6FC}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F93A}, {0x1F93C, 0x1F945}, {0x1F947, 0x1F9FF},
+    {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+template <size_t N>
+static bool inRanges(const CharRange (&ranges)[N], char32_t c)
+{
+  const CharRange *after = std::upper_bound(ranges, ranges + N, c, [](char32_t value, const CharRange &range)
+                                            { return value < range.first; });
+
+  return after != ranges && c <= after[-1].last;
+}
+
+size_t utf8SequenceLength(unsigned char lead)
+{
+  if (lead < 0x80)
+    return 1;
+  if (lead >= 0xC2 && lead <= 0xDF)
+    return 2;
+  if (lead >= 0xE0 && lead <= 0xEF)
+    return 3;
+  if (lead >= 0xF0 && lead <= 0xF4)
+    return 4;
+  return 0;
+}
+
+size_t decodeUtf8(std::string_view text, size_t at, char32_t &c)
+{
+  static const char32_t LOWEST[] = {0, 0, 0x80, 0x800, 0x10000};
+
+  unsigned char lead = text[at];
+  size_t length = utf8SequenceLength(lead);
+
+  if (length <= 1 || at + length > text.size())
+  {
+    c = length == 1 ? lead : REPLACEMENT;
+    return 1;
+  }
+
+  char32_t value = lead & (0x7F >> length);
+
+  for (size_t i = 1; i < length; i++)
+  {
+    unsigned char next = text[at + i];
+
+    if ((next & 0xC0) != 0x80)
+    {
+      c = REPLACEMENT;
+      return 1;
+    }
+
+    value = value << 6 | (next & 0x3F);
+  }
+
+  // Overlong forms and surrogates are not valid UTF-8 either.
+  if (value < LOWEST[length] || value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF))
+  {
+    c = REPLACEMENT;
+    return 1;
+  }
+
+  c = value;
+  return length;
+}
+
+size_t encodeUtf8(char32_t c, char *out)
+{
+  if (c < 0x80)
+  {
+    out[0] = (char)c;
+    return 1;
+  }
+
+  if (c < 0x800)
+  {
+    out[0] = (char)(0xC0 | c >> 6);
+    out[1] = (char)(0x80 | (c & 0x3F));
+    return 2;
+  }
+
+  if (c < 0x10000)
+  {
+    out[0] = (char)(0xE0 | c >> 12);
+    out[1] = (char)(0x80 | (c >> 6 & 0x3F));
+    out[2] = (char)(0x80 | (c & 0x3F));
+    return 3;
+  }
+
+  out[0] = (char)(0xF0 | c >> 18);
+  out[1] = (char)(0x80 | (c >> 12 & 0x3F));
+  out[2] = (char)(0x80 | (c >> 6 & 0x3F));
+  out[3] = (char)(0x80 | (c & 0x3F));
+  return 4;
+}
+
+int charWidth(char32_t c)
+{
+  if (c < 0x300)
+    return 1;
+
+  if (inRanges(ZERO_WIDTH, c))
+    return 0;
+
+  return inRanges(WIDE, c) ? 2 : 1;
+}
+
+size_t byteAtColumn(std::string_view text, size_t column)
+{
+  size_t i = findNonAscii(text.data(), std::min(column, text.size()));
+
+  if (i == SIZE_MAX)
+    return std::min(column, text.size());
+
+  size_t at = i;
+
+  while (i < text.size())
+  {
+    char32_t c;
+    size_t length = decodeUtf8(text, i, c);
+    int width = charWidth(c);
+
+    if (width > 0 && at + width > column)
+      break;
+
+    i += length;
+    at += width;
+  }
+
+  return i;
+}
+
+void ColumnCache::clear()
+{
+  maps.clear();
+  version = UINT64_MAX;
+  lastLine = SIZE_MAX;
+}
+
+void ColumnCache::sync(const TextBuffer &buffer)
+{
+  if (version != buffer.version())
+  {
+    clear();
+    version = buffer.version();
+  }
+}
+
+bool ColumnCache::isAscii(const TextBuffer &buffer, size_t line, size_t &size)
+{
+  sync(buffer);
+
+  if (line != lastLine)
+  {
+    lastLine = line;
+    lastAscii = buffer.isAscii(line);
+    lastSize = buffer.lineSize(line);
+  }
+
+  size = lastSize;
+  return lastAscii;
+}
+
+// Marks sit at character boundaries about MARK_BYTES apart; the last is the
+// end of the line.
+const std::vector<ColumnCache::Mark> &ColumnCache::marksOf(const TextBuffer &buffer, size_t line)
+{
+  sync(buffer);
+
+  auto found = maps.find(line);
+  if (found != maps.end())
+    return found->second;
+
+  std::vector<Mark> &marks = maps[line];
+  size_t byte = 0, column = 0;
+
+  marks.push_back({0, 0});
+
+  buffer.forEachPiece(line, [&](size_t, std::string_view text)
+                      {
+                        for (size_t i = 0; i < text.size();)
+                        {
+                          size_t ascii = findNonAscii(text.data() + i, text.size() - i);
+                          size_t end = ascii == SIZE_MAX ? text.size() : i + ascii;
+
+                          for (size_t step; end - i >= (step = marks.back().byte + MARK_BYTES - byte);)
+                          {
+                            i += step;
+                            byte += step;
+                            column += step;
+                            marks.push_back({byte, column});
+                          }
+
+                          byte += end - i;
+                          column += end - i;
+                          i = end;
+
+                          if (i == text.size())
+                            break;
+
+                          char32_t c;
+                          size_t length = decodeUtf8(text, i, c);
+
+                          i += length;
+                          byte += length;
+                          column += charWidth(c);
+
+                          if (byte - marks.back().byte >= MARK_BYTES)
+                            marks.push_back({byte, column});
+                        } });
+
+  if (marks.back().byte != byte)
+    marks.push_back({byte, column});
+
+  return marks;
+}
+
+// The last mark at or before `at`, as a byte or as a column.
+const ColumnCache::Mark &ColumnCache::markBefore(const std::vector<Mark> &marks, size_t at, bool byColumn)
+{
+  auto after = std::upper_bound(marks.begin(), marks.end(), at, [&](size_t value, const Mark &mark)
+                                { return value < (byColumn ? mark.column : mark.byte); });
+
+  return after[-1];
+}
+
+// Up to `count` bytes of the line from `from`, at `from - start` in the
+// returned text.
+std::string_view ColumnCache::textAt(const TextBuffer &buffer, size_t line, size_t from, size_t count, size_t &start)
+{
+  std::string_view result;
+
+  buffer.forEachSlice(line, line + 1, from, count, [&](size_t, std::string_view text, size_t textStart, size_t size, bool)
+                      {
+                        if (textStart == 0 && text.size() == size)
+                        {
+                          result = text;
+                          start = 0;
+                        }
+                        else
+                        {
+                          size_t offset = std::min(from - textStart, text.size());
+                          scratch.assign(text.substr(offset, count));
+                          result = scratch;
+                          start = textStart + offset;
+                        }
+                        return true; });
+
+  return result;
+}
+
+size_t ColumnCache::columnOf(const TextBuffer &buffer, size_t line, size_t at)
+{
+  size_t size;
+
+  if (isAscii(buffer, line, size))
+    return std::min(at, size);
+
+  const Mark &mark = markBefore(marksOf(buffer, line), at, false);
+  size_t start, column = mark.column;
+  std::string_view text = textAt(buffer, line, mark.byte, at - mark.byte + 4, start);
+
+  for (size_t i = mark.byte - start; i < text.size();)
+  {
+    char32_t c;
+    size_t length = decodeUtf8(text, i, c);
+
+    if (start + i + length > at)
+      break;
+
+    i += length;
+    column += charWidth(c);
+  }
+
+  return column;
+}
+
+size_t ColumnCache::byteAt(const TextBuffer &buffer, size_t line, size_t column)
+{
+  size_t size;
+
+  if (isAscii(buffer, line, size))
+    return std::min(column, size);
+
+  const std::vector<Mark> &marks = marksOf(buffer, line);
+
+  if (column >= marks.back().column)
+    return marks.back().byte;
+
+  const Mark &mark = markBefore(marks, column, true);
+  size_t start, at = mark.column;
+  std::string_view text = textAt(buffer, line, mark.byte, MARK_BYTES + 8, start);
+  size_t i = mark.byte - start;
+
+  while (i < text.size())
+  {
+    char32_t c;
+    size_t length = decodeUtf8(text, i, c);
+    int width = charWidth(c);
+
+    if (width > 0 && at + width > column)
+      break;
+
+    i += length;
+    at += width;
+  }
+
+  return start + i;
+}
+
+size_t ColumnCache::nextChar(const TextBuffer &buffer, size_t line, size_t at)
+{
+  size_t size;
+  bool ascii = isAscii(buffer, line, size);
+
+  if (at >= size)
+    return size;
+
+  if (ascii)
+    return at + 1;
+
+  size_t start;
+  std::string_view text = textAt(buffer, line, at, 64, start);
+  size_t i = at - start;
+  char32_t c;
+
+  i += decodeUtf8(text, i, c);
+
+  while (i < text.size())
+  {
+    size_t length = decodeUtf8(text, i, c);
+
+    if (charWidth(c) > 0)
+      break;
+
+    i += length;
+  }
+
+  return start + i;
+}
+
+size_t ColumnCache::previousChar(const TextBuffer &buffer, size_t line, size_t at)
+{
+  size_t size;
+
+  if (at == 0)
+    return 0;
+
+  if (isAscii(buffer, line, size))
+    return at - 1;
+
+  const Mark &mark = markBefore(marksOf(buffer, line), at - 1, false);
+  size_t start, found = SIZE_MAX;
+  std::string_view text = textAt(buffer, line, mark.byte, at - mark.byte, start);
+
+  for (size_t i = mark.byte - start; i < text.size() && start + i < at;)
+  {
+    char32_t c;
+    size_t length = decodeUtf8(text, i, c);
+
+    if (charWidth(c) > 0)
+      found = start + i;
+
+    i += length;
+  }
+
+  // Only zero-width characters since the mark: they go with one before it.
+  if (found == SIZE_MAX)
+    return mark.byte > 0 ? previousChar(buffer, line, mark.byte) : 0;
+
+  return found;
+}
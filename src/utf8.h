@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.h"
+
+// Reads the character at text[at] into c and returns its length in bytes;
+// an invalid byte reads as U+FFFD on its own.
+size_t decodeUtf8(std::string_view text, size_t at, char32_t &c);
+
+// Writes c to out, which must hold 4 bytes, and returns the length.
+size_t encodeUtf8(char32_t c, char *out);
+
+// How many bytes the sequence started by `lead` has, or 0 for a byte that
+// cannot start one.
+size_t utf8SequenceLength(unsigned char lead);
+
+// Screen columns c takes: 2 for East Asian wide and fullwidth characters, 0
+// for combining marks and other zero-width ones, 1 for everything else.
+int charWidth(char32_t c);
+
+// First byte of the character of text covering screen column `column`, or
+// text's size if it ends before. Only the bytes up to there are read.
+size_t byteAtColumn(std::string_view text, size_t column);
+
+// Screen columns of the buffer's lines, whose x positions are byte offsets.
+// Non-ASCII lines get a map of columns every MARK_BYTES or so, made on first
+// use and dropped when the text changes; call clear() when it is replaced.
+class ColumnCache
+{
+public:
+  static const size_t MARK_BYTES = 256;
+
+  // Column at which the character holding byte `at` starts.
+  size_t columnOf(const TextBuffer &buffer, size_t line, size_t at);
+
+  // First byte of the character covering `column`, or the line's size if
+  // the line ends before it.
+  size_t byteAt(const TextBuffer &buffer, size_t line, size_t column);
+
+  // Where the character after, or before, the one at byte `at` starts.
+  // Zero-width characters go with the one they follow.
+  size_t nextChar(const TextBuffer &buffer, size_t line, size_t at);
+  size_t previousChar(const TextBuffer &buffer, size_t line, size_t at);
+
+  void clear();
+
+private:
+  struct Mark
+  {
+    size_t byte, column;
+  };
+
+  std::unordered_map<size_t, std::vector<Mark>> maps;
+  uint64_t version = UINT64_MAX;
+  std::string scratch;
+
+  // The last line looked up, usually the cursor's, so that moving along it
+  // does not go back to the buffer each time.
+  size_t lastLine = SIZE_MAX, lastSize = 0;
+  bool lastAscii = false;
+
+  void sync(const TextBuffer &buffer);
+  bool isAscii(const TextBuffer &buffer, size_t line, size_t &size);
+  const std::vector<Mark> &marksOf(const TextBuffer &buffer, size_t line);
+  const Mark &markBefore(const std::vector<Mark> &marks, size_t at, bool byColumn);
+  std::string_view textAt(const TextBuffer &buffer, size_t line, size_t from, size_t count, size_t &start);
+};
@@ -0,0 +1,89 @@
+#include "watch.h"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+bool DiskState::operator==(const DiskState &other) const
+{
+  if (!exists || !other.exists)
+    return exists == other.exists;
+
+  return device == other.device && inode == other.inode && size == other.size &&
+         modified.tv_sec == other.modified.tv_sec && modified.tv_nsec == other.modified.tv_nsec;
+}
+
+DiskState diskState(const std::string &fileName)
+{
+  DiskState state;
+  struct stat info;
+
+  if (stat(fileName.c_str(), &info) != 0)
+    return state;
+
+  state.exists = true;
+  state.device = info.st_dev;
+  state.inode = info.st_ino;
+  state.size = info.st_size;
+  state.modified = info.st_mtim;
+  return state;
+}
+
+FileWatch::FileWatch()
+{
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+}
+
+FileWatch::~FileWatch()
+{
+  if (inotifyFd >= 0)
+    close(inotifyFd);
+}
+
+void FileWatch::watch(const std::string &fileName)
+{
+  if (inotifyFd < 0)
+    return;
+
+  if (watchId >= 0)
+    inotify_rm_watch(inotifyFd, watchId);
+
+  // Saves go to the file a symlink points to, so that is the one watched.
+  char *resolved = realpath(fileName.c_str(), nullptr);
+  std::string target = resolved ? resolved : fileName;
+  free(resolved);
+
+  size_t slash = target.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : target.substr(0, slash + 1);
+  name = slash == std::string::npos ? target : target.substr(slash + 1);
+
+  // Writes in place show up when the writer closes the file, replacements
+  // when they are renamed in; deletions matter too.
+  watchId = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM);
+}
+
+bool FileWatch::changed()
+{
+  if (inotifyFd < 0)
+    return false;
+
+  alignas(inotify_event) char events[4096];
+  bool found = false;
+  ssize_t length;
+
+  while ((length = read(inotifyFd, events, sizeof(events))) > 0)
+  {
+    for (ssize_t offset = 0; offset < length;)
+    {
+      const inotify_event *event = (const inotify_event *)(events + offset);
+
+      if (event->wd == watchId && event->len > 0 && name == event->name)
+        found = true;
+
+      offset += sizeof(inotify_event) + event->len;
+    }
+  }
+
+  return found;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+#include <sys/stat.h>
+
+// What a file on disk looked like at one point: enough to tell whether it
+// has been written or replaced since.
+struct DiskState
+{
+  bool exists = false;
+  dev_t device = 0;
+  ino_t inode = 0;
+  off_t size = 0;
+  timespec modified = {};
+
+  bool operator==(const DiskState &other) const;
+  bool operator!=(const DiskState &other) const { return !(*this == other); }
+
+  // Whether both are the same file, however it was written in between.
+  bool isSameFile(const DiskState &other) const { return exists && other.exists && device == other.device && inode == other.inode; }
+};
+
+DiskState diskState(const std::string &fileName);
+
+// Watches one file for changes made by other programs. The directory is
+// watched, so that a file replaced by a rename is still seen.
+class FileWatch
+{
+public:
+  FileWatch();
+  ~FileWatch();
+
+  FileWatch(const FileWatch &) = delete;
+  FileWatch &operator=(const FileWatch &) = delete;
+
+  // Watches fileName from now on, in place of whatever was watched before.
+  void watch(const std::string &fileName);
+
+  // Becomes readable when there are events for changed(); -1 where inotify
+  // is not available.
+  int fd() const { return inotifyFd; }
+
+  // Reads all pending events and returns whether any was about the file.
+  bool changed();
+
+private:
+  int inotifyFd = -1, watchId = -1;
+  std::string name;
+};
@@ -0,0 +1,74 @@
+#include "workers.h"
+
+WorkerPool::WorkerPool(unsigned threads)
+{
+  for (unsigned i = 1; i < threads; i++)
+    workers.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  wake.notify_all();
+
+  for (std::thread &worker : workers)
+    worker.join();
+}
+
+void WorkerPool::takeTasks()
+{
+  for (size_t i; (i = nextTask.fetch_add(1)) < taskCount;)
+    (*task)(i);
+}
+
+void WorkerPool::run(size_t count, const std::function<void(size_t)> &fn)
+{
+  if (count == 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    task = &fn;
+    taskCount = count;
+    nextTask = 0;
+    busyWorkers = workers.size();
+    generation++;
+  }
+
+  wake.notify_all();
+  takeTasks();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&]
+            { return busyWorkers == 0; });
+  task = nullptr;
+}
+
+void WorkerPool::work()
+{
+  uint64_t seen = 0;
+
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]
+                { return stopping || generation != seen; });
+
+      if (stopping)
+        return;
+
+      seen = generation;
+    }
+
+    takeTasks();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busyWorkers == 0)
+      done.notify_one();
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads running one job's tasks at a time, with the
+// calling thread taking tasks too.
+class WorkerPool
+{
+public:
+  explicit WorkerPool(unsigned threads = std::thread::hardware_concurrency());
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Number of threads working on a job, the caller included.
+  unsigned size() const { return workers.size() + 1; }
+
+  // Calls task(i) for every i in [0, count) and returns once all are done.
+  void run(size_t count, const std::function<void(size_t)> &task);
+
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wake, done;
+
+  const std::function<void(size_t)> *task = nullptr;
+  size_t taskCount = 0;
+  std::atomic<size_t> nextTask{0};
+  size_t busyWorkers = 0;
+  uint64_t generation = 0;
+  bool stopping = false;
+
+  void work();
+  void takeTasks();
+};
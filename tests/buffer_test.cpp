@@ -0,0 +1,260 @@
+#include <cstdint>
+#include <fstream>
+
+#include "simd.h"
+#include "synthetic.h"
+#include "test.h"
+
+// Large enough to be mapped rather than read.
+static const size_t MAPPED_LINES = 100000;
+
+TEST(loadIndexesLargeFilesLazily)
+{
+  TempDir dir;
+  std::string large = syntheticC(MAPPED_LINES, 1), small = syntheticC(10, 2);
+  TextBuffer buffer;
+
+  CHECK(writeFile(dir.path("large.c"), large));
+  CHECK(writeFile(dir.path("small.c"), small));
+
+  CHECK(buffer.load(dir.path("large.c")));
+  CHECK(buffer.isLoading());
+
+  while (buffer.isLoading())
+    buffer.continueLoading(1 << 16);
+
+  CHECK(buffer.isMapped());
+  CHECK(bufferText(buffer) + "\n" == large);
+
+  CHECK(buffer.load(dir.path("small.c")));
+  buffer.finishLoading();
+  CHECK(!buffer.isMapped());
+  CHECK(bufferText(buffer) + "\n" == small);
+}
+
+TEST(newlineScanMatchesAPlainOne)
+{
+  std::string data;
+  uint64_t seed = 1;
+
+  for (size_t i = 0; i < 4096; i++)
+  {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    data += (seed >> 59) == 0 ? '\n' : (char)(seed >> 56);
+  }
+
+  // Every alignment, and lengths around the vector widths.
+  for (size_t start = 0; start < 64; start++)
+    for (size_t length : {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1000, 4000})
+    {
+      std::vector<uint64_t> found, expected;
+
+      findNewlines(data.data() + start, length, 100, found);
+
+      for (size_t i = 0; i < length; i++)
+        if (data[start + i] == '\n')
+          expected.push_back(100 + i);
+
+      CHECK(found == expected);
+    }
+}
+
+TEST(copiedFileSurvivesTruncation)
+{
+  TempDir dir;
+  std::string text = syntheticC(MAPPED_LINES, 3);
+  TextBuffer buffer;
+
+  CHECK(writeFile(dir.path("a.c"), text));
+  CHECK(buffer.load(dir.path("a.c")));
+
+  buffer.copyFile();
+  std::ofstream(dir.path("a.c")).close();
+
+  CHECK(!buffer.isMapped());
+  buffer.finishLoading();
+  CHECK(bufferText(buffer) + "\n" == text);
+}
+
+TEST(truncatingCommandsKeepMappedBuffers)
+{
+  TempDir dir;
+  std::string text = syntheticC(MAPPED_LINES, 4);
+  Editor e;
+
+  CHECK(writeFile(dir.path("a.c"), text));
+  CHECK(writeFile(dir.path("b.c"), "b\n"));
+  setUpEditor(e);
+  openFile(e, dir.path("a.c"));
+
+  // Once for the stashed buffer, once for the current one.
+  typeKeys(e, ":swp " + dir.path("b.c") + "\n");
+  typeKeys(e, ":c " + dir.path("a.c") + "\n");
+  typeKeys(e, ":swp " + dir.path("a.c") + "\n");
+  CHECK(e.fileName == dir.path("a.c"));
+  e.buffer.finishLoading();
+  CHECK(bufferText(e.buffer) + "\n" == text);
+
+  CHECK(writeFile(dir.path("a.c"), text));
+  openFile(e, dir.path("a.c"));
+  typeKeys(e, ":c " + dir.path("a.c") + "\n");
+  e.buffer.finishLoading();
+  CHECK(bufferText(e.buffer) + "\n" == text);
+}
+
+static std::vector<std::string> splitLines(const std::string &text)
+{
+  std::vector<std::string> lines;
+  size_t start = 0;
+
+  for (size_t newline; (newline = text.find('\n', start)) != std::string::npos; start = newline + 1)
+    lines.push_back(text.substr(start, newline - start));
+
+  return lines;
+}
+
+static bool sameLines(const TextBuffer &buffer, const std::vector<std::string> &lines)
+{
+  bool same = buffer.size() == lines.size();
+
+  buffer.forEachLine(0, std::min(buffer.size(), lines.size()), [&](size_t index, std::string_view line)
+                     {
+                       same &= line == lines[index];
+                       return same; });
+
+  return same;
+}
+
+// Makes the same random edits to the buffer and to `lines`: typing and
+// erasing within lines, inserting and erasing whole lines, and now and
+// then a line long enough to be chunked.
+static void editRandomly(TextBuffer &buffer, std::vector<std::string> &lines, BenchRandom &random, size_t edits)
+{
+  for (size_t i = 0; i < edits; i++)
+  {
+    size_t index = random.below(lines.size());
+    std::string &line = lines[index];
+
+    switch (random.below(6))
+    {
+    case 0:
+    case 1:
+    {
+      size_t column = random.below(line.size() + 1);
+      std::string text(1 + random.below(8), 'a' + random.below(26));
+
+      buffer.insertInLine(index, column, text);
+      line.insert(column, text);
+      break;
+    }
+
+    case 2:
+    {
+      size_t from = random.below(line.size() + 1), to = from + random.below(line.size() - from + 1);
+
+      CHECK(buffer.eraseInLine(index, from, to) == line.substr(from, to - from));
+      line.erase(from, to - from);
+      break;
+    }
+
+    case 3:
+    {
+      std::string text = random.below(50) == 0 ? std::string(TextBuffer::LONG_LINE_BYTES + random.below(1000), 'L') : std::to_string(random.next());
+
+      buffer.insertLine(index, text);
+      lines.insert(lines.begin() + index, text);
+      break;
+    }
+
+    case 4:
+      if (lines.size() > 1)
+      {
+        buffer.eraseLine(index);
+        lines.erase(lines.begin() + index);
+      }
+      break;
+
+    case 5:
+      CHECK(buffer.line(index) == line);
+      break;
+    }
+  }
+}
+
+TEST(editedLinesMatchAReference)
+{
+  TempDir dir;
+  std::string text = syntheticC(20000, 12);
+  BenchRandom random(12);
+  TextBuffer buffer;
+
+  CHECK(writeFile(dir.path("a.c"), text));
+  CHECK(buffer.load(dir.path("a.c")));
+  buffer.finishLoading();
+
+  std::vector<std::string> lines = splitLines(text);
+
+  for (int round = 0; round < 10; round++)
+  {
+    editRandomly(buffer, lines, random, 5000);
+    CHECK(sameLines(buffer, lines));
+
+    // Compaction moves every edited line to a fresh pool block.
+    buffer.compact();
+    CHECK(sameLines(buffer, lines));
+  }
+
+  CHECK(buffer.memoryUse().pool > 0);
+}
+
+TEST(compactionReclaimsFreedPoolSpace)
+{
+  TextBuffer buffer;
+  std::string line(1000, 'x');
+
+  for (size_t i = 0; i < 20000; i++)
+    buffer.insertLine(i, line);
+
+  buffer.eraseLines(0, 15000);
+  buffer.insertInLine(0, 0, "y");
+
+  TextBuffer::MemoryUse before = buffer.memoryUse();
+
+  buffer.compact();
+
+  TextBuffer::MemoryUse after = buffer.memoryUse();
+
+  CHECK(before.poolFree > 0);
+  CHECK(after.pool < before.pool);
+  CHECK(buffer.size() == 5000 && buffer.line(0) == "y" + line && buffer.line(4999) == line);
+}
+
+TEST(packedLeavesKeepTheirText)
+{
+  TempDir dir;
+  std::string text = syntheticC(MAPPED_LINES, 16);
+  BenchRandom random(16);
+  TextBuffer buffer;
+
+  CHECK(writeFile(dir.path("a.c"), text));
+  CHECK(buffer.load(dir.path("a.c")));
+  buffer.finishLoading();
+
+  std::vector<std::string> lines = splitLines(text);
+  size_t unpacked = buffer.memoryUse().index;
+
+  buffer.setMemoryBudget(1 << 20);
+  CHECK(buffer.memoryUse().packed > 0);
+  CHECK(buffer.memoryUse().index + buffer.memoryUse().packed < unpacked);
+  CHECK(sameLines(buffer, lines));
+
+  // Edits expand leaves here and there, which packs others.
+  for (int round = 0; round < 5; round++)
+  {
+    editRandomly(buffer, lines, random, 2000);
+    CHECK(sameLines(buffer, lines));
+  }
+
+  buffer.setMemoryBudget(0);
+  CHECK(sameLines(buffer, lines));
+}
@@ -0,0 +1,146 @@
+#include <fstream>
+
+#include "diff.h"
+#include "synthetic.h"
+#include "test.h"
+
+static void fill(TextBuffer &buffer, const std::vector<std::string> &lines)
+{
+  std::vector<std::string> copy = lines;
+  buffer.insertLines(0, std::move(copy));
+}
+
+// Applies the hunks to `before`, bottom up, as reloading does.
+static std::vector<std::string> applyHunks(std::vector<std::string> before, const std::vector<std::string> &after, const std::vector<LineHunk> &hunks)
+{
+  for (auto hunk = hunks.rbegin(); hunk != hunks.rend(); ++hunk)
+  {
+    before.erase(before.begin() + hunk->oldStart, before.begin() + hunk->oldStart + hunk->oldCount);
+    before.insert(before.begin() + hunk->oldStart, after.begin() + hunk->newStart, after.begin() + hunk->newStart + hunk->newCount);
+  }
+
+  return before;
+}
+
+TEST(diffOfSameTextIsEmpty)
+{
+  TextBuffer before, after;
+  std::vector<std::string> lines = {"a", "b", "a", "c"};
+
+  fill(before, lines);
+  fill(after, lines);
+  CHECK(diffLines(before, after).empty());
+}
+
+TEST(diffFindsOneChangedLine)
+{
+  TextBuffer before, after;
+  std::vector<std::string> lines;
+
+  for (int i = 0; i < 1000; i++)
+    lines.push_back("line " + std::to_string(i));
+
+  fill(before, lines);
+  lines[500] = "changed";
+  fill(after, lines);
+
+  std::vector<LineHunk> hunks = diffLines(before, after);
+
+  CHECK(hunks.size() == 1);
+  CHECK(hunks.size() == 1 && hunks[0].oldStart == 500 && hunks[0].oldCount == 1 && hunks[0].newCount == 1);
+}
+
+TEST(diffHunksTurnOneTextIntoTheOther)
+{
+  BenchRandom random(7);
+
+  for (int round = 0; round < 200; round++)
+  {
+    std::vector<std::string> oldLines, newLines;
+
+    // Few distinct lines, so that many repeat and few anchor the match.
+    for (size_t i = random.below(300); i > 0; i--)
+      oldLines.push_back(std::to_string(random.below(round % 2 ? 20 : 1000)));
+
+    newLines = oldLines;
+
+    for (size_t edits = random.below(20); edits > 0; edits--)
+    {
+      size_t at = random.below(newLines.size() + 1);
+
+      if (random.below(2) && at < newLines.size())
+        newLines.erase(newLines.begin() + at);
+      else
+        newLines.insert(newLines.begin() + at, std::to_string(random.below(50)));
+    }
+
+    TextBuffer before, after;
+
+    fill(before, oldLines);
+    fill(after, newLines);
+    CHECK(applyHunks(oldLines, newLines, diffLines(before, after)) == newLines);
+  }
+}
+
+TEST(reloadAppliesChangesMadeElsewhere)
+{
+  TempDir dir;
+  Editor e;
+
+  CHECK(writeFile(dir.path("a.txt"), "one\ntwo\nthree\n"));
+  setUpEditor(e);
+  openFile(e, dir.path("a.txt"));
+
+  CHECK(writeFile(dir.path("a.txt"), "one\n2\nthree\nfour\n"));
+  e.diskCheckPending = true;
+  CHECK(checkDisk(e));
+  CHECK(bufferText(e.buffer) == "one\n2\nthree\nfour");
+  CHECK(!e.unSavedChanges);
+
+  // The reload undoes as one step.
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) == "one\ntwo\nthree");
+}
+
+TEST(reloadOfMappedFileRewrittenInPlace)
+{
+  TempDir dir;
+  Editor e;
+  std::string text = syntheticC(100000, 5), shorter = syntheticC(1000, 6);
+
+  CHECK(writeFile(dir.path("a.c"), text));
+  setUpEditor(e);
+  openFile(e, dir.path("a.c"));
+  CHECK(e.buffer.isMapped());
+
+  // Written through the same inode, so the mapping shrinks under the buffer.
+  std::ofstream(dir.path("a.c")) << shorter;
+  e.diskCheckPending = true;
+  CHECK(checkDisk(e));
+  CHECK(bufferText(e.buffer) + "\n" == shorter);
+}
+
+TEST(editedMappedFileRewrittenInPlaceStaysReadable)
+{
+  TempDir dir;
+  Editor e;
+  std::string text = syntheticC(100000, 8), shorter = syntheticC(1000, 9);
+
+  CHECK(writeFile(dir.path("a.c"), text));
+  setUpEditor(e);
+  openFile(e, dir.path("a.c"));
+  typeKeys(e, "iedit\x1b");
+
+  std::ofstream(dir.path("a.c")) << shorter;
+  e.diskCheckPending = true;
+  CHECK(checkDisk(e));
+  CHECK(e.changedOnDisk);
+
+  // Every line is read here; none may fault past the file's new end.
+  e.buffer.finishLoading();
+  CHECK(bufferText(e.buffer).size() >= text.size());
+  drawEditor(e);
+
+  typeKeys(e, ":reload\n");
+  CHECK(bufferText(e.buffer) + "\n" == shorter);
+}
@@ -0,0 +1,161 @@
+#include <ncurses.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "synthetic.h"
+#include "test.h"
+
+TEST(journalReadsBackItsRecords)
+{
+  TempDir dir;
+  std::string fileName = dir.path("a.txt");
+  std::vector<JournalEdit> edits;
+  std::string error;
+
+  CHECK(writeFile(fileName, "hello\n"));
+
+  {
+    CrashJournal journal;
+
+    journal.attach(fileName, diskState(fileName));
+    journal.recordInsert({0, 5}, " world\n!");
+    journal.recordErase({0, 0}, {1, 0});
+    CHECK(journal.flush(2, {1, 1}));
+  }
+
+  CHECK(readJournal(fileName, diskState(fileName), edits, error));
+  CHECK(edits.size() >= 2);
+
+  if (edits.size() >= 2)
+  {
+    CHECK(edits[0].kind == JournalEdit::INSERT && edits[0].from.column == 5 && edits[0].text == " world\n!");
+    CHECK(edits[1].kind == JournalEdit::ERASE && edits[1].to.line == 1 && edits[1].to.column == 0);
+  }
+
+  // A journal of another version of the file is refused.
+  CHECK(writeFile(fileName, "changed\n"));
+  CHECK(!readJournal(fileName, diskState(fileName), edits, error));
+}
+
+TEST(journalEndsAtATornRecord)
+{
+  TempDir dir;
+  std::string fileName = dir.path("a.txt");
+  std::vector<JournalEdit> edits;
+  std::string error;
+
+  std::string journalName = CrashJournal::pathFor(fileName);
+  struct stat info;
+
+  CHECK(writeFile(fileName, "\n"));
+
+  {
+    CrashJournal journal;
+
+    journal.attach(fileName, diskState(fileName));
+    journal.recordInsert({0, 0}, "first");
+    CHECK(journal.flush(0, {}));
+    CHECK(stat(journalName.c_str(), &info) == 0);
+    journal.recordInsert({0, 5}, "second");
+    CHECK(journal.flush(0, {}));
+  }
+
+  // Cut off inside the second record.
+  CHECK(truncate(journalName.c_str(), info.st_size + 3) == 0);
+  CHECK(readJournal(fileName, diskState(fileName), edits, error));
+  CHECK(edits.size() >= 1 && edits[0].text == "first");
+
+  for (const JournalEdit &edit : edits)
+    CHECK(edit.kind != JournalEdit::INSERT || edit.text != "second");
+}
+
+// Edits the file and leaves its journal behind, as a crash would.
+static std::string editAndCrash(const std::string &fileName)
+{
+  Editor e;
+
+  setUpEditor(e);
+  openFile(e, fileName);
+  typeKeys(e, "ifirst\n");
+  pasteText(e, std::string(CrashJournal::FLUSH_BYTES * 2, 'x'));
+  typeKeys(e, "\x1b");
+
+  for (int i = 0; i < 500; i++)
+    processKey(e, KEY_DOWN);
+
+  typeKeys(e, "isecond\x1bu");
+  typeKeys(e, "ithird\x1b");
+  flushJournal(e);
+  e.buffer.finishLoading();
+  return bufferText(e.buffer);
+}
+
+TEST(recoverReplaysEditsLeftByACrash)
+{
+  TempDir dir;
+  std::string fileName = dir.path("a.c");
+
+  CHECK(writeFile(fileName, syntheticC(2000, 10)));
+  std::string edited = editAndCrash(fileName);
+
+  Editor e;
+
+  setUpEditor(e);
+  openFile(e, fileName);
+  CHECK(e.crashJournal.isPaused());
+  typeKeys(e, ":recover\n");
+  e.buffer.finishLoading();
+  CHECK(bufferText(e.buffer) == edited);
+  CHECK(e.unSavedChanges);
+
+  // Recovery undoes as one step.
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) + "\n" == syntheticC(2000, 10));
+}
+
+TEST(recoverKeepsTheOldJournalUntilTheNewOneIsSynced)
+{
+  TempDir dir;
+  std::string fileName = dir.path("a.c");
+
+  CHECK(writeFile(fileName, syntheticC(2000, 11)));
+  std::string edited = editAndCrash(fileName);
+
+  // Dies once partway into writing the new journal, once after it is
+  // flushed.
+  for (int crash = 0; crash < 2; crash++)
+  {
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+      Editor e;
+
+      setUpEditor(e);
+      openFile(e, fileName);
+      typeKeys(e, ":recover\n");
+
+      if (crash == 1)
+        flushJournal(e);
+
+      _exit(0);
+    }
+
+    int status = 0;
+
+    CHECK(child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status));
+  }
+
+  Editor e;
+
+  setUpEditor(e);
+  openFile(e, fileName);
+  typeKeys(e, ":recover\n");
+  e.buffer.finishLoading();
+  CHECK(bufferText(e.buffer) == edited);
+
+  discardJournals(e);
+  CHECK(access(CrashJournal::pathFor(fileName).c_str(), F_OK) != 0);
+  CHECK(access((CrashJournal::pathFor(fileName) + ".new").c_str(), F_OK) != 0);
+}
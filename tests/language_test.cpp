@@ -0,0 +1,151 @@
+#include <cstring>
+
+#include "highlight.h"
+#include "language.h"
+#include "test.h"
+
+// One letter per byte of each line for what it was highlighted as: k
+// keyword, s string, c comment, n number, d directive, b bracket, and '.'
+// for plain text. The lexer state carries from each line to the next.
+static std::vector<std::string> lexLines(const Language &language, const std::vector<std::string> &lines)
+{
+  std::vector<std::string> kinds;
+  LexState state;
+
+  for (size_t i = 0; i < lines.size(); i++)
+  {
+    std::vector<HighlightData> highlights;
+    std::string line(lines[i].size(), '.');
+
+    lexLine(language, lines[i], i, state, highlights);
+
+    for (const HighlightData &h : highlights)
+    {
+      char kind = h.color == KEYWORD ? 'k' : h.color == STRING ? 's' : h.color == COMMENT ? 'c' : h.color == NUMBER ? 'n' : h.color == DIRECTIVE ? 'd' : 'b';
+
+      // Brackets share their colours with other kinds.
+      if (h.length == 1 && strchr("()[]{}", lines[i][h.position]))
+        kind = 'b';
+
+      for (int at = h.position; at < h.position + h.length; at++)
+        line[at] = kind;
+    }
+
+    kinds.push_back(line);
+  }
+
+  return kinds;
+}
+
+static std::string lexKinds(const Language &language, const std::string &line)
+{
+  return lexLines(language, {line})[0];
+}
+
+TEST(languagesAreFoundByExtension)
+{
+  CHECK(languageFor("a.c") && languageFor("a.c")->definition->name == "c");
+  CHECK(languageFor("dir.d/a.hpp") && languageFor("dir.d/a.hpp")->definition->name == "c");
+  CHECK(languageFor("a.py") && languageFor("a.py")->definition->name == "python");
+  CHECK(languageFor("a.sh") && languageFor("a.sh")->definition->name == "shell");
+  CHECK(!languageFor("a.txt"));
+  CHECK(!languageFor("Makefile"));
+}
+
+TEST(cLinesLexIntoTokens)
+{
+  const Language &c = *languageFor("a.c");
+
+  CHECK(lexKinds(c, "int x = 42; // hi") == "kkk.....nn..ccccc");
+  CHECK(lexKinds(c, "return \"a\\\"b\" + 'c';") == "kkkkkk.ssssss...sss.");
+  CHECK(lexKinds(c, "f(a[1]) / 2.5e3") == ".b.bnbb...nnnnn");
+  CHECK(lexKinds(c, "interval = sizeof x;") == "...........kkkkkk...");
+}
+
+TEST(cDirectivesColourTheirArgument)
+{
+  const Language &c = *languageFor("a.c");
+
+  CHECK(lexKinds(c, "#include <stdio.h>") == "dddddddddsssssssss");
+  CHECK(lexKinds(c, "#include \"a.h\" // x") == "dddddddddsssssscccc");
+  CHECK(lexKinds(c, "#define N 10") == "ddddddddkdnn");
+  CHECK(lexKinds(c, "x = a # b;") == "..........");
+}
+
+TEST(cTemplateArgumentsAreKeywords)
+{
+  const Language &c = *languageFor("a.c");
+
+  CHECK(lexKinds(c, "vector<string> v;") == ".......kkkkkk....");
+  CHECK(lexKinds(c, "if (a < b) x;") == "kk.b.....b...");
+  CHECK(lexKinds(c, "a<b> c < d") == "..k.......");
+}
+
+TEST(multilineCommentsAndStringsCarryOver)
+{
+  const Language &c = *languageFor("a.c");
+  const Language &python = *languageFor("a.py");
+
+  CHECK(lexLines(c, {"x; /* one", "two", "three */ int y;"}) == (std::vector<std::string>{"...cccccc", "ccc", "cccccccc.kkk..."}));
+  CHECK(lexLines(c, {"\"open", "int"}) == (std::vector<std::string>{"sssss", "kkk"}));
+  CHECK(lexLines(python, {"s = \"\"\"doc", "for", "\"\"\" if x"}) == (std::vector<std::string>{"....ssssss", "sss", "sss.kk.."}));
+}
+
+TEST(lineEndsDropTentativeTokens)
+{
+  const Language &c = *languageFor("a.c");
+
+  CHECK(lexLines(c, {"if (a <", "int b;"}) == (std::vector<std::string>{"kk.b...", "kkk..."}));
+  CHECK(lexLines(c, {"x = a<b", "int"}) == (std::vector<std::string>{".......", "kkk"}));
+}
+
+TEST(shellCommentsStartAfterSpace)
+{
+  const Language &shell = *languageFor("a.sh");
+
+  CHECK(lexKinds(shell, "echo a#b # c") == ".........ccc");
+  CHECK(lexKinds(shell, "# all") == "ccccc");
+  CHECK(lexKinds(shell, "if [ $x ]; then echo 'a # b'; fi") == "kk.b....b..kkkk......sssssss..kk");
+}
+
+TEST(pythonKeywordsAndStrings)
+{
+  const Language &python = *languageFor("a.py");
+
+  CHECK(lexKinds(python, "def f(x): return 'a' # c") == "kkk..b.b..kkkkkk.sss.ccc");
+  CHECK(lexKinds(python, "True and None") == "kkkk.kkk.kkkk");
+}
+
+TEST(keywordsAreFoundWithOrWithoutASeed)
+{
+  for (const char *fileName : {"a.c", "a.py", "a.sh"})
+  {
+    const Language &language = *languageFor(fileName);
+
+    for (std::string_view keyword : language.definition->keywords)
+    {
+      std::string word(keyword);
+
+      CHECK(language.isKeyword(word.data(), word.size()));
+      word.back() ^= 0x20;
+      CHECK(!language.isKeyword(word.data(), word.size()));
+    }
+  }
+
+  // Far more keywords than there are slots, so they are searched instead.
+  LanguageDefinition many;
+  std::vector<std::string> words;
+
+  for (int i = 0; i < 400; i++)
+    words.push_back("kw" + std::to_string(i));
+
+  many.keywords.assign(words.begin(), words.end());
+
+  Language language(many);
+
+  for (const std::string &word : words)
+    CHECK(language.isKeyword(word.data(), word.size()));
+
+  CHECK(!language.isKeyword("kw400", 5));
+  CHECK(!language.isKeyword("k", 1));
+}
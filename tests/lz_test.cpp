@@ -0,0 +1,46 @@
+#include "lz.h"
+#include "synthetic.h"
+#include "test.h"
+
+static bool roundTrips(const std::string &data)
+{
+  std::vector<char> packed;
+  std::string unpacked(data.size(), '\0');
+
+  lzCompress(data.data(), data.size(), packed);
+  return lzDecompress(packed.data(), packed.size(), &unpacked[0], unpacked.size()) && unpacked == data;
+}
+
+TEST(lzRoundTrips)
+{
+  BenchRandom random(13);
+  std::string noise;
+
+  for (int i = 0; i < 100000; i++)
+    noise += (char)random.next();
+
+  CHECK(roundTrips(""));
+  CHECK(roundTrips("a"));
+  CHECK(roundTrips(std::string(100000, 'a')));
+  CHECK(roundTrips(syntheticC(5000, 13)));
+  CHECK(roundTrips(noise));
+}
+
+TEST(lzCompressesText)
+{
+  std::string text = syntheticC(5000, 14);
+  std::vector<char> packed;
+
+  lzCompress(text.data(), text.size(), packed);
+  CHECK(packed.size() < text.size() / 2);
+}
+
+TEST(lzRejectsDamagedInput)
+{
+  std::string text = syntheticC(1000, 15), out(text.size(), '\0');
+  std::vector<char> packed;
+
+  lzCompress(text.data(), text.size(), packed);
+  CHECK(!lzDecompress(packed.data(), packed.size(), &out[0], out.size() - 1));
+  CHECK(!lzDecompress(packed.data(), packed.size() / 2, &out[0], out.size()));
+}
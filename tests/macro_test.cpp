@@ -0,0 +1,59 @@
+#include "synthetic.h"
+#include "test.h"
+
+static void openText(Editor &e, TempDir &dir, const std::string &text)
+{
+  CHECK(writeFile(dir.path("a.txt"), text));
+  setUpEditor(e);
+  openFile(e, dir.path("a.txt"));
+}
+
+TEST(macrosReplayTypedTextAndKeys)
+{
+  TempDir dir;
+  Editor e;
+
+  openText(e, dir, "one\ntwo\nthree\nfour\nfive\n");
+
+  // Prefix the line, then move down to the next one.
+  typeKeys(e, "qi- \x1b" "as" "q");
+  CHECK(!e.macro.isRecording());
+  CHECK(bufferText(e.buffer) == "- one\ntwo\nthree\nfour\nfive");
+  CHECK(e.y == 1);
+
+  typeKeys(e, "@");
+  CHECK(bufferText(e.buffer) == "- one\n- two\nthree\nfour\nfive");
+
+  typeKeys(e, ":@ 2\n");
+  CHECK(bufferText(e.buffer) == "- one\n- two\n- three\n- four\nfive");
+  CHECK(e.y == 4);
+
+  // A replay undoes as one step.
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) == "- one\n- two\nthree\nfour\nfive");
+  typeKeys(e, "r");
+  CHECK(bufferText(e.buffer) == "- one\n- two\n- three\n- four\nfive");
+}
+
+TEST(macroCountsRunEveryRepetition)
+{
+  TempDir dir;
+  Editor e;
+
+  openText(e, dir, "a\nb\nc\nd\ne\nf\ng\n");
+
+  // Movement alone, which changes nothing, still runs count times.
+  typeKeys(e, "qsq");
+  CHECK(e.y == 1);
+  typeKeys(e, ":@ 4\n");
+  CHECK(e.y == 5);
+
+  typeKeys(e, ":@ x\n");
+  CHECK(e.message == "USAGE - :@ <COUNT>");
+  CHECK(e.y == 5);
+
+  // Recording again drops the old macro.
+  typeKeys(e, "qdix\x1bq");
+  typeKeys(e, "w@");
+  CHECK(bufferText(e.buffer) == "a\nb\nc\nd\nex\nfx\ng");
+}
@@ -0,0 +1,101 @@
+// Runs the tests linked into TextEditorTests, or those named on the
+// command line, and exits non-zero if any check failed.
+//
+//   TextEditorTests [NAME...]
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "test.h"
+
+static int failures = 0;
+
+std::vector<TestCase> &testCases()
+{
+  static std::vector<TestCase> cases;
+  return cases;
+}
+
+void reportFailure(const char *file, int line, const char *condition)
+{
+  fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+  failures++;
+}
+
+TempDir::TempDir()
+{
+  char name[] = "/tmp/TextEditorTests-XXXXXX";
+
+  if (mkdtemp(name))
+    dir = name;
+}
+
+TempDir::~TempDir()
+{
+  DIR *listing = opendir(dir.c_str());
+
+  if (!listing)
+    return;
+
+  while (dirent *entry = readdir(listing))
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+      unlink(path(entry->d_name).c_str());
+
+  closedir(listing);
+  rmdir(dir.c_str());
+}
+
+std::string bufferText(const TextBuffer &buffer)
+{
+  std::string text;
+
+  buffer.forEachLine(0, buffer.size(), [&](size_t index, std::string_view line)
+                     {
+                       if (index > 0)
+                         text += '\n';
+                       text += line;
+                       return true; });
+
+  return text;
+}
+
+void setUpEditor(Editor &e)
+{
+  e.screenRows = 24;
+  e.screenCols = 80;
+}
+
+void typeKeys(Editor &e, const std::string &keys)
+{
+  for (char key : keys)
+    processKey(e, (unsigned char)key);
+}
+
+int main(int argc, char **argv)
+{
+  int run = 0;
+
+  for (const TestCase &test : testCases())
+  {
+    bool wanted = argc == 1;
+
+    for (int i = 1; i < argc; i++)
+      wanted |= strcmp(argv[i], test.name) == 0;
+
+    if (!wanted)
+      continue;
+
+    int before = failures;
+
+    test.run();
+    run++;
+    fprintf(stderr, "%s %s\n", failures == before ? "ok  " : "FAIL", test.name);
+  }
+
+  fprintf(stderr, "%d tests, %d failed checks\n", run, failures);
+  return failures == 0 && run > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
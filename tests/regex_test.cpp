@@ -0,0 +1,93 @@
+#include "regex.h"
+#include "test.h"
+
+// The match of pattern in line at or after `from`, as "start:length", or
+// "none".
+static std::string match(const std::string &pattern, std::string_view line, size_t from = 0)
+{
+  Regex regex;
+  std::string error;
+  size_t start, length;
+
+  if (!regex.compile(pattern, error))
+    return "invalid";
+
+  if (!regex.search(line, from, start, length))
+    return "none";
+
+  return std::to_string(start) + ":" + std::to_string(length);
+}
+
+TEST(regexMatchesLeftmostLongest)
+{
+  CHECK(match("a|ab", "xab") == "1:2");
+  CHECK(match("a*", "baaa") == "0:0");
+  CHECK(match("a+", "baaa") == "1:3");
+  CHECK(match("(ab)+c?", "zababc") == "1:5");
+  CHECK(match("x(a|bc)*y", "xbcaay") == "0:6");
+  CHECK(match("colou?r", "color colour") == "0:5");
+  CHECK(match("colou?r", "color colour", 1) == "6:6");
+}
+
+TEST(regexPrefersEarlierStartsOverEarlierEnds)
+{
+  CHECK(match("abcd|c", "abcd") == "0:4");
+  CHECK(match("abc|bcyy", "xabcyy") == "1:3");
+  CHECK(match("b|abcd|cd", "xabcd") == "1:4");
+  CHECK(match("a|b*", "bbba") == "0:3");
+}
+
+TEST(regexScansLongLinesInOnePass)
+{
+  // Every start before the 'b' is a candidate that runs to the line end.
+  std::string line(200000, 'a');
+
+  CHECK(match("a*b", line + "b") == "0:200001");
+  CHECK(match("(a|aa)*b", "x" + line + "b") == "1:200001");
+  CHECK(match("a*b", line) == "none");
+}
+
+TEST(regexClassesAndEscapes)
+{
+  CHECK(match("[a-c]+", "xxbcaz") == "2:3");
+  CHECK(match("[^a-z ]+", "abc DEF1 g") == "4:4");
+  CHECK(match("\\d+", "id=4711;") == "3:4");
+  CHECK(match("\\w+", "  foo_1 ") == "2:5");
+  CHECK(match("\\s\\S", "ab  c") == "3:2");
+  CHECK(match("a.c", "abc") == "0:3");
+  CHECK(match("a\\.c", "abc a.c") == "4:3");
+  CHECK(match("x{2,3}", "xxxxx") == "0:3");
+  CHECK(match("x{2}", "x x xx") == "4:2");
+}
+
+TEST(regexAnchors)
+{
+  CHECK(match("^ab", "abab") == "0:2");
+  CHECK(match("^ab", "abab", 1) == "none");
+  CHECK(match("ab$", "abab") == "2:2");
+  CHECK(match("^$", "") == "0:0");
+  CHECK(match("^$", "a") == "none");
+  CHECK(match("^a*$", "aaa") == "0:3");
+}
+
+TEST(regexRejectsBadPatterns)
+{
+  CHECK(match("(ab", "ab") == "invalid");
+  CHECK(match("[ab", "ab") == "invalid");
+  CHECK(match("*a", "a") == "invalid");
+  CHECK(match("a{3,2}", "aaa") == "invalid");
+}
+
+TEST(regexRequiredLiteral)
+{
+  Regex regex;
+  std::string error;
+
+  CHECK(regex.compile("hello", error));
+  CHECK(regex.isLiteral());
+  CHECK(regex.requiredLiteral() == "hello");
+
+  CHECK(regex.compile("\\d+ apples?", error));
+  CHECK(!regex.isLiteral());
+  CHECK(regex.requiredLiteral() == " apple");
+}
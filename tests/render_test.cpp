@@ -0,0 +1,99 @@
+#include <cstdio>
+
+#include "render.h"
+#include "test.h"
+
+// The characters of a frame's row, without their attributes.
+static std::string rowText(Frame &frame, int y)
+{
+  std::string text;
+
+  for (int x = 0; x < frame.cols; x++)
+    text += (char)(frame.row(y)[x] & A_CHARTEXT);
+
+  return text;
+}
+
+// The characters curses holds for a row of the screen, `cols` wide.
+static std::string screenText(int y, int cols)
+{
+  std::string text;
+
+  for (int x = 0; x < cols; x++)
+    text += (char)(mvinch(y, x) & A_CHARTEXT);
+
+  return text;
+}
+
+TEST(putTextClipsAndBlanksControlCharacters)
+{
+  Renderer r;
+
+  beginFrame(r, 2, 8);
+
+  CHECK(putText(r.next, 0, 5, "abcdef", 6, A_BOLD) == 3);
+  CHECK(rowText(r.next, 0) == "     abc");
+  CHECK((r.next.row(0)[5] & A_ATTRIBUTES) == A_BOLD);
+  CHECK((r.next.row(0)[4] & A_ATTRIBUTES) == 0);
+
+  CHECK(putText(r.next, 1, 0, "a\tb\x7f", 4, 0) == 4);
+  CHECK(rowText(r.next, 1) == "a b     ");
+
+  CHECK(putText(r.next, 2, 0, "x", 1, 0) == 0);
+  CHECK(putText(r.next, 0, 8, "x", 1, 0) == 0);
+
+  putAttr(r.next, 1, -2, 4, A_REVERSE);
+  CHECK((r.next.row(1)[1] & A_REVERSE) != 0);
+  CHECK((r.next.row(1)[2] & A_REVERSE) == 0);
+  CHECK(rowText(r.next, 1) == "a b     ");
+
+  clearRow(r.next, 1);
+  CHECK(rowText(r.next, 1) == "        ");
+}
+
+TEST(flushFrameWritesOnlyChangedCells)
+{
+  FILE *out = fopen("/dev/null", "w"), *in = fopen("/dev/null", "r");
+  SCREEN *screen = out && in ? newterm("vt100", out, in) : nullptr;
+
+  CHECK(screen != nullptr);
+
+  if (screen)
+  {
+    Renderer r;
+
+    beginFrame(r, 3, 10);
+    putText(r.next, 0, 0, "first", 5, 0);
+    putText(r.next, 1, 0, "second", 6, 0);
+    flushFrame(r);
+
+    CHECK(screenText(0, 10) == "first     ");
+    CHECK(screenText(1, 10) == "second    ");
+    CHECK(r.shown.cells == r.next.cells);
+
+    // Marks left on the screen show which cells are written again.
+    mvaddch(0, 9, 'Z');
+    mvaddch(1, 9, 'Z');
+    putText(r.next, 1, 0, "SE", 2, 0);
+    flushFrame(r);
+
+    CHECK(screenText(0, 10) == "first    Z");
+    CHECK(screenText(1, 10) == "SEcond   Z");
+    CHECK(r.shown.cells == r.next.cells);
+
+    // A resize makes every cell count as changed.
+    beginFrame(r, 3, 12);
+    putText(r.next, 0, 0, "first", 5, 0);
+    flushFrame(r);
+    CHECK(screenText(0, 12) == "first       ");
+    CHECK(screenText(1, 12) == "            ");
+
+    endwin();
+    delscreen(screen);
+  }
+
+  if (out)
+    fclose(out);
+  if (in)
+    fclose(in);
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+
+#include "search.h"
+#include "simd.h"
+#include "synthetic.h"
+#include "test.h"
+
+// Mostly 'a's, so that partial matches of the needles are everywhere.
+static std::string nearMisses(BenchRandom &random, size_t size)
+{
+  std::string text;
+
+  for (size_t i = 0; i < size; i++)
+    text += "aaaaaab\n"[random.below(8)];
+
+  return text;
+}
+
+TEST(substringSearchMatchesAPlainOne)
+{
+  BenchRandom random(20);
+  std::string text = nearMisses(random, 4096);
+
+  for (size_t needleLength : {1, 2, 3, 7, 16, 17, 31, 32, 33, 40})
+    for (int attempt = 0; attempt < 8; attempt++)
+    {
+      std::string needle = nearMisses(random, needleLength);
+      size_t start = random.below(64), length = random.below(text.size() - start + 1);
+      std::string_view data(text.data() + start, length);
+      size_t expected = data.find(needle);
+
+      CHECK(findSubstring(data.data(), data.size(), needle.data(), needle.size()) == (expected == std::string_view::npos ? SIZE_MAX : expected));
+    }
+}
+
+TEST(byteCountMatchesAPlainOne)
+{
+  BenchRandom random(21);
+  std::string text = nearMisses(random, 4096);
+
+  for (size_t start = 0; start < 64; start++)
+    for (size_t length : {0, 1, 31, 32, 33, 63, 64, 65, 1000, 4000})
+      CHECK(countByte(text.data() + start, length, '\n') == (size_t)std::count(text.begin() + start, text.begin() + start + length, '\n'));
+}
+
+TEST(searchWrapsAroundAndCountsMatches)
+{
+  TempDir dir;
+  TextBuffer buffer;
+  WorkerPool pool;
+  Search search;
+  TextPos match;
+
+  CHECK(writeFile(dir.path("a.txt"), "alpha beta\ngamma\nbeta beta\ndelta\n"));
+  CHECK(buffer.load(dir.path("a.txt")));
+  buffer.finishLoading();
+  search.setPattern("beta");
+
+  CHECK(search.next(buffer, {0, 0}, match) && match.line == 0 && match.column == 6);
+  CHECK(search.next(buffer, {0, 7}, match) && match.line == 2 && match.column == 0);
+  CHECK(search.next(buffer, {2, 6}, match) && match.line == 0 && match.column == 6);
+  CHECK(search.previous(buffer, {2, 0}, match) && match.line == 0 && match.column == 6);
+  CHECK(search.previous(buffer, {0, 6}, match) && match.line == 2 && match.column == 5);
+  CHECK(search.count(buffer, pool) == 3);
+
+  std::vector<std::pair<size_t, size_t>> matches;
+
+  search.matchesInLine("beta betabeta", matches);
+  CHECK(matches == (std::vector<std::pair<size_t, size_t>>{{0, 4}, {5, 4}, {9, 4}}));
+
+  // An edited line is searched as well, and the count follows the edit.
+  insertText(buffer, {3, 0}, "beta ");
+  CHECK(search.count(buffer, pool) == 4);
+  CHECK(search.next(buffer, {2, 6}, match) && match.line == 3 && match.column == 0);
+
+  search.setPattern("missing");
+  CHECK(!search.next(buffer, {0, 0}, match));
+  CHECK(search.count(buffer, pool) == 0);
+}
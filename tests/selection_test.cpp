@@ -0,0 +1,72 @@
+#include "synthetic.h"
+#include "test.h"
+
+static void openText(Editor &e, TempDir &dir, const std::string &text)
+{
+  CHECK(writeFile(dir.path("a.txt"), text));
+  setUpEditor(e);
+  openFile(e, dir.path("a.txt"));
+}
+
+TEST(lineSelectionIndentsAndOutdents)
+{
+  TempDir dir;
+  Editor e;
+
+  openText(e, dir, "a\nb\n\nc\nd\n");
+  typeKeys(e, "svss>");
+  CHECK(bufferText(e.buffer) == "a\n    b\n\n    c\nd");
+
+  // The indent undoes as one step.
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) == "a\nb\n\nc\nd");
+  typeKeys(e, "r<<");
+  CHECK(bufferText(e.buffer) == "a\nb\n\nc\nd");
+}
+
+TEST(lineSelectionDeletesAndInsertsAtBothEnds)
+{
+  TempDir dir;
+  Editor e;
+
+  openText(e, dir, "one\ntwo\nthree\nfour\n");
+  typeKeys(e, "vs:i > \n");
+  CHECK(bufferText(e.buffer) == "> one\n> two\nthree\nfour");
+  typeKeys(e, ":a ;\n");
+  CHECK(bufferText(e.buffer) == "> one;\n> two;\nthree\nfour");
+
+  typeKeys(e, "x");
+  CHECK(bufferText(e.buffer) == "three\nfour");
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) == "> one;\n> two;\nthree\nfour");
+}
+
+TEST(blockSelectionEditsItsColumns)
+{
+  TempDir dir;
+  Editor e;
+
+  openText(e, dir, "abcdef\nghijkl\nmn\nopqrst\n");
+  processKey(e, KEY_RIGHT);
+  typeKeys(e, "b");
+  typeKeys(e, "sss");
+  processKey(e, KEY_RIGHT);
+  processKey(e, KEY_RIGHT);
+  typeKeys(e, "x");
+  CHECK(bufferText(e.buffer) == "aef\ngkl\nm\nost");
+
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) == "abcdef\nghijkl\nmn\nopqrst");
+
+  // Lines ending left of the block are left alone.
+  typeKeys(e, "a");
+  processKey(e, KEY_RIGHT);
+  typeKeys(e, "bsss");
+  processKey(e, KEY_RIGHT);
+  processKey(e, KEY_RIGHT);
+  typeKeys(e, ":a ]\n:i [\n");
+  CHECK(bufferText(e.buffer) == "a[bcd]ef\ng[hij]kl\nm[n\no[pqr]st");
+
+  typeKeys(e, "\x1b");
+  CHECK(e.selection == Editor::SELECT_NONE);
+}
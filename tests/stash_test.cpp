@@ -0,0 +1,68 @@
+#include "synthetic.h"
+#include "test.h"
+
+static std::vector<std::string> stashedNames(const Editor &e)
+{
+  std::vector<std::string> names;
+
+  for (const StashedFile &file : e.stash)
+    names.push_back(file.fileName);
+
+  return names;
+}
+
+TEST(switchingBackRestoresTheStashedFile)
+{
+  TempDir dir;
+  Editor e;
+
+  CHECK(writeFile(dir.path("a.txt"), "one\ntwo\nthree\n"));
+  CHECK(writeFile(dir.path("b.txt"), "bee\n"));
+  setUpEditor(e);
+  openFile(e, dir.path("a.txt"));
+
+  typeKeys(e, "ssix\x1b");
+  CHECK(bufferText(e.buffer) == "one\ntwo\nxthree");
+
+  typeKeys(e, ":swp " + dir.path("b.txt") + "\n");
+  CHECK(e.fileName == dir.path("b.txt"));
+  CHECK(bufferText(e.buffer) == "bee");
+  CHECK(stashedNames(e) == std::vector<std::string>{dir.path("a.txt")});
+
+  typeKeys(e, ":swp " + dir.path("a.txt") + "\n");
+  CHECK(e.fileName == dir.path("a.txt"));
+  CHECK(bufferText(e.buffer) == "one\ntwo\nxthree");
+  CHECK(e.y == 2 && e.x == 1);
+  CHECK(stashedNames(e) == std::vector<std::string>{dir.path("b.txt")});
+
+  // The undo history came back with it.
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) == "one\ntwo\nthree");
+}
+
+TEST(stashDropsLeastRecentlyUsedSavedFilesPastItsCap)
+{
+  TempDir dir;
+  Editor e;
+  std::string a = dir.path("a.txt"), b = dir.path("b.txt"), c = dir.path("c.txt");
+
+  CHECK(writeFile(a, "a\n") && writeFile(b, "b\n") && writeFile(c, "c\n"));
+  setUpEditor(e);
+  openFile(e, a);
+
+  typeKeys(e, ":swp " + b + "\n");
+  typeKeys(e, ":swp " + c + "\n");
+  CHECK(stashedNames(e) == (std::vector<std::string>{b, a}));
+
+  typeKeys(e, ":swp " + a + "\n");
+  CHECK(stashedNames(e) == (std::vector<std::string>{c, b}));
+
+  // Unsaved changes are kept whatever the cap.
+  typeKeys(e, "ix\x1b");
+  typeKeys(e, ":cswp " + dir.path("d.txt") + "\n");
+  CHECK(stashedNames(e) == (std::vector<std::string>{a, c, b}));
+
+  typeKeys(e, ":bufcap 0\n");
+  CHECK(stashedNames(e) == std::vector<std::string>{a});
+  CHECK(e.stash.front().unSavedChanges);
+}
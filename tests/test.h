@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "editor.h"
+
+// A small test runner with no dependencies. TEST(name) defines and
+// registers a test; CHECK(condition) reports a failed condition with its
+// location and lets the test carry on.
+struct TestCase
+{
+  const char *name;
+  void (*run)();
+};
+
+std::vector<TestCase> &testCases();
+void reportFailure(const char *file, int line, const char *condition);
+
+struct TestRegistration
+{
+  TestRegistration(const char *name, void (*run)()) { testCases().push_back({name, run}); }
+};
+
+#define TEST(name)                                              \
+  static void name();                                           \
+  static TestRegistration name##Registration(#name, name);      \
+  static void name()
+
+#define CHECK(condition) ((condition) ? (void)0 : reportFailure(__FILE__, __LINE__, #condition))
+
+// A directory of its own for each test's files, removed afterwards.
+class TempDir
+{
+public:
+  TempDir();
+  ~TempDir();
+
+  TempDir(const TempDir &) = delete;
+  TempDir &operator=(const TempDir &) = delete;
+
+  std::string path(const std::string &name) const { return dir + "/" + name; }
+
+private:
+  std::string dir;
+};
+
+// The buffer's lines joined by '\n'.
+std::string bufferText(const TextBuffer &buffer);
+
+// An editor with a screen of its own, not drawn to a terminal.
+void setUpEditor(Editor &e);
+
+// Feeds keys to the editor; '\n' is Enter and '\x1b' Escape, as typed.
+void typeKeys(Editor &e, const std::string &keys);
@@ -0,0 +1,132 @@
+#include "synthetic.h"
+#include "test.h"
+#include "undo.h"
+
+static TextPos typeText(TextBuffer &buffer, UndoJournal &undo, TextPos at, const std::string &text)
+{
+  for (char c : text)
+  {
+    undo.recordInsert(at, std::string_view(&c, 1), true);
+    at = insertText(buffer, at, std::string_view(&c, 1));
+  }
+
+  return at;
+}
+
+static size_t undoAll(TextBuffer &buffer, UndoJournal &undo)
+{
+  TextPos cursor;
+  size_t steps = 0;
+
+  while (undo.undo(buffer, cursor))
+    steps++;
+
+  return steps;
+}
+
+TEST(typedRunUndoesAsOneStep)
+{
+  TextBuffer buffer;
+  UndoJournal undo;
+  TextPos cursor;
+
+  buffer.insertLine(0, "hello");
+  typeText(buffer, undo, {0, 5}, " world");
+  CHECK(bufferText(buffer) == "hello world");
+
+  CHECK(undo.undo(buffer, cursor));
+  CHECK(bufferText(buffer) == "hello");
+  CHECK(cursor.line == 0 && cursor.column == 5);
+  CHECK(!undo.undo(buffer, cursor));
+
+  CHECK(undo.redo(buffer, cursor));
+  CHECK(bufferText(buffer) == "hello world");
+}
+
+TEST(runsBreakWhereTypingJumps)
+{
+  TextBuffer buffer;
+  UndoJournal undo;
+
+  buffer.insertLine(0, "abc");
+  typeText(buffer, undo, {0, 3}, "de");
+  typeText(buffer, undo, {0, 0}, "xy");
+  undo.seal();
+  typeText(buffer, undo, {0, 2}, "z");
+  CHECK(bufferText(buffer) == "xyzabcde");
+
+  CHECK(undoAll(buffer, undo) == 3);
+  CHECK(bufferText(buffer) == "abc");
+}
+
+TEST(backspacesCoalesce)
+{
+  TextBuffer buffer;
+  UndoJournal undo;
+  TextPos cursor;
+
+  buffer.insertLine(0, "abcdef");
+
+  for (size_t column = 6; column > 2; column--)
+    undo.recordErase({0, column - 1}, eraseText(buffer, {0, column - 1}, {0, column}), true);
+
+  CHECK(bufferText(buffer) == "ab");
+  CHECK(undo.undo(buffer, cursor));
+  CHECK(bufferText(buffer) == "abcdef");
+  CHECK(!undo.undo(buffer, cursor));
+}
+
+TEST(groupUndoesAsOneStep)
+{
+  TextBuffer buffer;
+  UndoJournal undo;
+
+  buffer.insertLine(0, "one");
+  undo.beginGroup();
+  undo.recordInsert({0, 3}, "\ntwo", false);
+  insertText(buffer, {0, 3}, "\ntwo");
+  undo.recordErase({0, 0}, eraseText(buffer, {0, 0}, {0, 1}), false);
+  undo.endGroup();
+  CHECK(bufferText(buffer) == "ne\ntwo");
+
+  CHECK(undoAll(buffer, undo) == 1);
+  CHECK(bufferText(buffer) == "one");
+}
+
+TEST(capDropsOldestSteps)
+{
+  TextBuffer buffer;
+  UndoJournal undo;
+
+  buffer.insertLine(0, "");
+  undo.setCap(1 << 10);
+
+  for (int i = 0; i < 100; i++)
+  {
+    std::string text(64, 'a' + i % 26);
+
+    undo.seal();
+    undo.recordInsert({0, 0}, text, false);
+    insertText(buffer, {0, 0}, text);
+  }
+
+  CHECK(undo.memoryUsed() <= 2 << 10);
+  CHECK(undoAll(buffer, undo) < 100);
+}
+
+TEST(editorUndoesTypingAndRedoes)
+{
+  TempDir dir;
+  Editor e;
+
+  CHECK(writeFile(dir.path("a.txt"), "hello\n"));
+  setUpEditor(e);
+  openFile(e, dir.path("a.txt"));
+
+  typeKeys(e, "iabc\x1b");
+  CHECK(bufferText(e.buffer) == "abchello");
+  typeKeys(e, "u");
+  CHECK(bufferText(e.buffer) == "hello");
+  typeKeys(e, "r");
+  CHECK(bufferText(e.buffer) == "abchello");
+}
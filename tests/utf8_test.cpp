@@ -0,0 +1,133 @@
+#include "render.h"
+#include "simd.h"
+#include "synthetic.h"
+#include "test.h"
+#include "utf8.h"
+
+// Byte offsets and columns of every character start in text, by decoding
+// it from the beginning, plus the end.
+static void layOut(std::string_view text, std::vector<size_t> &bytes, std::vector<size_t> &columns)
+{
+  size_t column = 0;
+
+  for (size_t at = 0; at < text.size();)
+  {
+    char32_t c;
+    size_t length = decodeUtf8(text, at, c);
+
+    bytes.push_back(at);
+    columns.push_back(column);
+    column += charWidth(c);
+    at += length;
+  }
+
+  bytes.push_back(text.size());
+  columns.push_back(column);
+}
+
+TEST(utf8DecodesAndEncodes)
+{
+  char32_t c;
+  char out[4];
+
+  for (char32_t sample : {U'a', U'é', U'日', U'\U0001F600'})
+  {
+    size_t length = encodeUtf8(sample, out);
+
+    CHECK(decodeUtf8(std::string_view(out, length), 0, c) == length && c == sample);
+    CHECK(utf8SequenceLength(out[0]) == length);
+  }
+
+  // Stray, truncated and overlong sequences read a byte at a time.
+  CHECK(decodeUtf8("\x80z", 0, c) == 1 && c == 0xFFFD);
+  CHECK(decodeUtf8("\xE6\x97", 0, c) == 1 && c == 0xFFFD);
+  CHECK(decodeUtf8("\xC0\xAF", 0, c) == 1 && c == 0xFFFD);
+
+  CHECK(charWidth(U'a') == 1);
+  CHECK(charWidth(U'日') == 2);
+  CHECK(charWidth(U'́') == 0);
+}
+
+TEST(nonAsciiScanMatchesAPlainOne)
+{
+  std::string text(4096, 'a');
+
+  for (size_t at : {0, 1, 15, 16, 31, 32, 33, 63, 64, 1000, 4095})
+  {
+    text[at] = '\xC3';
+
+    for (size_t start = 0; start < 64 && start <= at; start++)
+      CHECK(findNonAscii(text.data() + start, text.size() - start) == at - start);
+
+    CHECK(findNonAscii(text.data(), at) == SIZE_MAX);
+    text[at] = 'a';
+  }
+}
+
+TEST(columnsOfMixedLinesMatchAPlainLayout)
+{
+  BenchRandom random(19);
+  static const char *const PIECES[] = {"a", "bc", "\xC3\xA9", "\xE6\x97\xA5", "e\xCC\x81", "\xF0\x9F\x98\x80", "\t", "\xFF"};
+  TextBuffer buffer;
+  ColumnCache cache;
+
+  buffer.insertLine(0, "plain ascii");
+
+  // Long enough to need several marks.
+  for (size_t line = 1; line < 4; line++)
+  {
+    std::string text;
+
+    while (text.size() < ColumnCache::MARK_BYTES * 5)
+      text += PIECES[random.below(8)];
+
+    buffer.insertLine(line, text);
+  }
+
+  for (size_t line = 0; line < buffer.size(); line++)
+  {
+    std::string text(buffer.line(line));
+    std::vector<size_t> bytes, columns;
+
+    layOut(text, bytes, columns);
+
+    for (size_t i = 0; i + 1 < bytes.size(); i++)
+    {
+      CHECK(cache.columnOf(buffer, line, bytes[i]) == columns[i]);
+
+      // Zero-width characters go with the one before them.
+      size_t next = i + 1;
+      while (next + 1 < bytes.size() && columns[next] == columns[next + 1])
+        next++;
+
+      CHECK(cache.nextChar(buffer, line, bytes[i]) == bytes[next]);
+    }
+
+    for (size_t i = 0; i + 1 < bytes.size(); i++)
+      if (columns[i + 1] > columns[i])
+        CHECK(cache.byteAt(buffer, line, columns[i + 1] - 1) == bytes[i]);
+
+    CHECK(cache.byteAt(buffer, line, columns.back() + 5) == text.size());
+  }
+
+  // Edits drop the maps.
+  insertText(buffer, {1, 0}, "\xE6\x97\xA5");
+  CHECK(cache.columnOf(buffer, 1, 3) == 2);
+  CHECK(cache.previousChar(buffer, 1, 3) == 0);
+}
+
+TEST(wideCharactersTakeTwoCells)
+{
+  Renderer r;
+
+  beginFrame(r, 1, 6);
+  CHECK(putText(r.next, 0, 0, "a\xE6\x97\xA5" "b\xE6\x97\xA5", 8, 0) == 6);
+  CHECK((r.next.row(0)[0] & A_CHARTEXT) == 'a');
+  CHECK(r.next.glyphRow(0)[1] == U'日' && r.next.glyphRow(0)[2] == Frame::WIDE_TAIL);
+  CHECK((r.next.row(0)[3] & A_CHARTEXT) == 'b');
+
+  // One that does not fit is cut to a blank.
+  beginFrame(r, 1, 2);
+  CHECK(putText(r.next, 0, 0, "a\xE6\x97\xA5", 4, 0) == 2);
+  CHECK((r.next.row(0)[1] & A_CHARTEXT) == ' ');
+}